@@ -25,8 +25,11 @@ int blockConstruct_constructP(const void *o1, const void *o2) {
 
 Block *block_construct(int64_t length, Flower *flower) {
     assert(flower != NULL);
+    return block_construct2(cactusDisk_getUniqueIDInterval(flower_getCactusDisk(flower), 3), length, flower);
+}
 
-    Name name = cactusDisk_getUniqueIDInterval(flower_getCactusDisk(flower), 3);
+Block *block_construct2(Name name, int64_t length, Flower *flower) {
+    assert(flower != NULL);
 
 	Block *block = st_calloc(1, 6*sizeof(Block) + sizeof(BlockEndContents));
     // Bits: (0) orientation / (1) part_of_block / (2) is_block / (3) left / (4) is_attached / (5) side
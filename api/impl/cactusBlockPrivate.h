@@ -23,9 +23,10 @@ struct _block_instanceIterator {
 ////////////////////////////////////////////////
 
 /*
- * Constructs the block, but not its ends.
+ * Constructs the block and its ends, using the given name for the 5' end. The block and 3' end take the
+ * following two names.
  */
-Block *block_construct2(Name name, int64_t length, End *leftEnd, End *rightEnd, Flower *flower);
+Block *block_construct2(Name name, int64_t length, Flower *flower);
 
 /*
  * Destructs the block and all segments it contains.
@@ -89,6 +89,16 @@ char *cactusDisk_getString(CactusDisk *cactusDisk, Name name, int64_t start, int
     return string;
 }
 
+void cactusDisk_removeString(CactusDisk *cactusDisk, Name name) {
+#if defined(_OPENMP)
+    omp_set_lock(&(cactusDisk->writelock));
+#endif
+    free(stHash_remove(cactusDisk->allStrings, (void *)name)); // Cheeky 64bit int to pointer conversion
+#if defined(_OPENMP)
+    omp_unset_lock(&(cactusDisk->writelock));
+#endif
+}
+
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -72,6 +72,11 @@ Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string);
 char *cactusDisk_getString(CactusDisk *cactusDisk, Name name,
         int64_t start, int64_t length, int64_t strand, int64_t totalSequenceLength);
 
+/*
+ * Frees a string from the database, if it is still present.
+ */
+void cactusDisk_removeString(CactusDisk *cactusDisk, Name name);
+
 /*
  * Set the event tree for this disk. (Hopefully this only happens once.)
  */
@@ -20,10 +20,14 @@ SegmentCapContents *segment_getContents(Segment *segment) {
 }
 
 Segment *segment_construct(Block *block, Event *event) {
-    assert(event != NULL);
     assert(block != NULL);
+    return segment_construct3(cactusDisk_getUniqueIDInterval(flower_getCactusDisk(block_getFlower(block)), 3),
+                              block, event);
+}
 
-    Name instance = cactusDisk_getUniqueIDInterval(flower_getCactusDisk(block_getFlower(block)), 3);
+Segment *segment_construct3(Name instance, Block *block, Event *event) {
+    assert(event != NULL);
+    assert(block != NULL);
     assert(instance != NULL_NAME);
 
     // Create the combined forward and reverse caps
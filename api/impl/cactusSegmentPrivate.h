@@ -18,10 +18,10 @@
 ////////////////////////////////////////////////
 
 /*
- * Constructs segment with the two caps, which must both have the same instance name.
+ * Constructs the segment and its two caps, using the given name for the 5' cap. The segment and 3' cap take the
+ * following two names.
  */
-Segment *segment_construct3(Name name, Block *block,
-		Cap *_5Cap, Cap *_3Cap);
+Segment *segment_construct3(Name instance, Block *block, Event *event);
 
 /*
  * Destruct the segment, does not destruct ends.
@@ -0,0 +1,571 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include "cactusSnapshot.h"
+
+/*
+ * Layout of a snapshot, in order:
+ *  header: magic, version, stage label, next unused name, root flower name
+ *  event tree: the root event, then the other events in pre-order, each after its parent
+ *  strings: name, length, bases
+ *  sequences
+ *  flowers, each: its sequences, its ends (a stub end with its caps, or a block with its segments) in name order
+ *  terminated by a sentinel, the adjacencies between its caps, its groups with their ends, its chains with their links
+ */
+
+static const char snapshotMagic[8] = { 'C', 'A', 'C', 'T', 'U', 'S', 'S', 'N' };
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BUFFER_SIZE (1 << 22)
+
+#define SNAPSHOT_STUB_END 0
+#define SNAPSHOT_BLOCK 1
+#define SNAPSHOT_END_OF_ENDS 2
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Primitive reads and writes.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static void writeBytes(FILE *fileHandle, const void *bytes, size_t length) {
+    if (fwrite(bytes, 1, length, fileHandle) != length) {
+        st_errAbort("Failed to write to cactus snapshot");
+    }
+}
+
+static void readBytes(FILE *fileHandle, void *bytes, size_t length) {
+    if (fread(bytes, 1, length, fileHandle) != length) {
+        st_errAbort("Cactus snapshot is truncated");
+    }
+}
+
+static void writeInt(FILE *fileHandle, int64_t i) {
+    writeBytes(fileHandle, &i, sizeof(int64_t));
+}
+
+static int64_t readInt(FILE *fileHandle) {
+    int64_t i;
+    readBytes(fileHandle, &i, sizeof(int64_t));
+    return i;
+}
+
+static void writeChar(FILE *fileHandle, char c) {
+    writeBytes(fileHandle, &c, 1);
+}
+
+static char readChar(FILE *fileHandle) {
+    char c;
+    readBytes(fileHandle, &c, 1);
+    return c;
+}
+
+static void writeString(FILE *fileHandle, const char *string) {
+    int64_t length = strlen(string);
+    writeInt(fileHandle, length);
+    writeBytes(fileHandle, string, length);
+}
+
+static char *readString(FILE *fileHandle) {
+    int64_t length = readInt(fileHandle);
+    if (length < 0) {
+        st_errAbort("Cactus snapshot is corrupt, got a string of length %" PRIi64, length);
+    }
+    char *string = st_malloc(length + 1);
+    readBytes(fileHandle, string, length);
+    string[length] = '\0';
+    return string;
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Writing.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static void writeEvent(FILE *fileHandle, Event *event) {
+    writeInt(fileHandle, event_getName(event));
+    writeInt(fileHandle, event_getParent(event) != NULL ? event_getName(event_getParent(event)) : NULL_NAME);
+    writeString(fileHandle, event_getHeader(event));
+    float branchLength = event_getBranchLength(event);
+    writeBytes(fileHandle, &branchLength, sizeof(float));
+    writeChar(fileHandle, event_isOutgroup(event));
+    for (int64_t i = 0; i < event_getChildNumber(event); i++) {
+        writeEvent(fileHandle, event_getChild(event, i));
+    }
+}
+
+static int nameCmpFn(const void *a, const void *b) {
+    return cactusMisc_nameCompare((Name)a, (Name)b);
+}
+
+static void writeStrings(FILE *fileHandle, CactusDisk *cactusDisk) {
+    stList *names = stHash_getKeys(cactusDisk->allStrings);
+    stList_sort(names, nameCmpFn); // So that the snapshot of a given disk is always the same
+    writeInt(fileHandle, stList_length(names));
+    for (int64_t i = 0; i < stList_length(names); i++) {
+        void *name = stList_get(names, i);
+        writeInt(fileHandle, (Name)name);
+        writeString(fileHandle, stHash_search(cactusDisk->allStrings, name));
+    }
+    stList_destruct(names);
+}
+
+static void writeSequences(FILE *fileHandle, CactusDisk *cactusDisk) {
+    writeInt(fileHandle, stSortedSet_size(cactusDisk->sequences));
+    stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->sequences);
+    Sequence *sequence;
+    while ((sequence = stSortedSet_getNext(it)) != NULL) {
+        writeInt(fileHandle, sequence->name);
+        writeInt(fileHandle, sequence->start);
+        writeInt(fileHandle, sequence->length);
+        writeInt(fileHandle, sequence->stringName);
+        writeString(fileHandle, sequence->header);
+        writeInt(fileHandle, event_getName(sequence->event));
+        writeChar(fileHandle, sequence->isTrivialSequence);
+    }
+    stSortedSet_destructIterator(it);
+}
+
+/*
+ * Writes the event, sequence and coordinates shared by a stub cap and the 5' cap of a segment.
+ */
+static void writeCapCoordinates(FILE *fileHandle, Cap *cap) {
+    writeInt(fileHandle, event_getName(cap_getEvent(cap)));
+    writeInt(fileHandle, cap_getSequence(cap) != NULL ? sequence_getName(cap_getSequence(cap)) : NULL_NAME);
+    writeInt(fileHandle, cap_getCoordinate(cap));
+    writeChar(fileHandle, cap_getStrand(cap));
+}
+
+static void writeStubEnd(FILE *fileHandle, End *end) {
+    writeChar(fileHandle, SNAPSHOT_STUB_END);
+    writeInt(fileHandle, end_getName(end));
+    writeChar(fileHandle, end_isAttached(end));
+    writeChar(fileHandle, end_getSide(end));
+    writeInt(fileHandle, end_getInstanceNumber(end));
+    End_InstanceIterator *capIt = end_getInstanceIterator(end);
+    Cap *cap;
+    while ((cap = end_getNext(capIt)) != NULL) {
+        writeInt(fileHandle, cap_getName(cap));
+        writeCapCoordinates(fileHandle, cap);
+    }
+    end_destructInstanceIterator(capIt);
+}
+
+static void writeBlock(FILE *fileHandle, Block *block) {
+    writeChar(fileHandle, SNAPSHOT_BLOCK);
+    writeInt(fileHandle, end_getName(block_get5End(block)));
+    writeInt(fileHandle, block_getLength(block));
+    writeInt(fileHandle, block_getInstanceNumber(block));
+    Block_InstanceIterator *segmentIt = block_getInstanceIterator(block);
+    Segment *segment;
+    while ((segment = block_getNext(segmentIt)) != NULL) {
+        Cap *cap = segment_get5Cap(segment);
+        writeInt(fileHandle, segment_getName(segment) - 1);
+        // Whether the segment was constructed on the reverse strand of the block, which determines the cap names
+        writeChar(fileHandle, !cap_left(cap));
+        writeCapCoordinates(fileHandle, cap);
+    }
+    block_destructInstanceIterator(segmentIt);
+}
+
+static void writeFlower(FILE *fileHandle, Flower *flower) {
+    writeInt(fileHandle, flower->name);
+    writeInt(fileHandle, flower->parentFlowerName);
+    writeChar(fileHandle, flower->builtBlocks);
+
+    writeInt(fileHandle, stList_length(flower->sequences));
+    for (int64_t i = 0; i < stList_length(flower->sequences); i++) {
+        writeInt(fileHandle, sequence_getName(stList_get(flower->sequences, i)));
+    }
+
+    // Ends, with their caps
+    assert(flower->ends2 == NULL && flower->caps2 == NULL);
+    for (int64_t i = 0; i < stList_length(flower->ends); i++) {
+        End *end = stList_get(flower->ends, i);
+        if (end_isStubEnd(end)) {
+            writeStubEnd(fileHandle, end);
+        } else {
+            Block *block = block_getPositiveOrientation(end_getBlock(end));
+            if (block_get5End(block) == end) { // Each block is written once, at its 5' end
+                writeBlock(fileHandle, block);
+            }
+        }
+    }
+    writeChar(fileHandle, SNAPSHOT_END_OF_ENDS);
+
+    // Adjacencies, each written once
+    int64_t adjacencyNumber = 0;
+    for (int64_t i = 0; i < stList_length(flower->caps); i++) {
+        Cap *cap = stList_get(flower->caps, i), *adjacentCap = cap_getAdjacency(cap);
+        adjacencyNumber += adjacentCap != NULL && cap_getName(cap) < cap_getName(adjacentCap);
+    }
+    writeInt(fileHandle, adjacencyNumber);
+    for (int64_t i = 0; i < stList_length(flower->caps); i++) {
+        Cap *cap = stList_get(flower->caps, i), *adjacentCap = cap_getAdjacency(cap);
+        if (adjacentCap != NULL && cap_getName(cap) < cap_getName(adjacentCap)) {
+            writeInt(fileHandle, cap_getName(cap));
+            writeInt(fileHandle, cap_getName(adjacentCap));
+        }
+    }
+
+    // Groups, with their ends in order
+    writeInt(fileHandle, stList_length(flower->groups));
+    for (int64_t i = 0; i < stList_length(flower->groups); i++) {
+        Group *group = stList_get(flower->groups, i);
+        writeInt(fileHandle, group_getName(group));
+        writeChar(fileHandle, group_isLeaf(group));
+        writeInt(fileHandle, group_getEndNumber(group));
+        Group_EndIterator *endIt = group_getEndIterator(group);
+        End *end;
+        while ((end = group_getNextEnd(endIt)) != NULL) {
+            writeInt(fileHandle, end_getName(end));
+        }
+        group_destructEndIterator(endIt);
+    }
+
+    // Chains, with their links in order
+    writeInt(fileHandle, stList_length(flower->chains));
+    for (int64_t i = 0; i < stList_length(flower->chains); i++) {
+        Chain *chain = stList_get(flower->chains, i);
+        writeInt(fileHandle, chain_getName(chain));
+        int64_t linkNumber = 0;
+        for (Link *link = chain_getFirst(chain); link != NULL; link = link_getNextLink(link)) {
+            linkNumber++;
+        }
+        writeInt(fileHandle, linkNumber);
+        for (Link *link = chain_getFirst(chain); link != NULL; link = link_getNextLink(link)) {
+            writeInt(fileHandle, group_getName(link_getGroup(link)));
+            writeInt(fileHandle, end_getName(link_get3End(link)));
+            writeInt(fileHandle, end_getName(link_get5End(link)));
+        }
+    }
+}
+
+void cactusSnapshot_write(CactusDisk *cactusDisk, Flower *rootFlower, const char *stage, const char *snapshotFile) {
+    char *tempFile = stString_print("%s.tmp", snapshotFile);
+    FILE *fileHandle = fopen(tempFile, "wb");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open cactus snapshot file for writing: %s", tempFile);
+    }
+    char *buffer = st_malloc(SNAPSHOT_BUFFER_SIZE);
+    setvbuf(fileHandle, buffer, _IOFBF, SNAPSHOT_BUFFER_SIZE);
+
+    writeBytes(fileHandle, snapshotMagic, sizeof(snapshotMagic));
+    writeInt(fileHandle, SNAPSHOT_VERSION);
+    writeString(fileHandle, stage);
+    writeInt(fileHandle, cactusDisk->currentName);
+    writeInt(fileHandle, flower_getName(rootFlower));
+
+    writeChar(fileHandle, cactusDisk->eventTree != NULL);
+    if (cactusDisk->eventTree != NULL) {
+        writeInt(fileHandle, eventTree_getEventNumber(cactusDisk->eventTree));
+        writeEvent(fileHandle, eventTree_getRootEvent(cactusDisk->eventTree));
+    }
+
+    writeStrings(fileHandle, cactusDisk);
+    writeSequences(fileHandle, cactusDisk);
+
+    writeInt(fileHandle, stSortedSet_size(cactusDisk->flowers));
+    stSortedSetIterator *flowerIt = stSortedSet_getIterator(cactusDisk->flowers);
+    Flower *flower;
+    while ((flower = stSortedSet_getNext(flowerIt)) != NULL) {
+        writeFlower(fileHandle, flower);
+    }
+    stSortedSet_destructIterator(flowerIt);
+
+    if (fclose(fileHandle) != 0) {
+        st_errAbort("Failed to write cactus snapshot file: %s", tempFile);
+    }
+    free(buffer);
+    if (rename(tempFile, snapshotFile) != 0) {
+        st_errAbort("Could not move cactus snapshot %s to %s", tempFile, snapshotFile);
+    }
+    free(tempFile);
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Loading.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static Event *getEvent(EventTree *eventTree, Name name) {
+    Event *event = eventTree_getEvent(eventTree, name);
+    if (event == NULL) {
+        st_errAbort("Cactus snapshot is corrupt, event %" PRIi64 " not found", name);
+    }
+    return event;
+}
+
+static void readEventTree(FILE *fileHandle, CactusDisk *cactusDisk) {
+    int64_t eventNumber = readInt(fileHandle);
+    EventTree *eventTree = NULL;
+    for (int64_t i = 0; i < eventNumber; i++) {
+        Name name = readInt(fileHandle);
+        Name parentName = readInt(fileHandle);
+        char *header = readString(fileHandle);
+        float branchLength;
+        readBytes(fileHandle, &branchLength, sizeof(float));
+        bool isOutgroup = readChar(fileHandle);
+        Event *event;
+        if (i == 0) { // The root event
+            eventTree = eventTree_construct(cactusDisk, name);
+            event = eventTree_getRootEvent(eventTree);
+            free(event->header);
+            event->header = stString_copy(header);
+            event->branchLength = branchLength;
+        } else {
+            event = event_construct(name, header, branchLength, getEvent(eventTree, parentName), eventTree);
+        }
+        event_setOutgroupStatus(event, isOutgroup);
+        free(header);
+    }
+}
+
+static void readStrings(FILE *fileHandle, CactusDisk *cactusDisk) {
+    int64_t stringNumber = readInt(fileHandle);
+    for (int64_t i = 0; i < stringNumber; i++) {
+        Name name = readInt(fileHandle);
+        stHash_insert(cactusDisk->allStrings, (void *)name, readString(fileHandle)); // Cheeky 64bit int to pointer conversion
+    }
+}
+
+static Sequence *getSequence(CactusDisk *cactusDisk, Name name) {
+    Sequence *sequence = cactusDisk_getSequence(cactusDisk, name);
+    if (sequence == NULL) {
+        st_errAbort("Cactus snapshot is corrupt, sequence %" PRIi64 " not found", name);
+    }
+    return sequence;
+}
+
+static void readSequences(FILE *fileHandle, CactusDisk *cactusDisk) {
+    int64_t sequenceNumber = readInt(fileHandle);
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        Name name = readInt(fileHandle);
+        int64_t start = readInt(fileHandle);
+        int64_t length = readInt(fileHandle);
+        Name stringName = readInt(fileHandle);
+        char *header = readString(fileHandle);
+        Event *event = getEvent(cactusDisk->eventTree, readInt(fileHandle));
+        bool isTrivialSequence = readChar(fileHandle);
+        sequence_construct2(name, start, length, stringName, header, event, isTrivialSequence, cactusDisk);
+        free(header);
+    }
+}
+
+/*
+ * Reads the values written by writeCapCoordinates.
+ */
+static void readCapCoordinates(FILE *fileHandle, CactusDisk *cactusDisk, Event **event, Name *sequenceName,
+                               int64_t *coordinate, bool *strand) {
+    *event = getEvent(cactusDisk->eventTree, readInt(fileHandle));
+    *sequenceName = readInt(fileHandle);
+    *coordinate = readInt(fileHandle);
+    *strand = readChar(fileHandle);
+}
+
+static void setCapCoordinates(CactusDisk *cactusDisk, Cap *cap, Name sequenceName, int64_t coordinate, bool strand) {
+    cap_setCoordinates(cap, coordinate, strand, sequenceName != NULL_NAME ? getSequence(cactusDisk, sequenceName) : NULL);
+}
+
+/*
+ * The caps of an end and the segments of a block are held in lists that are prepended to, so they are
+ * constructed in reverse to restore their order.
+ */
+
+static void readStubEnd(FILE *fileHandle, Flower *flower) {
+    CactusDisk *cactusDisk = flower_getCactusDisk(flower);
+    Name name = readInt(fileHandle);
+    bool isAttached = readChar(fileHandle);
+    bool side = readChar(fileHandle);
+    End *end = end_construct3(name, isAttached, side, flower);
+    int64_t capNumber = readInt(fileHandle);
+    Name *capNames = st_malloc(sizeof(Name) * capNumber);
+    Event **events = st_malloc(sizeof(Event *) * capNumber);
+    Name *sequenceNames = st_malloc(sizeof(Name) * capNumber);
+    int64_t *coordinates = st_malloc(sizeof(int64_t) * capNumber);
+    bool *strands = st_malloc(sizeof(bool) * capNumber);
+    for (int64_t i = 0; i < capNumber; i++) {
+        capNames[i] = readInt(fileHandle);
+        readCapCoordinates(fileHandle, cactusDisk, &events[i], &sequenceNames[i], &coordinates[i], &strands[i]);
+    }
+    for (int64_t i = capNumber - 1; i >= 0; i--) {
+        Cap *cap = cap_construct3(capNames[i], events[i], end);
+        setCapCoordinates(cactusDisk, cap, sequenceNames[i], coordinates[i], strands[i]);
+    }
+    free(capNames);
+    free(events);
+    free(sequenceNames);
+    free(coordinates);
+    free(strands);
+}
+
+static void readBlock(FILE *fileHandle, Flower *flower) {
+    CactusDisk *cactusDisk = flower_getCactusDisk(flower);
+    Name name = readInt(fileHandle);
+    int64_t length = readInt(fileHandle);
+    Block *block = block_construct2(name, length, flower);
+    int64_t segmentNumber = readInt(fileHandle);
+    Name *segmentNames = st_malloc(sizeof(Name) * segmentNumber);
+    bool *reversed = st_malloc(sizeof(bool) * segmentNumber);
+    Event **events = st_malloc(sizeof(Event *) * segmentNumber);
+    Name *sequenceNames = st_malloc(sizeof(Name) * segmentNumber);
+    int64_t *coordinates = st_malloc(sizeof(int64_t) * segmentNumber);
+    bool *strands = st_malloc(sizeof(bool) * segmentNumber);
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        segmentNames[i] = readInt(fileHandle);
+        reversed[i] = readChar(fileHandle);
+        readCapCoordinates(fileHandle, cactusDisk, &events[i], &sequenceNames[i], &coordinates[i], &strands[i]);
+    }
+    for (int64_t i = segmentNumber - 1; i >= 0; i--) {
+        Segment *segment = segment_construct3(segmentNames[i], reversed[i] ? block_getReverse(block) : block, events[i]);
+        setCapCoordinates(cactusDisk, segment_get5Cap(segment_getPositiveOrientation(segment)), sequenceNames[i],
+                          coordinates[i], strands[i]);
+    }
+    free(segmentNames);
+    free(reversed);
+    free(events);
+    free(sequenceNames);
+    free(coordinates);
+    free(strands);
+}
+
+static End *getEnd(Flower *flower, Name name) {
+    End *end = flower_getEnd(flower, name);
+    if (end == NULL) {
+        st_errAbort("Cactus snapshot is corrupt, end %" PRIi64 " not found in flower %" PRIi64, name,
+                    flower_getName(flower));
+    }
+    return end;
+}
+
+static Cap *getCap(Flower *flower, Name name) {
+    Cap *cap = flower_getCap(flower, name);
+    if (cap == NULL) {
+        st_errAbort("Cactus snapshot is corrupt, cap %" PRIi64 " not found in flower %" PRIi64, name,
+                    flower_getName(flower));
+    }
+    return cap;
+}
+
+static void readFlower(FILE *fileHandle, CactusDisk *cactusDisk) {
+    Flower *flower = flower_construct2(readInt(fileHandle), cactusDisk);
+    flower->parentFlowerName = readInt(fileHandle);
+    flower->builtBlocks = readChar(fileHandle);
+
+    int64_t sequenceNumber = readInt(fileHandle);
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        flower_addSequence(flower, getSequence(cactusDisk, readInt(fileHandle)));
+    }
+
+    // The caps of a block's segments are not adjacent in name order to those of the stub ends, so they
+    // are indexed in sorted sets while loading and sorted into the flower's lists once at the end
+    flower_setFastCapsAndEnds(flower, 1);
+    char tag;
+    while ((tag = readChar(fileHandle)) != SNAPSHOT_END_OF_ENDS) {
+        if (tag == SNAPSHOT_STUB_END) {
+            readStubEnd(fileHandle, flower);
+        } else if (tag == SNAPSHOT_BLOCK) {
+            readBlock(fileHandle, flower);
+        } else {
+            st_errAbort("Cactus snapshot is corrupt, got unknown end type %i", (int)tag);
+        }
+    }
+
+    int64_t adjacencyNumber = readInt(fileHandle);
+    for (int64_t i = 0; i < adjacencyNumber; i++) {
+        Cap *cap = getCap(flower, readInt(fileHandle));
+        cap_makeAdjacent(cap, getCap(flower, readInt(fileHandle)));
+    }
+
+    // Groups, whose ends are prepended and so are added in reverse
+    int64_t groupNumber = readInt(fileHandle);
+    for (int64_t i = 0; i < groupNumber; i++) {
+        Name name = readInt(fileHandle);
+        bool isLeaf = readChar(fileHandle);
+        Group *group = group_construct4(flower, name, isLeaf);
+        int64_t endNumber = readInt(fileHandle);
+        stList *ends = stList_construct();
+        for (int64_t j = 0; j < endNumber; j++) {
+            stList_append(ends, getEnd(flower, readInt(fileHandle)));
+        }
+        while (stList_length(ends) > 0) {
+            end_setGroup(stList_pop(ends), group);
+        }
+        stList_destruct(ends);
+    }
+
+    // Chains, whose links are constructed in order. Constructing a link puts its 5' and 3' ends at the front of its
+    // group's ends, leaving the remaining ends in their order, which restores the order that was written.
+    int64_t chainNumber = readInt(fileHandle);
+    for (int64_t i = 0; i < chainNumber; i++) {
+        Chain *chain = chain_construct2(readInt(fileHandle), flower);
+        int64_t linkNumber = readInt(fileHandle);
+        for (int64_t j = 0; j < linkNumber; j++) {
+            Name groupName = readInt(fileHandle);
+            Group *group = flower_getGroup(flower, groupName);
+            if (group == NULL) {
+                st_errAbort("Cactus snapshot is corrupt, group %" PRIi64 " not found in flower %" PRIi64, groupName,
+                            flower_getName(flower));
+            }
+            End *_3End = getEnd(flower, readInt(fileHandle));
+            link_construct(_3End, getEnd(flower, readInt(fileHandle)), group, chain);
+        }
+    }
+
+    flower_setFastCapsAndEnds(flower, 0);
+}
+
+CactusDisk *cactusSnapshot_load(const char *snapshotFile, Flower **rootFlower, char **stage) {
+    FILE *fileHandle = fopen(snapshotFile, "rb");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open cactus snapshot file: %s", snapshotFile);
+    }
+    char *buffer = st_malloc(SNAPSHOT_BUFFER_SIZE);
+    setvbuf(fileHandle, buffer, _IOFBF, SNAPSHOT_BUFFER_SIZE);
+
+    char magic[sizeof(snapshotMagic)];
+    readBytes(fileHandle, magic, sizeof(magic));
+    if (memcmp(magic, snapshotMagic, sizeof(magic)) != 0) {
+        st_errAbort("Not a cactus snapshot file: %s", snapshotFile);
+    }
+    int64_t version = readInt(fileHandle);
+    if (version != SNAPSHOT_VERSION) {
+        st_errAbort("Cactus snapshot %s has version %" PRIi64 ", expected version %i", snapshotFile, version,
+                    SNAPSHOT_VERSION);
+    }
+    *stage = readString(fileHandle);
+    CactusDisk *cactusDisk = cactusDisk_construct();
+    Name currentName = readInt(fileHandle);
+    Name rootFlowerName = readInt(fileHandle);
+
+    if (readChar(fileHandle)) {
+        readEventTree(fileHandle, cactusDisk);
+    }
+    readStrings(fileHandle, cactusDisk);
+    readSequences(fileHandle, cactusDisk);
+
+    int64_t flowerNumber = readInt(fileHandle);
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        readFlower(fileHandle, cactusDisk);
+    }
+
+    cactusDisk->currentName = currentName;
+
+    fclose(fileHandle);
+    free(buffer);
+
+    *rootFlower = cactusDisk_getFlower(cactusDisk, rootFlowerName);
+    if (*rootFlower == NULL) {
+        st_errAbort("Cactus snapshot is corrupt, root flower %" PRIi64 " not found", rootFlowerName);
+    }
+    return cactusDisk;
+}
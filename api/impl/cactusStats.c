@@ -0,0 +1,219 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <time.h>
+#include <math.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "sonLib.h"
+#include "cactusStats.h"
+
+/*
+ * Per-flower times are binned by powers of two. Bin 0 holds times less than 2^FLOWER_TIME_MIN_EXPONENT seconds,
+ * bin i > 0 holds those in [2^(i-1+FLOWER_TIME_MIN_EXPONENT), 2^(i+FLOWER_TIME_MIN_EXPONENT)), and the last bin also
+ * holds everything longer.
+ */
+#define FLOWER_TIME_BINS 48
+#define FLOWER_TIME_MIN_EXPONENT -20
+
+typedef struct _stageRecord {
+    char *name;
+    int64_t round;
+    int64_t depth;
+    bool ended;
+    double startWallTime, wallTime;
+    double startCpuTime, cpuTime;
+    int64_t peakRss;
+    int64_t startHeapBytes, endHeapBytes;
+} StageRecord;
+
+typedef struct _flowerTimeHistogram {
+    char *name;
+    int64_t flowerNumber;
+    double totalTime, maxTime;
+    int64_t bins[FLOWER_TIME_BINS];
+} FlowerTimeHistogram;
+
+static bool enabled = 0;
+static stList *stages = NULL; // All the stages, in the order they were started
+static stList *openStages = NULL; // The stages not yet ended, innermost last
+static stList *flowerTimeHistograms = NULL;
+
+static void stageRecord_destruct(StageRecord *stage) {
+    free(stage->name);
+    free(stage);
+}
+
+static void flowerTimeHistogram_destruct(FlowerTimeHistogram *histogram) {
+    free(histogram->name);
+    free(histogram);
+}
+
+void cactusStats_enable(void) {
+    if (!enabled) {
+        enabled = 1;
+        stages = stList_construct3(0, (void (*)(void *))stageRecord_destruct);
+        openStages = stList_construct();
+        flowerTimeHistograms = stList_construct3(0, (void (*)(void *))flowerTimeHistogram_destruct);
+    }
+}
+
+bool cactusStats_isEnabled(void) {
+    return enabled;
+}
+
+void cactusStats_reset(void) {
+    if (enabled) {
+        stList_destruct(stages);
+        stList_destruct(openStages);
+        stList_destruct(flowerTimeHistograms);
+        stages = openStages = flowerTimeHistograms = NULL;
+        enabled = 0;
+    }
+}
+
+double cactusStats_getWallTime(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1.0e-9;
+}
+
+static double getCpuTime(void) {
+    // Summed over all the threads of the process
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    return r.ru_utime.tv_sec + r.ru_utime.tv_usec * 1.0e-6 + r.ru_stime.tv_sec + r.ru_stime.tv_usec * 1.0e-6;
+}
+
+static int64_t getPeakRss(void) {
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+#if defined(__APPLE__)
+    return r.ru_maxrss; // Bytes
+#else
+    return r.ru_maxrss * 1024; // Kilobytes
+#endif
+}
+
+/*
+ * The bytes currently allocated by malloc, or -1 if the C library can't say.
+ */
+static int64_t getHeapBytes(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 m = mallinfo2();
+    return m.uordblks + m.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+void cactusStats_startStage(const char *stageName, int64_t round) {
+    if (!enabled) {
+        return;
+    }
+    StageRecord *stage = st_calloc(1, sizeof(StageRecord));
+    stage->name = stString_copy(stageName);
+    stage->round = round;
+    stage->depth = stList_length(openStages);
+    stage->startWallTime = cactusStats_getWallTime();
+    stage->startCpuTime = getCpuTime();
+    stage->startHeapBytes = getHeapBytes();
+    stList_append(stages, stage);
+    stList_append(openStages, stage);
+}
+
+static void stageRecord_update(StageRecord *stage) {
+    stage->wallTime = cactusStats_getWallTime() - stage->startWallTime;
+    stage->cpuTime = getCpuTime() - stage->startCpuTime;
+    stage->peakRss = getPeakRss();
+    stage->endHeapBytes = getHeapBytes();
+}
+
+void cactusStats_endStage(void) {
+    if (!enabled) {
+        return;
+    }
+    if (stList_length(openStages) == 0) {
+        st_errAbort("Tried to end a stage when none has been started");
+    }
+    StageRecord *stage = stList_pop(openStages);
+    stageRecord_update(stage);
+    stage->ended = 1;
+}
+
+static int64_t getFlowerTimeBin(double time) {
+    if (time < ldexp(1.0, FLOWER_TIME_MIN_EXPONENT)) {
+        return 0;
+    }
+    int64_t i = (int64_t)floor(log2(time)) - FLOWER_TIME_MIN_EXPONENT + 1;
+    return i < FLOWER_TIME_BINS ? i : FLOWER_TIME_BINS - 1;
+}
+
+void cactusStats_recordFlowerTime(const char *histogramName, double startTime) {
+    if (!enabled) {
+        return;
+    }
+    double time = cactusStats_getWallTime() - startTime;
+    int64_t bin = getFlowerTimeBin(time);
+#if defined(_OPENMP)
+#pragma omp critical(cactusStats)
+#endif
+    {
+        FlowerTimeHistogram *histogram = NULL;
+        for (int64_t i = 0; i < stList_length(flowerTimeHistograms); i++) {
+            FlowerTimeHistogram *h = stList_get(flowerTimeHistograms, i);
+            if (strcmp(h->name, histogramName) == 0) {
+                histogram = h;
+                break;
+            }
+        }
+        if (histogram == NULL) {
+            histogram = st_calloc(1, sizeof(FlowerTimeHistogram));
+            histogram->name = stString_copy(histogramName);
+            stList_append(flowerTimeHistograms, histogram);
+        }
+        histogram->flowerNumber++;
+        histogram->totalTime += time;
+        if (time > histogram->maxTime) {
+            histogram->maxTime = time;
+        }
+        histogram->bins[bin]++;
+    }
+}
+
+void cactusStats_write(FILE *fileHandle) {
+    fprintf(fileHandle, "{\n\"stages\": [");
+    for (int64_t i = 0; enabled && i < stList_length(stages); i++) {
+        StageRecord *stage = stList_get(stages, i);
+        if (!stage->ended) { // Report a stage still running up to now
+            stageRecord_update(stage);
+        }
+        fprintf(fileHandle, "%s\n{\"name\": \"%s\", \"round\": %" PRIi64 ", \"depth\": %" PRIi64
+                ", \"complete\": %s, \"wallSeconds\": %.6f, \"cpuSeconds\": %.6f, \"peakRssBytes\": %" PRIi64
+                ", \"heapBytesAtStart\": %" PRIi64 ", \"heapBytesAtEnd\": %" PRIi64 "}",
+                i > 0 ? "," : "", stage->name, stage->round, stage->depth, stage->ended ? "true" : "false",
+                stage->wallTime, stage->cpuTime, stage->peakRss, stage->startHeapBytes, stage->endHeapBytes);
+    }
+    fprintf(fileHandle, "\n],\n\"flowerTimes\": [");
+    for (int64_t i = 0; enabled && i < stList_length(flowerTimeHistograms); i++) {
+        FlowerTimeHistogram *histogram = stList_get(flowerTimeHistograms, i);
+        fprintf(fileHandle, "%s\n{\"name\": \"%s\", \"flowers\": %" PRIi64 ", \"totalSeconds\": %.6f, "
+                "\"maxSeconds\": %.6f, \"bins\": [", i > 0 ? "," : "", histogram->name, histogram->flowerNumber,
+                histogram->totalTime, histogram->maxTime);
+        bool first = 1;
+        for (int64_t j = 0; j < FLOWER_TIME_BINS; j++) {
+            if (histogram->bins[j] > 0) { // Only the occupied bins are written
+                fprintf(fileHandle, "%s{\"minSeconds\": %g, \"maxSeconds\": %g, \"flowers\": %" PRIi64 "}",
+                        first ? "" : ", ", j == 0 ? 0.0 : ldexp(1.0, j - 1 + FLOWER_TIME_MIN_EXPONENT),
+                        ldexp(1.0, j + FLOWER_TIME_MIN_EXPONENT), histogram->bins[j]);
+                first = 0;
+            }
+        }
+        fprintf(fileHandle, "]}");
+    }
+    fprintf(fileHandle, "\n]\n}\n");
+}
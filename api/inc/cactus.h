@@ -23,5 +23,7 @@
 #include "cactusMisc.h"
 #include "cactusTestCommon.h"
 #include "cactus_params_parser.h"
+#include "cactusStats.h"
+#include "cactusSnapshot.h"
 
 #endif
@@ -56,6 +56,12 @@ Event *sequence_getEvent(Sequence *sequence);
  */
 char *sequence_getString(Sequence *sequence, int64_t start, int64_t length, int64_t strand);
 
+/*
+ * Frees the bases of the meta sequence, to reclaim memory once they are no longer needed. Afterwards
+ * sequence_getString must not be called on the sequence.
+ */
+void sequence_freeString(Sequence *sequence);
+
 /*
  * Gets the header line associated with the meta sequence.
  */
@@ -0,0 +1,34 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_SNAPSHOT_H_
+#define CACTUS_SNAPSHOT_H_
+
+#include "cactusGlobals.h"
+
+/*
+ * Snapshots of a complete cactus disk (event tree, strings, sequences and every flower with its ends, caps,
+ * segments, blocks, groups, chains and links), so a long run can be resumed from the end of a completed stage.
+ *
+ * Every object keeps its name, and the orders of the lists that are not sorted by name (the caps of an end, the
+ * segments of a block, the ends of a group and the links of a chain) are preserved, so the restored disk behaves
+ * identically to the original. The file is a single sequential stream of fixed width integers (in the native byte
+ * order) and length prefixed strings, with the sequence strings, which dominate its size, written as contiguous
+ * runs.
+ */
+
+/*
+ * Writes a snapshot of the cactus disk to the given file. The stage is an arbitrary label recorded with the
+ * snapshot, e.g. the name of the last stage completed. The file is first written under a temporary name and then
+ * renamed, so an interrupted write never leaves a partial snapshot behind.
+ */
+void cactusSnapshot_write(CactusDisk *cactusDisk, Flower *rootFlower, const char *stage, const char *snapshotFile);
+
+/*
+ * Loads a cactus disk from a snapshot written by cactusSnapshot_write. The root flower and the stage label (which
+ * the caller must free) are returned in the given pointers. Aborts if the file is missing or is not a snapshot.
+ */
+CactusDisk *cactusSnapshot_load(const char *snapshotFile, Flower **rootFlower, char **stage);
+
+#endif /* CACTUS_SNAPSHOT_H_ */
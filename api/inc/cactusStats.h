@@ -0,0 +1,57 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_STATS_H_
+#define CACTUS_STATS_H_
+
+#include "sonLib.h"
+
+/*
+ * A per-stage performance report for a run: the wall time, CPU time, peak resident memory and heap usage of each
+ * stage, plus histograms of per-flower timings for the stages that process flowers independently.
+ *
+ * Recording is off until cactusStats_enable is called, and all the functions are then no-ops, so the stages can be
+ * instrumented unconditionally.
+ */
+
+/*
+ * Turns on recording.
+ */
+void cactusStats_enable(void);
+
+bool cactusStats_isEnabled(void);
+
+/*
+ * Frees everything recorded and turns recording off.
+ */
+void cactusStats_reset(void);
+
+/*
+ * Starts a stage. Stages may be nested, e.g. the annealing rounds of CAF within the CAF stage. The round is reported
+ * for stages that are repeated, use -1 for stages that are not.
+ */
+void cactusStats_startStage(const char *stageName, int64_t round);
+
+/*
+ * Ends the most recently started stage that has not yet ended.
+ */
+void cactusStats_endStage(void);
+
+/*
+ * Seconds since an arbitrary fixed point, from a monotonic clock.
+ */
+double cactusStats_getWallTime(void);
+
+/*
+ * Adds the time elapsed since startTime (as returned by cactusStats_getWallTime) to the named per-flower timing
+ * histogram. Is thread safe.
+ */
+void cactusStats_recordFlowerTime(const char *histogramName, double startTime);
+
+/*
+ * Writes the report as a JSON object.
+ */
+void cactusStats_write(FILE *fileHandle);
+
+#endif /* CACTUS_STATS_H_ */
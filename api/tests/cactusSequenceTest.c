@@ -69,6 +69,18 @@ void testSequence_getString(CuTest* testCase) {
     }
 }
 
+void testSequence_freeString(CuTest* testCase) {
+    cactusSequenceTestSetup(testCase);
+    Sequence *sequence2 = sequence_construct(1, 4, "ACGT", headerString, event, cactusDisk);
+    sequence_freeString(sequence);
+    sequence_freeString(sequence); // Freeing twice is harmless
+    //The other sequence's string is untouched and the sequence itself is still intact
+    CuAssertStrEquals(testCase, "ACGT", sequence_getString(sequence2, 1, 4, 1));
+    CuAssertIntEquals(testCase, 10, sequence_getLength(sequence));
+    CuAssertStrEquals(testCase, headerString, sequence_getHeader(sequence));
+    cactusSequenceTestTeardown(testCase);
+}
+
 void testSequence_getHeader(CuTest* testCase) {
     cactusSequenceTestSetup(testCase);
     CuAssertStrEquals(testCase, headerString, sequence_getHeader(sequence));
@@ -94,5 +106,6 @@ CuSuite* cactusSequenceTestSuite(void) {
     SUITE_ADD_TEST(suite, testSequence_getString);
     SUITE_ADD_TEST(suite, testSequence_isTrivialSequence);
     SUITE_ADD_TEST(suite, testSequence_getHeader);
+    SUITE_ADD_TEST(suite, testSequence_freeString);
     return suite;
 }
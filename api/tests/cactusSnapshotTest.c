@@ -0,0 +1,173 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include "cactusSnapshot.h"
+#include "cactusChainsTestShared.h"
+
+static const char *snapshotFile = "cactusSnapshotTestTempFile.bin";
+
+static char *nameString(Name name) {
+    return name == NULL_NAME ? stString_copy("null") : cactusMisc_nameToString(name);
+}
+
+static void describeCap(stList *strings, Cap *cap) {
+    Cap *adjacentCap = cap_getAdjacency(cap);
+    stList_append(strings, stString_print("cap %" PRIi64 " event %" PRIi64 " sequence %" PRIi64 " coordinate %"
+            PRIi64 " strand %i side %i adjacency %" PRIi64, cap_getName(cap), event_getName(cap_getEvent(cap)),
+            cap_getSequence(cap) != NULL ? sequence_getName(cap_getSequence(cap)) : NULL_NAME, cap_getCoordinate(cap),
+            (int)cap_getStrand(cap), (int)cap_getSide(cap), adjacentCap != NULL ? cap_getName(adjacentCap) : NULL_NAME));
+}
+
+/*
+ * A description of everything in the flower, including the orders of its lists.
+ */
+static char *describeFlower(Flower *flower) {
+    stList *strings = stList_construct3(0, free);
+    stList_append(strings, stString_print("flower %" PRIi64 " parent %" PRIi64 " builtBlocks %i", flower_getName(flower),
+                                          flower->parentFlowerName, (int)flower_builtBlocks(flower)));
+    Flower_SequenceIterator *sequenceIt = flower_getSequenceIterator(flower);
+    Sequence *sequence;
+    while ((sequence = flower_getNextSequence(sequenceIt)) != NULL) {
+        char *string = sequence_getString(sequence, sequence_getStart(sequence), sequence_getLength(sequence), 1);
+        stList_append(strings, stString_print("sequence %" PRIi64 " %s %s", sequence_getName(sequence),
+                                              sequence_getHeader(sequence), string));
+        free(string);
+    }
+    flower_destructSequenceIterator(sequenceIt);
+    Flower_EndIterator *endIt = flower_getEndIterator(flower);
+    End *end;
+    while ((end = flower_getNextEnd(endIt)) != NULL) {
+        Group *group = end_getGroup(end);
+        stList_append(strings, stString_print("end %" PRIi64 " side %i attached %i blockEnd %i group %" PRIi64,
+                                              end_getName(end), (int)end_getSide(end), (int)end_isAttached(end),
+                                              (int)end_isBlockEnd(end), group != NULL ? group_getName(group) : NULL_NAME));
+        End_InstanceIterator *capIt = end_getInstanceIterator(end);
+        Cap *cap;
+        while ((cap = end_getNext(capIt)) != NULL) {
+            describeCap(strings, cap);
+        }
+        end_destructInstanceIterator(capIt);
+        if (end_isBlockEnd(end) && end == block_get5End(block_getPositiveOrientation(end_getBlock(end)))) {
+            Block *block = block_getPositiveOrientation(end_getBlock(end));
+            stList_append(strings, stString_print("block %" PRIi64 " length %" PRIi64, block_getName(block),
+                                                  block_getLength(block)));
+            Block_InstanceIterator *segmentIt = block_getInstanceIterator(block);
+            Segment *segment;
+            while ((segment = block_getNext(segmentIt)) != NULL) {
+                stList_append(strings, stString_print("segment %" PRIi64 " 5cap %" PRIi64 " 3cap %" PRIi64,
+                                                      segment_getName(segment), cap_getName(segment_get5Cap(segment)),
+                                                      cap_getName(segment_get3Cap(segment))));
+            }
+            block_destructInstanceIterator(segmentIt);
+        }
+    }
+    flower_destructEndIterator(endIt);
+    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+    Group *group;
+    while ((group = flower_getNextGroup(groupIt)) != NULL) {
+        stList_append(strings, stString_print("group %" PRIi64 " leaf %i link %i", group_getName(group),
+                                              (int)group_isLeaf(group), (int)group_isLink(group)));
+        Group_EndIterator *groupEndIt = group_getEndIterator(group);
+        while ((end = group_getNextEnd(groupEndIt)) != NULL) {
+            stList_append(strings, nameString(end_getName(end)));
+        }
+        group_destructEndIterator(groupEndIt);
+    }
+    flower_destructGroupIterator(groupIt);
+    Flower_ChainIterator *chainIt = flower_getChainIterator(flower);
+    Chain *chain;
+    while ((chain = flower_getNextChain(chainIt)) != NULL) {
+        stList_append(strings, stString_print("chain %" PRIi64, chain_getName(chain)));
+        for (Link *link = chain_getFirst(chain); link != NULL; link = link_getNextLink(link)) {
+            stList_append(strings, stString_print("link %" PRIi64 " %" PRIi64 " %" PRIi64,
+                                                  group_getName(link_getGroup(link)), end_getName(link_get3End(link)),
+                                                  end_getName(link_get5End(link))));
+        }
+    }
+    flower_destructChainIterator(chainIt);
+    char *description = stString_join2("\n", strings);
+    stList_destruct(strings);
+    return description;
+}
+
+static stList *describeFlowers(CactusDisk *cactusDisk) {
+    stList *descriptions = stList_construct3(0, free);
+    stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->flowers);
+    Flower *flower2;
+    while ((flower2 = stSortedSet_getNext(it)) != NULL) {
+        stList_append(descriptions, describeFlower(flower2));
+    }
+    stSortedSet_destructIterator(it);
+    return descriptions;
+}
+
+static void testCactusSnapshot_roundTrip(CuTest *testCase) {
+    cactusChainsSharedTestSetup(NULL);
+    // Add an outgroup event, a segment on the reverse strand of its block and stub caps, one without coordinates
+    Event *rootEvent = eventTree_getRootEvent(cactusDisk_getEventTree(cactusDisk));
+    Event *event = event_construct3("outgroup", 0.5, rootEvent, cactusDisk_getEventTree(cactusDisk));
+    event_setOutgroupStatus(event, 1);
+    Sequence *sequence = sequence_construct(1, 4, "ACGT", "outgroupSequence", event, cactusDisk);
+    flower_addSequence(flower, sequence);
+    segment_construct2(block_getReverse(block4), 2, 0, sequence);
+    cap_construct2(end1, 1, 1, sequence);
+    cap_construct(end_getReverse(end2), rootEvent);
+
+    stList *descriptions = describeFlowers(cactusDisk);
+    char *eventTreeString = eventTree_makeNewickString(cactusDisk_getEventTree(cactusDisk));
+    cactusSnapshot_write(cactusDisk, flower, "bar", snapshotFile);
+    Name nextName = cactusDisk_getUniqueID(cactusDisk);
+
+    Flower *rootFlower;
+    char *stage;
+    CactusDisk *cactusDisk2 = cactusSnapshot_load(snapshotFile, &rootFlower, &stage);
+    st_system("rm %s", snapshotFile);
+
+    CuAssertStrEquals(testCase, "bar", stage);
+    CuAssertTrue(testCase, flower_getName(rootFlower) == flower_getName(flower));
+    CuAssertTrue(testCase, cactusDisk_getUniqueID(cactusDisk2) == nextName);
+    char *eventTreeString2 = eventTree_makeNewickString(cactusDisk_getEventTree(cactusDisk2));
+    CuAssertStrEquals(testCase, eventTreeString, eventTreeString2);
+    Event *event2 = eventTree_getEvent(cactusDisk_getEventTree(cactusDisk2), event_getName(event));
+    CuAssertTrue(testCase, event2 != NULL && event_isOutgroup(event2));
+
+    stList *descriptions2 = describeFlowers(cactusDisk2);
+    CuAssertIntEquals(testCase, stList_length(descriptions), stList_length(descriptions2));
+    for (int64_t i = 0; i < stList_length(descriptions); i++) {
+        CuAssertStrEquals(testCase, stList_get(descriptions, i), stList_get(descriptions2, i));
+    }
+
+    stList_destruct(descriptions);
+    stList_destruct(descriptions2);
+    free(eventTreeString);
+    free(eventTreeString2);
+    free(stage);
+    cactusDisk_destruct(cactusDisk2);
+    cactusChainsSharedTestTeardown(NULL);
+}
+
+static void testCactusSnapshot_overwrite(CuTest *testCase) {
+    // Writing a snapshot replaces any earlier one in the same file
+    cactusChainsSharedTestSetup(NULL);
+    cactusSnapshot_write(cactusDisk, flower, "caf", snapshotFile);
+    cactusSnapshot_write(cactusDisk, flower, "bar", snapshotFile);
+    Flower *rootFlower;
+    char *stage;
+    CactusDisk *cactusDisk2 = cactusSnapshot_load(snapshotFile, &rootFlower, &stage);
+    st_system("rm %s", snapshotFile);
+    CuAssertStrEquals(testCase, "bar", stage);
+    CuAssertIntEquals(testCase, flower_getEndNumber(flower), flower_getEndNumber(rootFlower));
+    CuAssertIntEquals(testCase, flower_getCapNumber(flower), flower_getCapNumber(rootFlower));
+    free(stage);
+    cactusDisk_destruct(cactusDisk2);
+    cactusChainsSharedTestTeardown(NULL);
+}
+
+CuSuite* cactusSnapshotTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCactusSnapshot_roundTrip);
+    SUITE_ADD_TEST(suite, testCactusSnapshot_overwrite);
+    return suite;
+}
@@ -0,0 +1,84 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "cactusStats.h"
+
+static char *getReport(void) {
+    char *tempFile = "cactusStatsTestTempFile.json";
+    FILE *fileHandle = fopen(tempFile, "w");
+    cactusStats_write(fileHandle);
+    fclose(fileHandle);
+    fileHandle = fopen(tempFile, "r");
+    stList *lines = stList_construct3(0, free);
+    char *line;
+    while ((line = stFile_getLineFromFile(fileHandle)) != NULL) {
+        stList_append(lines, line);
+    }
+    fclose(fileHandle);
+    st_system("rm %s", tempFile);
+    char *report = stString_join2("\n", lines);
+    stList_destruct(lines);
+    return report;
+}
+
+static void testCactusStats_disabled(CuTest *testCase) {
+    CuAssertTrue(testCase, !cactusStats_isEnabled());
+    cactusStats_startStage("setup", -1);
+    cactusStats_recordFlowerTime("bar", cactusStats_getWallTime());
+    cactusStats_endStage();
+    char *report = getReport();
+    CuAssertTrue(testCase, strstr(report, "setup") == NULL);
+    CuAssertTrue(testCase, strstr(report, "bar") == NULL);
+    free(report);
+}
+
+static void testCactusStats_stages(CuTest *testCase) {
+    cactusStats_enable();
+    cactusStats_startStage("caf", -1);
+    cactusStats_startStage("annealing", 0);
+    cactusStats_endStage();
+    cactusStats_startStage("melting", 0);
+    cactusStats_endStage();
+    cactusStats_endStage();
+    cactusStats_startStage("bar", -1);
+    char *report = getReport();
+    CuAssertTrue(testCase, strstr(report, "{\"name\": \"caf\", \"round\": -1, \"depth\": 0, \"complete\": true") != NULL);
+    CuAssertTrue(testCase, strstr(report, "{\"name\": \"annealing\", \"round\": 0, \"depth\": 1, \"complete\": true") != NULL);
+    CuAssertTrue(testCase, strstr(report, "{\"name\": \"melting\", \"round\": 0, \"depth\": 1, \"complete\": true") != NULL);
+    CuAssertTrue(testCase, strstr(report, "{\"name\": \"bar\", \"round\": -1, \"depth\": 0, \"complete\": false") != NULL);
+    // Stages are reported in the order they were started
+    CuAssertTrue(testCase, strstr(report, "\"caf\"") < strstr(report, "\"annealing\""));
+    CuAssertTrue(testCase, strstr(report, "\"annealing\"") < strstr(report, "\"melting\""));
+    free(report);
+    cactusStats_reset();
+    CuAssertTrue(testCase, !cactusStats_isEnabled());
+}
+
+static void testCactusStats_flowerTimes(CuTest *testCase) {
+    cactusStats_enable();
+    double now = cactusStats_getWallTime();
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (int64_t i = 0; i < 100; i++) {
+        cactusStats_recordFlowerTime("reference", now - 3.0);
+    }
+    char *report = getReport();
+    CuAssertTrue(testCase, strstr(report, "{\"name\": \"reference\", \"flowers\": 100,") != NULL);
+    // All the flowers took at least three seconds, so land in the [2, 4) second bin (or the next if slow)
+    CuAssertTrue(testCase, strstr(report, "{\"minSeconds\": 2, \"maxSeconds\": 4, \"flowers\": 100}") != NULL ||
+                           strstr(report, "{\"minSeconds\": 4, \"maxSeconds\": 8, \"flowers\":") != NULL);
+    free(report);
+    cactusStats_reset();
+}
+
+CuSuite* cactusStatsTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCactusStats_disabled);
+    SUITE_ADD_TEST(suite, testCactusStats_stages);
+    SUITE_ADD_TEST(suite, testCactusStats_flowerTimes);
+    return suite;
+}
@@ -46,7 +46,46 @@ stPinch *getNextAlignedPairAlignment(stSortedSetIterator *it, stPinch *pinchToFi
 
 bool blockFilterFn(stPinchBlock *pinchBlock, void *extraArg) {
     FilterArgs *f = extraArg;
-    return !stCaf_containsRequiredSpecies(pinchBlock, f->flower, f->minimumIngroupDegree, f->minimumOutgroupDegree, f->minimumDegree, f->minimumNumberOfSpecies);
+    return !stCaf_containsRequiredSpecies(pinchBlock, f->flower, f->eventTable, f->minimumIngroupDegree, f->minimumOutgroupDegree, f->minimumDegree, f->minimumNumberOfSpecies);
+}
+
+int64_t bar_predictFlowerCost(Flower *flower, int64_t maximumLength, int64_t windowSize) {
+    int64_t cost = 0;
+    Flower_EndIterator *endIt = flower_getEndIterator(flower);
+    End *end;
+    while ((end = flower_getNextEnd(endIt)) != NULL) {
+        int64_t totalLength = 0, maxLength = 0;
+        End_InstanceIterator *capIt = end_getInstanceIterator(end);
+        Cap *cap;
+        while ((cap = end_getNext(capIt)) != NULL) {
+            if (cap_getSide(cap)) {
+                cap = cap_getReverse(cap);
+            }
+            int length;
+            get_adjacency_string(cap, &length, 0);
+            int64_t cappedLength = length < maximumLength ? length : maximumLength;
+            totalLength += cappedLength;
+            maxLength = cappedLength > maxLength ? cappedLength : maxLength;
+        }
+        end_destructInstanceIterator(capIt);
+        cost += totalLength * (maxLength < windowSize ? maxLength : windowSize);
+    }
+    flower_destructEndIterator(endIt);
+    return cost;
+}
+
+typedef struct _scheduledFlower {
+    Flower *flower;
+    int64_t predictedCost;
+    int64_t index; // Position in the input list, to break ties deterministically
+} ScheduledFlower;
+
+static int scheduledFlower_cmp(const void *a, const void *b) {
+    const ScheduledFlower *f = a, *g = b;
+    if (f->predictedCost != g->predictedCost) {
+        return f->predictedCost < g->predictedCost ? 1 : -1; // Descending order of predicted cost
+    }
+    return f->index < g->index ? -1 : (f->index > g->index ? 1 : 0);
 }
 
 void bar(stList *flowers, CactusParams *params, CactusDisk *cactusDisk, stList *listOfEndAlignmentFiles) {
@@ -71,6 +110,9 @@ void bar(stList *flowers, CactusParams *params, CactusDisk *cactusDisk, stList *
     int64_t poaWindow = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentWindow");
     int64_t maskFilter = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentMaskFilter");
     abpoa_para_t *poaParameters = usePoa ? abpoaParameters_constructFromCactusParams(params) : NULL;
+    if (usePoa) {
+        poa_set_memory_budget(cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentMemoryBudget"));
+    }
 
     //////////////////////////////////////////////
     //Run the bar algorithm
@@ -80,79 +122,128 @@ void bar(stList *flowers, CactusParams *params, CactusDisk *cactusDisk, stList *
         st_errAbort("We have precomputed alignments but %" PRIi64 " flowers to align.\n", stList_length(flowers));
     }
 
+    /*
+     * Order the flowers by descending predicted cost, so the long poles start first.
+     */
+    int64_t flowerNumber = stList_length(flowers);
+    ScheduledFlower *schedule = st_malloc(sizeof(ScheduledFlower) * (flowerNumber > 0 ? flowerNumber : 1));
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (int64_t j = 0; j < flowerNumber; j++) {
+        schedule[j].flower = stList_get(flowers, j);
+        schedule[j].predictedCost = bar_predictFlowerCost(schedule[j].flower, maximumLength,
+                                                          usePoa ? poaWindow : maximumLength);
+        schedule[j].index = j;
+    }
+    qsort(schedule, flowerNumber, sizeof(ScheduledFlower), scheduledFlower_cmp);
+    double totalPredictedCost = 0.0, totalSeconds = 0.0;
+
+    /*
+     * Each flower is a task, started in order of predicted cost. Within a flower
+     * the ends are aligned as nested tasks (see make_consistent_partial_order_alignments), so once the flower tasks
+     * run out the idle threads help with the ends of the largest flowers still being aligned, rather than waiting
+     * for the single giant flower that dominates most runs.
+     */
+#if defined(_OPENMP)
+#pragma omp parallel
+#pragma omp single
+#endif
+    for (int64_t j = 0; j<flowerNumber; j++) {
 #if defined(_OPENMP)
-#pragma omp parallel for schedule(dynamic, 1)
+#pragma omp task firstprivate(j)
 #endif
-    for (int64_t j = 0; j<stList_length(flowers); j++) {
-        Flower *flower = stList_get(flowers, j);
-
-        // These are all variables used by the filter fns
-        FilterArgs *fa = st_calloc(1, sizeof(FilterArgs));
-        fa->minimumIngroupDegree = cactusParams_get_int(params, 2, "bar", "minimumIngroupDegree");
-        fa->minimumOutgroupDegree = cactusParams_get_int(params, 2, "bar", "minimumOutgroupDegree");
-        fa->minimumDegree = cactusParams_get_int(params, 2, "bar", "minimumBlockDegree");
-        fa->minimumNumberOfSpecies = cactusParams_get_int(params, 2, "bar", "minimumNumberOfSpecies");
-        fa->flower = flower;
-
-        void *alignments;
-        if (usePoa) {
+        {
+            Flower *flower = schedule[j].flower;
+            Name flowerName = flower_getName(flower); // The flower is destroyed by stCaf_finish
+            double flowerStartTime = cactusStats_getWallTime();
+
+            // These are all variables used by the filter fns
+            FilterArgs *fa = st_calloc(1, sizeof(FilterArgs));
+            fa->minimumIngroupDegree = cactusParams_get_int(params, 2, "bar", "minimumIngroupDegree");
+            fa->minimumOutgroupDegree = cactusParams_get_int(params, 2, "bar", "minimumOutgroupDegree");
+            fa->minimumDegree = cactusParams_get_int(params, 2, "bar", "minimumBlockDegree");
+            fa->minimumNumberOfSpecies = cactusParams_get_int(params, 2, "bar", "minimumNumberOfSpecies");
+            fa->flower = flower;
+
+            void *alignments;
+            if (usePoa) {
+                /*
+                 * This makes a consistent set of alignments using abPoa.
+                 *
+                 * It does not use any precomputed alignments, if they are provided they will be ignored
+                 */
+                alignments = make_flower_alignment_poa(flower, maximumLength, poaWindow, maskFilter, poaParameters);
+                st_logDebug("Created the poa alignments: %" PRIi64 " poa alignment blocks for flower\n",
+                            stList_length(alignments));
+            } else {
+                alignments = makeFlowerAlignment3(sM, flower, listOfEndAlignmentFiles, spanningTrees, maximumLength,
+                                                  useProgressiveMerging, matchGamma, pairwiseAlignmentParameters,
+                                                  pruneOutStubAlignments);
+                st_logDebug("Created the alignment: %" PRIi64 " pairs for flower\n", stSortedSet_size(alignments));
+            }
+
+            stPinchIterator *pinchIterator = NULL;
+            if(usePoa) {
+                pinchIterator = stPinchIterator_constructFromAlignedBlocks(alignments);
+            }
+            else {
+                pinchIterator = stPinchIterator_constructFromAlignedPairs(alignments, getNextAlignedPairAlignment);
+            }
             /*
-             * This makes a consistent set of alignments using abPoa.
-             *
-             * It does not use any precomputed alignments, if they are provided they will be ignored
+             * Run the cactus caf functions to build cactus.
              */
-            alignments = make_flower_alignment_poa(flower, maximumLength, poaWindow, maskFilter, poaParameters);
-            st_logDebug("Created the poa alignments: %" PRIi64 " poa alignment blocks for flower\n", stList_length(alignments));
-        } else {
-            alignments = makeFlowerAlignment3(sM, flower, listOfEndAlignmentFiles, spanningTrees, maximumLength,
-                                              useProgressiveMerging, matchGamma, pairwiseAlignmentParameters,
-                                              pruneOutStubAlignments);
-            st_logDebug("Created the alignment: %" PRIi64 " pairs for flower\n", stSortedSet_size(alignments));
-        }
 
-        stPinchIterator *pinchIterator = NULL;
-        if(usePoa) {
-            pinchIterator = stPinchIterator_constructFromAlignedBlocks(alignments);
-        }
-        else {
-            pinchIterator = stPinchIterator_constructFromAlignedPairs(alignments, getNextAlignedPairAlignment);
-        }
-        /*
-         * Run the cactus caf functions to build cactus.
-         */
+            stPinchThreadSet *threadSet = stCaf_setup(flower);
 
-        stPinchThreadSet *threadSet = stCaf_setup(flower);
+            stCaf_anneal(threadSet, pinchIterator, NULL, NULL);
 
-        stCaf_anneal(threadSet, pinchIterator, NULL, flower);
+            if (fa->minimumDegree < 2) {
+                stCaf_makeDegreeOneBlocks(threadSet);
+            }
 
-        if (fa->minimumDegree < 2) {
-            stCaf_makeDegreeOneBlocks(threadSet);
-        }
+            if (fa->minimumIngroupDegree > 0 || fa->minimumOutgroupDegree > 0 || fa->minimumDegree > 1) {
+                stCaf_melt(flower, threadSet, blockFilterFn, fa, 0, 0, 0, INT64_MAX);
+            }
 
-        if (fa->minimumIngroupDegree > 0 || fa->minimumOutgroupDegree > 0 || fa->minimumDegree > 1) {
-            stCaf_melt(flower, threadSet, blockFilterFn, fa, 0, 0, 0, INT64_MAX);
-        }
+            stCaf_finish(flower, threadSet, INT64_MAX, INT64_MAX); //Flower now destroyed.
 
-        stCaf_finish(flower, threadSet, INT64_MAX, INT64_MAX); //Flower now destroyed.
+            stPinchThreadSet_destruct(threadSet);
+            st_logDebug("Ran the cactus core script.\n");
 
-        stPinchThreadSet_destruct(threadSet);
-        st_logDebug("Ran the cactus core script.\n");
+            /*
+             * Cleanup
+             */
+            //Clean up the sorted set after cleaning up the iterator
+            stPinchIterator_destruct(pinchIterator);
+            if(usePoa) {
+                stList_destruct(alignments);
+            }
+            else {
+                stSortedSet_destruct(alignments);
+            }
+            free(fa);
 
-        /*
-         * Cleanup
-         */
-        //Clean up the sorted set after cleaning up the iterator
-        stPinchIterator_destruct(pinchIterator);
-        if(usePoa) {
-            stList_destruct(alignments);
-        }
-        else {
-            stSortedSet_destruct(alignments);
-        }
-        free(fa);
+            st_logDebug("Finished filling in the alignments for the flower\n");
+            cactusStats_recordFlowerTime("bar", flowerStartTime);
 
-        st_logDebug("Finished filling in the alignments for the flower\n");
+            // Log the predicted against the actual cost, to calibrate the model
+            double seconds = cactusStats_getWallTime() - flowerStartTime;
+            st_logDebug("Aligned flower %" PRIi64 " with predicted cost %" PRIi64 " in %f seconds\n", flowerName,
+                        schedule[j].predictedCost, seconds);
+#if defined(_OPENMP)
+#pragma omp critical(barPredictedCost)
+#endif
+            {
+                totalPredictedCost += schedule[j].predictedCost;
+                totalSeconds += seconds;
+            }
+        }
     }
+    st_logInfo("Aligned %" PRIi64 " flowers with a total predicted cost of %.0f in %f flower seconds (%g seconds per "
+               "unit of cost)\n", flowerNumber, totalPredictedCost, totalSeconds,
+               totalPredictedCost > 0 ? totalSeconds / totalPredictedCost : 0.0);
+    free(schedule);
 
     //////////////////////////////////////////////
     //Clean up
@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <pthread.h>
 
 // FOR DEBUGGING ONLY: Specify directory where abpoa inputs get dumped
 //#define CACTUS_ABPOA_MSA_DUMP_DIR "/home/hickey/dev/cactus/dump"
@@ -17,9 +18,15 @@
 //#define CACTUS_ABPOA_FROM_COMMAND_LINE
 
 // OpenMP
-//#if defined(_OPENMP)
-//#include <omp.h>
-//#endif
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+ * Ends whose strings total fewer bases than this are aligned by the thread that reaches them rather than being made
+ * into tasks, as for them the cost of a task outweighs the work.
+ */
+#define MIN_BASES_FOR_END_TASK 1000
 
 abpoa_para_t *abpoaParameters_constructFromCactusParams(CactusParams *params) {
     abpoa_para_t *abpt = abpoa_init_para();
@@ -80,9 +87,8 @@ abpoa_para_t *abpoaParameters_constructFromCactusParams(CactusParams *params) {
     return abpt;
 }
 
-// It turns out abpoa can write to these, so we make a quick copy before using
-static abpoa_para_t *copy_abpoa_params(abpoa_para_t *abpt) {
-    abpoa_para_t *abpt_cpy = abpoa_init_para();
+// It turns out abpoa can write to these, so we reset a copy from the originals before each use
+static void reset_abpoa_params(abpoa_para_t *abpt_cpy, abpoa_para_t *abpt) {
     abpt_cpy->out_msa = 1;
     abpt_cpy->out_cons = 0;
     abpt_cpy->align_mode = abpt->align_mode;
@@ -108,7 +114,132 @@ static abpoa_para_t *copy_abpoa_params(abpoa_para_t *abpt) {
     }
     abpt_cpy->max_mat = abpt->max_mat;
     abpt_cpy->min_mis = abpt->min_mis;
-    return abpt_cpy;
+}
+
+/*
+ * The abpoa state, parameters and input buffer used to align windows, kept between windows (and between the ends
+ * aligned by the same thread) so the DP matrices and buffers are reused, only growing as needed, rather than being
+ * allocated and freed for every window.
+ */
+struct _poaWorkspace {
+    abpoa_t *ab;
+    abpoa_para_t *abpt;
+    uint8_t **bseqs; // The poa input buffer, one row per sequence
+    int64_t *bseq_capacities; // The allocated length of each row
+    int64_t bseq_no; // The number of rows allocated
+};
+
+/*
+ * The memory governor, which admits windows while their estimated abpoa memory fits within the budget. Windows are
+ * admitted in the order they ask, so while a large window waits for room no later, smaller windows are admitted ahead
+ * of it and it can't be starved.
+ */
+static pthread_mutex_t poa_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poa_memory_released = PTHREAD_COND_INITIALIZER;
+static int64_t poa_memory_budget = 0; // 0 = unlimited
+static int64_t poa_memory_retain_limit = INT64_MAX; // Windows estimated bigger than this don't keep their matrices
+static int64_t poa_memory_in_use = 0;
+static uint64_t poa_memory_next_ticket = 0; // The ticket given to the next window to ask for memory
+static uint64_t poa_memory_now_serving = 0; // The ticket of the window to be admitted next
+
+void poa_set_memory_budget(int64_t budget) {
+    assert(budget >= 0);
+    pthread_mutex_lock(&poa_memory_mutex);
+    poa_memory_budget = budget;
+#if defined(_OPENMP)
+    int64_t thread_no = omp_get_max_threads();
+#else
+    int64_t thread_no = 1;
+#endif
+    // The matrices kept by idle workspaces are outside the accounting, so they are limited to a quarter of the budget
+    // in total, and the windows being aligned are admitted against the rest
+    poa_memory_retain_limit = budget > 0 ? budget / (4 * thread_no) : INT64_MAX;
+    pthread_cond_broadcast(&poa_memory_released); // The waiting windows may now fit
+    pthread_mutex_unlock(&poa_memory_mutex);
+}
+
+/*
+ * Estimates the bytes abpoa allocates to align a window: a DP matrix (three for affine gaps, five for convex) of
+ * 32 bit scores with a row per graph node and a column per base of the query, with the graph about as long as the
+ * longest sequence. Quadratic in the window size.
+ *
+ * It is only a guide. abpoa allocates whole rows whatever the band (wb and wf only limit the cells it fills in), so
+ * the band doesn't reduce it. It overestimates windows short enough for abpoa to use 16 bit scores, by up to half.
+ * It underestimates divergent windows, whose graph grows longer than their longest sequence as it gains bubbles.
+ */
+static int64_t estimate_window_bytes(int *seq_lens, int64_t seq_no, abpoa_para_t *abpt) {
+    int64_t max_len = 0;
+    for (int64_t i = 0; i < seq_no; ++i) {
+        max_len = seq_lens[i] > max_len ? seq_lens[i] : max_len;
+    }
+    int64_t matrices = abpt->gap_open1 == 0 ? 1 : (abpt->gap_open2 == 0 ? 3 : 5);
+    return matrices * sizeof(int32_t) * (max_len + 1) * (max_len + 1);
+}
+
+static void poa_memory_acquire(int64_t bytes) {
+    pthread_mutex_lock(&poa_memory_mutex);
+    uint64_t ticket = poa_memory_next_ticket++;
+    // Wait for the windows that asked before this one to be admitted, then for room for this one
+    while (ticket != poa_memory_now_serving ||
+           (poa_memory_budget > 0 && poa_memory_in_use > 0 &&
+            poa_memory_in_use + bytes > poa_memory_budget - poa_memory_budget / 4)) {
+        pthread_cond_wait(&poa_memory_released, &poa_memory_mutex);
+    }
+    poa_memory_now_serving++;
+    poa_memory_in_use += bytes;
+    pthread_cond_broadcast(&poa_memory_released); // Let the next window in line check if it fits
+    pthread_mutex_unlock(&poa_memory_mutex);
+}
+
+static void poa_memory_release(int64_t bytes) {
+    pthread_mutex_lock(&poa_memory_mutex);
+    poa_memory_in_use -= bytes;
+    assert(poa_memory_in_use >= 0);
+    pthread_cond_broadcast(&poa_memory_released);
+    pthread_mutex_unlock(&poa_memory_mutex);
+}
+
+PoaWorkspace *poa_workspace_construct(void) {
+    PoaWorkspace *workspace = st_calloc(1, sizeof(PoaWorkspace));
+    workspace->ab = abpoa_init();
+    workspace->abpt = abpoa_init_para();
+    return workspace;
+}
+
+void poa_workspace_destruct(PoaWorkspace *workspace) {
+    abpoa_free(workspace->ab);
+    abpoa_free_para(workspace->abpt);
+    for (int64_t i = 0; i < workspace->bseq_no; ++i) {
+        free(workspace->bseqs[i]);
+    }
+    free(workspace->bseqs);
+    free(workspace->bseq_capacities);
+    free(workspace);
+}
+
+/*
+ * Ensures the input buffer has a row for each sequence long enough to hold a window of it.
+ */
+static void poa_workspace_reserve(PoaWorkspace *workspace, int *seq_lens, int64_t seq_no, int64_t window_size) {
+    if (seq_no > workspace->bseq_no) {
+        workspace->bseqs = st_realloc(workspace->bseqs, sizeof(uint8_t *) * seq_no);
+        workspace->bseq_capacities = st_realloc(workspace->bseq_capacities, sizeof(int64_t) * seq_no);
+        for (int64_t i = workspace->bseq_no; i < seq_no; ++i) {
+            workspace->bseqs[i] = NULL;
+            workspace->bseq_capacities[i] = 0;
+        }
+        workspace->bseq_no = seq_no;
+    }
+    for (int64_t i = 0; i < seq_no; ++i) {
+        // Always at least one, for the N phonied in for empty sequences
+        int64_t row_length = seq_lens[i] < window_size ? seq_lens[i] : window_size;
+        row_length = row_length > 0 ? row_length : 1;
+        if (row_length > workspace->bseq_capacities[i]) {
+            free(workspace->bseqs[i]);
+            workspace->bseqs[i] = st_malloc(sizeof(uint8_t) * row_length);
+            workspace->bseq_capacities[i] = row_length;
+        }
+    }
 }
 
 // char <--> uint8_t conversion copied over from abPOA example
@@ -160,10 +291,12 @@ uint8_t msa_to_byte(char c) {
     return nst_nt4_table[(int)c];
 }
 
-static uint8_t rc_table[6] = { 3, 2, 1, 0, 4, 5 };
-
-static inline uint8_t msa_to_rc(uint8_t n) {
-    return rc_table[n];
+/*
+ * Equivalent to msa_to_base(n) == '-' (5 is the gap code of nst_nt4_table, 27 the one abpoa outputs), but simple
+ * enough for the loops over msa rows to vectorize.
+ */
+static inline bool msa_is_gap(uint8_t n) {
+    return n == 5 || n == 27;
 }
 
 #ifdef CACTUS_ABPOA_MSA_DUMP_DIR
@@ -296,56 +429,38 @@ void msa_print(Msa *msa, FILE *f) {
     fprintf(f, "\n");
 }
 
-/**
- * flip msa to its reverse complement (for trimming purposees)
- */
-static void flip_msa_seq(Msa* msa) {
-    if (msa != NULL) {
-        int64_t middle = msa->column_no / 2;
-        bool odd = msa->column_no % 2 == 1;
-        for (int64_t i = 0; i < msa->seq_no; ++i) {
-            for (int64_t j = 0; j < middle; ++j) {
-                uint8_t buf = msa->msa_seq[i][j];
-                msa->msa_seq[i][j] = msa_to_rc(msa->msa_seq[i][msa->column_no - 1 - j]);
-                msa->msa_seq[i][msa->column_no - 1 - j] = msa_to_rc(buf);
-            }
-            if (odd) {
-                msa->msa_seq[i][middle] = msa_to_rc(msa->msa_seq[i][middle]);
-            }
-        }
-    }
-}
-
 /**
  * Returns an array of floats, one for each corresponding column in the MSA. Each float
  * is the score of the column in the alignment.
  */
 static float *make_column_scores(Msa *msa) {
+    // Count the bases of the columns a row at a time, so the inner loop runs over contiguous bytes and vectorizes
+    int32_t *base_counts = st_calloc(msa->column_no, sizeof(int32_t));
+    for(int64_t j=0; j<msa->seq_no; j++) {
+        const uint8_t *row = msa->msa_seq[j];
+        for(int64_t i=0; i<msa->column_no; i++) {
+            base_counts[i] += !msa_is_gap(row[i]);
+        }
+    }
     float *column_scores = st_calloc(msa->column_no, sizeof(float));
     for(int64_t i=0; i<msa->column_no; i++) {
         // Score is simply max(number of aligned bases in the column - 1, 0)
-        for(int64_t j=0; j<msa->seq_no; j++) {
-            if(msa_to_base(msa->msa_seq[j][i]) != '-') {
-                column_scores[i]++;
-            }
-        }
-        if(column_scores[i] >= 1.0) {
-            column_scores[i]--;
-        }
-        assert(column_scores[i] >= 0.0);
+        column_scores[i] = base_counts[i] > 1 ? base_counts[i] - 1 : 0;
     }
+    free(base_counts);
     return column_scores;
 }
 
 /**
- * Fills in cu_column_scores with the cumulative sum of column scores, from left-to-right, of columns
- * containing a non-gap character in the given "row".
+ * Fills in cu_column_scores with the cumulative sum of column scores, from left-to-right (or right-to-left if
+ * reversed), of columns containing a non-gap character in the given "row".
  */
-static void sum_column_scores(int64_t row, Msa *msa, float *column_scores, float *cu_column_scores) {
+static void sum_column_scores(int64_t row, Msa *msa, float *column_scores, float *cu_column_scores, bool reversed) {
     float cu_score = 0.0; // The cumulative sum of column scores containing bases for the given row
     int64_t j=0; // The index in the DNA string for the given row
-    for(int64_t i=0; i<msa->column_no; i++) {
-        if(msa_to_base(msa->msa_seq[row][i]) != '-') {
+    for(int64_t k=0; k<msa->column_no; k++) {
+        int64_t i = reversed ? msa->column_no - 1 - k : k;
+        if(!msa_is_gap(msa->msa_seq[row][i])) {
             cu_score += column_scores[i];
             cu_column_scores[j++] = cu_score;
         }
@@ -355,12 +470,13 @@ static void sum_column_scores(int64_t row, Msa *msa, float *column_scores, float
 
 /**
  * Removes the suffix of the given row from the MSA and updates the column scores. suffix_start is the beginning
- * suffix to remove.
+ * suffix to remove. If reversed the row is read right-to-left, so it is a prefix that is removed.
  */
-static void trim_msa_suffix(Msa *msa, float *column_scores, int64_t row, int64_t suffix_start) {
+static void trim_msa_suffix(Msa *msa, float *column_scores, int64_t row, int64_t suffix_start, bool reversed) {
     int64_t seq_index = 0;
-    for(int64_t i=0; i<msa->column_no; i++) {
-        if(msa_to_base(msa->msa_seq[row][i]) != '-') {
+    for(int64_t k=0; k<msa->column_no; k++) {
+        int64_t i = reversed ? msa->column_no - 1 - k : k;
+        if(!msa_is_gap(msa->msa_seq[row][i])) {
             if(seq_index++ >= suffix_start) {
                 msa->msa_seq[row][i] = msa_to_byte('-');
                 column_scores[i] = column_scores[i] > 1 ? column_scores[i]-1 : 0;
@@ -371,9 +487,11 @@ static void trim_msa_suffix(Msa *msa, float *column_scores, int64_t row, int64_t
 }
 
 /**
- * Used to make two MSAs consistent with each other for a shared sequence
+ * Used to make two MSAs consistent with each other for a shared sequence. If reversed1 the first MSA is read
+ * right-to-left, as if it were reverse complemented (the scores only depend on where the gaps are), so its prefix
+ * rather than its suffix overlaps the second.
  */
-static void trim(int64_t row1, Msa *msa1, float *column_scores1,
+static void trim(int64_t row1, Msa *msa1, float *column_scores1, bool reversed1,
                  int64_t row2, Msa *msa2, float *column_scores2, int64_t overlap) {
     if(overlap == 0) { // There is no overlap, so no need to trim either MSA
         return;
@@ -389,8 +507,8 @@ static void trim(int64_t row1, Msa *msa1, float *column_scores1,
     // Get the cumulative cut scores for the columns containing the shared sequence
     float *cu_column_scores1 = st_malloc(msa1->column_no * sizeof(float));
     float *cu_column_scores2 = st_malloc(msa2->column_no * sizeof(float));
-    sum_column_scores(row1, msa1, column_scores1, cu_column_scores1);
-    sum_column_scores(row2, msa2, column_scores2, cu_column_scores2);
+    sum_column_scores(row1, msa1, column_scores1, cu_column_scores1, reversed1);
+    sum_column_scores(row2, msa2, column_scores2, cu_column_scores2, 0);
 
     // The score if we cut all of the overlap in msa1 and keep all of the overlap in msa2
     assert(seq_len2 <= msa2->column_no);
@@ -426,42 +544,48 @@ static void trim(int64_t row1, Msa *msa1, float *column_scores1,
 
     // Now trim back the two MSAs
     assert(max_overlap_cut_point <= overlap);
-    trim_msa_suffix(msa1, column_scores1, row1, seq_len1 - overlap + max_overlap_cut_point);
-    trim_msa_suffix(msa2, column_scores2, row2, seq_len2 - max_overlap_cut_point);
+    trim_msa_suffix(msa1, column_scores1, row1, seq_len1 - overlap + max_overlap_cut_point, reversed1);
+    trim_msa_suffix(msa2, column_scores2, row2, seq_len2 - max_overlap_cut_point, 0);
 
     free(cu_column_scores1);
     free(cu_column_scores2);
 }
 
 /**
- * recompute the seq_lens of a trimmed msa and clip off empty suffix columns
+ * recompute the seq_lens of a trimmed msa and clip off empty suffix columns (prefix columns if reversed), keeping
+ * the column scores in step with them
  * (todo: can this be built into trimming code?)
  */
-static void msa_fix_trimmed(Msa* msa) {
+static void msa_fix_trimmed(Msa* msa, float *column_scores, bool reversed) {
     for (int64_t i = 0; i < msa->seq_no; ++i) {
         // recompute the seq_len
         msa->seq_lens[i] = 0;
         for (int64_t j = 0; j < msa->column_no; ++j) {
-            if (msa_to_base(msa->msa_seq[i][j]) != '-') {
-                ++msa->seq_lens[i];
-            }
+            msa->seq_lens[i] += !msa_is_gap(msa->msa_seq[i][j]);
         }
     }
     // trim empty columns
     int64_t empty_columns = 0;
     for (bool still_empty = true; empty_columns < msa->column_no; ++empty_columns) {
+        int64_t column = reversed ? empty_columns : msa->column_no - 1 - empty_columns;
         for (int64_t i = 0; i < msa->seq_no && still_empty; ++i) {
-            still_empty = msa_to_base(msa->msa_seq[i][msa->column_no - 1 - empty_columns]) == '-';
+            still_empty = msa_is_gap(msa->msa_seq[i][column]);
         }
         if (!still_empty) {
             break;
         }
     }
     msa->column_no -= empty_columns;
+    if (reversed && empty_columns > 0) {
+        for (int64_t i = 0; i < msa->seq_no; ++i) {
+            memmove(msa->msa_seq[i], msa->msa_seq[i] + empty_columns, msa->column_no * sizeof(uint8_t));
+        }
+        memmove(column_scores, column_scores + empty_columns, msa->column_no * sizeof(float));
+    }
 }
 
-Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
-                                      abpoa_para_t *poa_parameters) {
+Msa *msa_make_partial_order_alignment2(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
+                                       abpoa_para_t *poa_parameters, PoaWorkspace *workspace, float **column_scores_out) {
 
     assert(seq_no > 0);
 
@@ -479,6 +603,9 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
         for (int64_t i = 0; i < msa->column_no; ++i) {
             msa->msa_seq[0][i] = msa_to_byte(msa->seqs[0][i]);
         }
+        if (column_scores_out != NULL) {
+            *column_scores_out = make_column_scores(msa);
+        }
         return msa;
     }
     
@@ -498,20 +625,24 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
     // keep track of overlaps
     int64_t* row_overlaps = (int64_t*)st_calloc(seq_no, sizeof(int64_t));
 
-    // allocate the poa input buffer
-    uint8_t **bseqs = (uint8_t**)st_malloc(sizeof(uint8_t*) * seq_no);
+    // make sure the poa input buffer is big enough
     for (int64_t i = 0; i < seq_no; ++i) {
-        int64_t row_size = seq_lens[i] < window_size ? seq_lens[i] : window_size;
-        bseqs[i] = (uint8_t*)st_malloc(sizeof(uint8_t) * row_size);
         bases_remaining += seq_lens[i];
     }
+    poa_workspace_reserve(workspace, seq_lens, seq_no, window_size);
+    uint8_t **bseqs = workspace->bseqs;
      
     // collect our windowed outputs here, to be stiched at the end. 
     stList* msa_windows = stList_construct3(0, (void(*)(void *)) msa_destruct);
     
+    // and the column scores of each window, kept in step with its msa as it is trimmed
+    stList* window_column_scores = stList_construct3(0, free);
+
     // remember the previous window
     Msa* prev_msa = NULL;
     
+    float* prev_column_scores = NULL;
+    
     int64_t prev_bases_remaining = bases_remaining;
     for (int64_t iteration = 0; bases_remaining > 0; ++iteration) {
 
@@ -561,9 +692,10 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
             }
         }
 
-        // init abpoa
-        abpoa_t *ab = abpoa_init();
-        abpoa_para_t *abpt = copy_abpoa_params(poa_parameters);
+        // reuse the abpoa state, which abpoa_msa resets, and reset its parameters
+        abpoa_t *ab = workspace->ab;
+        abpoa_para_t *abpt = workspace->abpt;
+        reset_abpoa_params(abpt, poa_parameters);
         
 #ifdef CACTUS_ABPOA_MSA_DUMP_DIR
         // dump the input to file
@@ -600,13 +732,21 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
         }
         free(test_msa);
 #else
-        // perform abpoa-msa
+        // perform abpoa-msa, once there is room for it in the memory budget
+        int64_t window_bytes = estimate_window_bytes(msa->seq_lens, msa->seq_no, abpt);
+        poa_memory_acquire(window_bytes);
         abpoa_msa(ab, abpt, msa->seq_no, NULL, msa->seq_lens, bseqs, NULL, NULL);
         // abpoa's interface has changed a bit -- instead of passing in pointers to the results, they
         // end up in the ab->abc struct -- we extract them here
         msa->msa_seq = ab->abc->msa_base;
         ab->abc->msa_base = NULL;
         msa->column_no = ab->abc->msa_len;
+        ab->abc->msa_len = 0; // the rows are now owned by the msa, so abpoa must not free them when next reset
+        if (window_bytes > poa_memory_retain_limit) { // don't hold on to matrices the budget no longer accounts for
+            abpoa_free(ab);
+            workspace->ab = abpoa_init();
+        }
+        poa_memory_release(window_bytes);
 #endif
 
 #ifdef CACTUS_ABPOA_MSA_DUMP_DIR
@@ -618,10 +758,6 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
         free(abpoa_command_line);
 #endif
 
-        // free abpoa
-        abpoa_free(ab);
-        abpoa_free_para(abpt);
-
         // mask out empty sequences that were phonied in as Ns above
         for (int64_t i = 0; i < msa->seq_no && emptyCount > 0; ++i) {
             if (empty_seqs[i] == true) {
@@ -657,31 +793,23 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
             seq_offsets[i] += msa->seq_lens[i];
         }
 
-        // todo: there is obviously room for optimization here, as we compute full scores twice for each msa
-        //       in addition to flipping the prev_msa back and forth
-        //       (not sure if this is at all noticeable on top of abpoa running time though)
+        // each msa is scored once, the trimming keeping the scores up to date for its use as the previous msa
+        float* column_scores = make_column_scores(msa);
         if (prev_msa) {
-            // trim() presently assumes we're looking at reverse-complement sequence:
-            flip_msa_seq(msa);
-            float* prev_column_scores = make_column_scores(prev_msa);
-            float* column_scores = make_column_scores(msa);
-
-            // trim with the previous alignment
+            // trim with the previous alignment, reading our msa backwards so its prefix is trimmed against the
+            // suffix of the previous msa (as if it were reverse complemented, without flipping it)
             for (int64_t i = 0; i < msa->seq_no; ++i) {
                 int64_t overlap = msa->seq_lens[i] < row_overlaps[i] ? msa->seq_lens[i] : row_overlaps[i];
                 if (overlap > 0) {
-                    trim(i, msa, column_scores, i, prev_msa, prev_column_scores, overlap);
+                    trim(i, msa, column_scores, 1, i, prev_msa, prev_column_scores, overlap);
                 }
             }
             // todo: can this be done as part of trim?
-            msa_fix_trimmed(msa);
-            msa_fix_trimmed(prev_msa);            
-            // flip our msa back to its original strand
-            flip_msa_seq(msa);
-
-            free(prev_column_scores);
-            free(column_scores);
+            msa_fix_trimmed(msa, column_scores, 1);
+            msa_fix_trimmed(prev_msa, prev_column_scores, 0);
         }
+        prev_column_scores = column_scores;
+        stList_append(window_column_scores, column_scores);
 
         // add the msa to our list
         stList_append(msa_windows, msa);
@@ -703,6 +831,9 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
         output_msa->seqs = seqs;
         free(output_msa->seq_lens); // cleanup old memory
         output_msa->seq_lens = seq_lens;
+        if (column_scores_out != NULL) {
+            *column_scores_out = stList_removeFirst(window_column_scores);
+        }
     } else {
         // otherwise, we stitch all the window msas into a new output msa
         output_msa = st_malloc(sizeof(Msa));
@@ -728,13 +859,21 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
             }
             assert(offset == output_msa->column_no);
         }
+        // and the scores of the window columns, which are those of the stitched columns
+        if (column_scores_out != NULL) {
+            float *column_scores = st_malloc(sizeof(float) * output_msa->column_no);
+            int64_t offset = 0;
+            for (int64_t j = 0; j < num_windows; ++j) {
+                Msa* msa_j = stList_get(msa_windows, j);
+                memcpy(column_scores + offset, stList_get(window_column_scores, j), sizeof(float) * msa_j->column_no);
+                offset += msa_j->column_no;
+            }
+            *column_scores_out = column_scores;
+        }
     } 
 
     // Clean up
-    for (int64_t i = 0; i < seq_no; ++i) {
-        free(bseqs[i]);
-    }
-    free(bseqs);
+    stList_destruct(window_column_scores);
     free(seq_offsets);
     free(empty_seqs);
     free(row_overlaps);
@@ -743,22 +882,87 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
     return output_msa;
 }
 
+Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
+                                      abpoa_para_t *poa_parameters) {
+    PoaWorkspace *workspace = poa_workspace_construct();
+    Msa *msa = msa_make_partial_order_alignment2(seqs, seq_lens, seq_no, window_size, poa_parameters, workspace, NULL);
+    poa_workspace_destruct(workspace);
+    return msa;
+}
+
+/**
+ * Aligns each end, as a task if it is big enough, and waits for them all. Called from a single thread of a parallel
+ * region, so the tasks bind to its team and the threads of the team pick them up, each using its own workspace.
+ */
+static void make_end_msas(int64_t end_no, int64_t *end_lengths, char ***end_strings, int **end_string_lengths,
+                          int64_t window_size, abpoa_para_t *poa_parameters, Msa **msas, float **column_scores,
+                          PoaWorkspace **workspaces) {
+    for(int64_t i=0; i<end_no; i++) {
+        int64_t end_bases = 0;
+        for(int64_t j=0; j<end_lengths[i]; j++) {
+            end_bases += end_string_lengths[i][j];
+        }
+#if defined(_OPENMP)
+#pragma omp task firstprivate(i) if(end_bases >= MIN_BASES_FOR_END_TASK)
+#endif
+        {
+#if defined(_OPENMP)
+            int64_t thread = omp_get_thread_num();
+#else
+            int64_t thread = 0;
+#endif
+            if (workspaces[thread] == NULL) {
+                workspaces[thread] = poa_workspace_construct();
+            }
+            msas[i] = msa_make_partial_order_alignment2(end_strings[i], end_string_lengths[i], end_lengths[i],
+                                                        window_size, poa_parameters, workspaces[thread],
+                                                        &column_scores[i]);
+        }
+    }
+#if defined(_OPENMP)
+#pragma omp taskwait
+#endif
+}
+
 Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_lengths, char ***end_strings,
         int **end_string_lengths, int64_t **right_end_indexes, int64_t **right_end_row_indexes, int64_t **overlaps,
         int64_t window_size, abpoa_para_t *poa_parameters) {
     // Calculate the initial, potentially inconsistent msas and column scores for each msa
-    float *column_scores[end_no];
+    float **column_scores = st_malloc(sizeof(float *) * end_no);
     Msa **msas = st_malloc(sizeof(Msa *) * end_no);
-//#if defined(_OPENMP)
-//#pragma omp parallel for schedule(dynamic)
-//#endif
-    for(int64_t i=0; i<end_no; i++) {
-        msas[i] = msa_make_partial_order_alignment(end_strings[i], end_string_lengths[i], end_lengths[i], window_size,
-                                                   poa_parameters);
-        column_scores[i] = make_column_scores(msas[i]);
+    // A workspace per thread of the team aligning the ends, made on first use. A thread never switches tasks within
+    // msa_make_partial_order_alignment2 (it has no task scheduling points), so it can't use its workspace twice at once.
+#if defined(_OPENMP)
+    bool in_parallel = omp_in_parallel();
+    int64_t workspace_no = in_parallel ? omp_get_num_threads() : omp_get_max_threads();
+#else
+    int64_t workspace_no = 1;
+#endif
+    PoaWorkspace **workspaces = st_calloc(workspace_no, sizeof(PoaWorkspace *));
+#if defined(_OPENMP)
+    if (in_parallel) {
+        // Called from within a parallel region (as from the flower tasks of bar()), so the end tasks are made
+        // directly, binding to the enclosing team, and any idle threads of it pick them up
+        make_end_msas(end_no, end_lengths, end_strings, end_string_lengths, window_size, poa_parameters,
+                      msas, column_scores, workspaces);
+    } else {
+#pragma omp parallel
+#pragma omp single
+        make_end_msas(end_no, end_lengths, end_strings, end_string_lengths, window_size, poa_parameters,
+                      msas, column_scores, workspaces);
+    }
+#else
+    make_end_msas(end_no, end_lengths, end_strings, end_string_lengths, window_size, poa_parameters,
+                  msas, column_scores, workspaces);
+#endif
+    for (int64_t i = 0; i < workspace_no; i++) {
+        if (workspaces[i] != NULL) {
+            poa_workspace_destruct(workspaces[i]);
+        }
     }
+    free(workspaces);
 
-    // Make the msas consistent with one another
+    // Make the msas consistent with one another, serially and in end order, so the result is deterministic
     for(int64_t i=0; i<end_no; i++) { // For each end
         Msa *msa = msas[i];
         for(int64_t j=0; j<msa->seq_no; j++) { //  For each string incident to the ith end
@@ -767,7 +971,7 @@ Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_leng
 
             // If it hasn't already been trimmed
             if(right_end_index > i || (right_end_index == i /* self loop */ && right_end_row_index > j)) {
-                trim(j, msa, column_scores[i],
+                trim(j, msa, column_scores[i], 0,
                         right_end_row_index, msas[right_end_index], column_scores[right_end_index], overlaps[i][j]);
             }
         }
@@ -777,6 +981,7 @@ Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_leng
     for(int64_t i=0; i<end_no; i++) {
         free(column_scores[i]);
     }
+    free(column_scores);
 
     return msas;
 }
@@ -20,6 +20,14 @@
  */
 void bar(stList *flowers, CactusParams *p, CactusDisk *cactusDisk, stList *listOfEndAlignmentFiles);
 
+/*
+ * Predicts the relative cost of aligning a flower in bar(), used to schedule the most expensive flowers first.
+ * Each end's alignment is modelled as the total length of its adjacencies (each capped at maximumLength) times the
+ * length of the longest, capped at the alignment window (windowSize), and the cost is the sum of these over the ends.
+ * Only the adjacency lengths are used, no strings are made.
+ */
+int64_t bar_predictFlowerCost(Flower *flower, int64_t maximumLength, int64_t windowSize);
+
 /*
  * Construct a pairwise alignment parameters object parsing the cactus params specified parameters.
  */
@@ -31,6 +39,15 @@ PairwiseAlignmentParameters *pairwiseAlignmentParameters_constructFromCactusPara
  */
 abpoa_para_t *abpoaParameters_constructFromCactusParams(CactusParams *params);
 
+/**
+ * Sets the limit, in bytes, on the estimated abpoa memory of the windows being aligned at once, across all threads.
+ * Threads wait for room before aligning a window, windows being admitted in the order they ask and a window bigger
+ * than the whole budget being aligned alone. The estimate is only a guide to abpoa's memory, see
+ * estimate_window_bytes in poaBarAligner.c. With a budget the DP matrices of large windows are also freed after use
+ * rather than kept for the next window, so they stay within it. 0 (the default) is unlimited.
+ */
+void poa_set_memory_budget(int64_t budget);
+
 /**
  * Object representing a multiple sequence alignment
  */
@@ -62,6 +79,15 @@ void msa_destruct(Msa *msa);
  */
 void msa_print(Msa *msa, FILE *f);
 
+/**
+ * The abpoa state and buffers reused by the alignments made with it, which must not be used by two alignments at once.
+ */
+typedef struct _poaWorkspace PoaWorkspace;
+
+PoaWorkspace *poa_workspace_construct(void);
+
+void poa_workspace_destruct(PoaWorkspace *workspace);
+
 /**
  * Creates a partial order alignment
  * @param seqs An array of DNA string
@@ -77,6 +103,14 @@ Msa *msa_make_partial_order_alignment(char **seqs,
                                       int64_t window_size,
                                       abpoa_para_t *poa_parameters);
 
+/**
+ * As msa_make_partial_order_alignment, but aligning using the given workspace, so its matrices and buffers are
+ * reused rather than allocated afresh. If column_scores is not NULL it is set to an array of the score of each
+ * column of the msa (the number of bases in it less one), as worked out while aligning.
+ */
+Msa *msa_make_partial_order_alignment2(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
+                                       abpoa_para_t *poa_parameters, PoaWorkspace *workspace, float **column_scores);
+
 /**
  * Takes a set of ends and returns a set of consistent multiple alignments,
  * one for each of them.
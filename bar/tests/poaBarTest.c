@@ -177,6 +177,258 @@ void test_make_consistent_partial_order_alignments_two_ends(CuTest *testCase) {
     abpoa_free_para(abpt);
 }
 
+/**
+ * The inputs of make_consistent_partial_order_alignments for two ends connected by a set of strings, the ith string
+ * of the first end being the reverse complement of the ((i + j) % seq_no)th string of the second.
+ */
+typedef struct _TwoEnds {
+    int64_t end_lengths[2];
+    char **end_strings[2];
+    int *end_string_lengths[2];
+    int64_t *right_end_indexes[2];
+    int64_t *right_end_row_indexes[2];
+    int64_t *overlaps[2];
+} TwoEnds;
+
+/**
+ * Makes two ends connected by copies of the given strings. The strings are owned by the msas made from them.
+ */
+static TwoEnds *twoEnds_construct(char **seqs, int64_t seq_no, int64_t j) {
+    TwoEnds *ends = st_malloc(sizeof(TwoEnds));
+    for(int64_t i=0; i<2; i++) {
+        ends->end_lengths[i] = seq_no;
+        ends->end_strings[i] = st_malloc(sizeof(char *) * seq_no);
+        ends->end_string_lengths[i] = st_malloc(sizeof(int) * seq_no);
+        ends->right_end_indexes[i] = st_malloc(sizeof(int64_t) * seq_no);
+        ends->right_end_row_indexes[i] = st_malloc(sizeof(int64_t) * seq_no);
+        ends->overlaps[i] = st_malloc(sizeof(int64_t) * seq_no);
+    }
+    for(int64_t i=0; i<seq_no; i++) {
+        int64_t k = (i + j)%seq_no;
+        int64_t length = strlen(seqs[i]);
+
+        ends->end_strings[0][i] = stString_copy(seqs[i]);
+        ends->end_string_lengths[0][i] = length;
+        ends->right_end_indexes[0][i] = 1;
+        ends->right_end_row_indexes[0][i] = k;
+        ends->overlaps[0][i] = length;
+
+        ends->end_strings[1][k] = stString_reverseComplementString(seqs[i]);
+        ends->end_string_lengths[1][k] = length;
+        ends->right_end_indexes[1][k] = 0;
+        ends->right_end_row_indexes[1][k] = i;
+        ends->overlaps[1][k] = length;
+    }
+    return ends;
+}
+
+static Msa **twoEnds_align(TwoEnds *ends, int64_t window_size, abpoa_para_t *abpt) {
+    return make_consistent_partial_order_alignments(2, ends->end_lengths, ends->end_strings, ends->end_string_lengths,
+                                                    ends->right_end_indexes, ends->right_end_row_indexes,
+                                                    ends->overlaps, window_size, abpt);
+}
+
+static void twoEnds_destruct(TwoEnds *ends) {
+    for(int64_t i=0; i<2; i++) {
+        free(ends->right_end_indexes[i]);
+        free(ends->right_end_row_indexes[i]);
+        free(ends->overlaps[i]);
+    }
+    free(ends);
+}
+
+/**
+ * Checks two msas have the same rows.
+ */
+static void check_msas_equal(CuTest *testCase, Msa *msa1, Msa *msa2) {
+    CuAssertIntEquals(testCase, msa1->seq_no, msa2->seq_no);
+    CuAssertIntEquals(testCase, msa1->column_no, msa2->column_no);
+    for(int64_t i=0; i<msa1->seq_no; i++) {
+        CuAssertIntEquals(testCase, msa1->seq_lens[i], msa2->seq_lens[i]);
+        CuAssertTrue(testCase, memcmp(msa1->msa_seq[i], msa2->msa_seq[i], msa1->column_no) == 0);
+    }
+}
+
+/**
+ * Makes random sets of closely related strings, each sequence from which a pair of ends is made.
+ */
+static stList *make_random_string_sets(int64_t set_no, int64_t *seq_nos) {
+    stList *string_sets = stList_construct();
+    for(int64_t test=0; test<set_no; test++) {
+        char *parent_string = getRandomACGTSequence(st_randomInt(50, 150));
+        seq_nos[test] = st_randomInt(2, 20);
+        char **seqs = st_malloc(sizeof(char *) * seq_nos[test]);
+        for(int64_t i=0; i<seq_nos[test]; i++) {
+            seqs[i] = evolveSequence(parent_string);
+        }
+        stList_append(string_sets, seqs);
+        free(parent_string);
+    }
+    return string_sets;
+}
+
+static void destruct_random_string_sets(stList *string_sets, int64_t *seq_nos) {
+    for(int64_t test=0; test<stList_length(string_sets); test++) {
+        char **seqs = stList_get(string_sets, test);
+        for(int64_t i=0; i<seq_nos[test]; i++) {
+            free(seqs[i]);
+        }
+        free(seqs);
+    }
+    stList_destruct(string_sets);
+}
+
+/**
+ * Aligns a series of different sets of strings with one workspace, so its buffers are grown and reused by inputs of
+ * varying numbers and lengths of strings, checking each msa is the same as that made with a fresh workspace and the
+ * column scores returned with it are those of its columns.
+ */
+void test_make_partial_order_alignment_reusing_workspace(CuTest *testCase) {
+    abpoa_para_t *abpt = abpoa_init_para();
+    abpt->wb = 10;
+    abpt->wf = 0.01;
+    abpoa_post_set_para(abpt);
+
+    int64_t set_no = 50;
+    int64_t seq_nos[set_no];
+    stList *string_sets = make_random_string_sets(set_no, seq_nos);
+    PoaWorkspace *workspace = poa_workspace_construct();
+    for(int64_t test=0; test<set_no; test++) {
+        char **seqs = stList_get(string_sets, test);
+        int64_t seq_no = seq_nos[test], window_size = st_randomInt(10, 200);
+        char **seqs1 = st_malloc(sizeof(char *) * seq_no), **seqs2 = st_malloc(sizeof(char *) * seq_no);
+        int *seq_lens1 = st_malloc(sizeof(int) * seq_no), *seq_lens2 = st_malloc(sizeof(int) * seq_no);
+        for(int64_t i=0; i<seq_no; i++) {
+            seqs1[i] = stString_copy(seqs[i]);
+            seqs2[i] = stString_copy(seqs[i]);
+            seq_lens1[i] = seq_lens2[i] = strlen(seqs[i]);
+        }
+
+        Msa *expected_msa = msa_make_partial_order_alignment(seqs1, seq_lens1, seq_no, window_size, abpt);
+        float *column_scores;
+        Msa *msa = msa_make_partial_order_alignment2(seqs2, seq_lens2, seq_no, window_size, abpt, workspace,
+                                                     &column_scores);
+        check_msas_equal(testCase, expected_msa, msa);
+
+        // check the column scores are the number of bases in each column less one
+        for(int64_t j=0; j<msa->column_no; j++) {
+            int64_t bases = 0;
+            for(int64_t i=0; i<seq_no; i++) {
+                bases += msa_to_base(msa->msa_seq[i][j]) != '-';
+            }
+            CuAssertDblEquals(testCase, bases > 1 ? bases - 1 : 0, column_scores[j], 0.0);
+        }
+
+        free(column_scores);
+        msa_destruct(expected_msa);
+        msa_destruct(msa);
+    }
+    poa_workspace_destruct(workspace);
+    destruct_random_string_sets(string_sets, seq_nos);
+    abpoa_free_para(abpt);
+}
+
+/**
+ * Aligns the two ends made from each set of strings, each from a task of a parallel region, as bar() does.
+ */
+static void align_two_ends_in_parallel(stList *string_sets, int64_t *seq_nos, int64_t *offsets, int64_t window_size,
+                                       abpoa_para_t *abpt, Msa ***msas) {
+#if defined(_OPENMP)
+#pragma omp parallel
+#pragma omp single
+#endif
+    for(int64_t test=0; test<stList_length(string_sets); test++) {
+#if defined(_OPENMP)
+#pragma omp task firstprivate(test)
+#endif
+        {
+            TwoEnds *ends = twoEnds_construct(stList_get(string_sets, test), seq_nos[test], offsets[test]);
+            msas[test] = twoEnds_align(ends, window_size, abpt);
+            twoEnds_destruct(ends);
+        }
+    }
+}
+
+/**
+ * Aligns sets of ends from tasks of an enclosing parallel region, as bar() does, and checks the msas are the same as
+ * those made when it is called outside of one.
+ */
+void test_make_consistent_partial_order_alignments_nested(CuTest *testCase) {
+    abpoa_para_t *abpt = abpoa_init_para();
+    abpt->wb = 10;
+    abpt->wf = 0.01;
+    abpoa_post_set_para(abpt);
+
+    int64_t set_no = 16, window_size = 40;
+    int64_t seq_nos[set_no], offsets[set_no];
+    stList *string_sets = make_random_string_sets(set_no, seq_nos);
+    Msa **expected_msas[set_no], **nested_msas[set_no];
+    for(int64_t test=0; test<set_no; test++) {
+        offsets[test] = st_randomInt(0, 1000);
+        TwoEnds *ends = twoEnds_construct(stList_get(string_sets, test), seq_nos[test], offsets[test]);
+        expected_msas[test] = twoEnds_align(ends, window_size, abpt);
+        twoEnds_destruct(ends);
+    }
+
+    align_two_ends_in_parallel(string_sets, seq_nos, offsets, window_size, abpt, nested_msas);
+
+    for(int64_t test=0; test<set_no; test++) {
+        for(int64_t i=0; i<2; i++) {
+            check_msas_equal(testCase, expected_msas[test][i], nested_msas[test][i]);
+            msa_destruct(expected_msas[test][i]);
+            msa_destruct(nested_msas[test][i]);
+        }
+        free(expected_msas[test]);
+        free(nested_msas[test]);
+    }
+    destruct_random_string_sets(string_sets, seq_nos);
+    abpoa_free_para(abpt);
+}
+
+/**
+ * Aligns sets of ends in parallel with memory budgets admitting one window at a time and a few at a time, checking the
+ * msas are the same as those made without a budget.
+ */
+void test_make_consistent_partial_order_alignments_memory_budget(CuTest *testCase) {
+    abpoa_para_t *abpt = abpoa_init_para();
+    abpt->wb = 10;
+    abpt->wf = 0.01;
+    abpoa_post_set_para(abpt);
+
+    int64_t set_no = 16, window_size = 40;
+    int64_t seq_nos[set_no], offsets[set_no];
+    stList *string_sets = make_random_string_sets(set_no, seq_nos);
+    for(int64_t test=0; test<set_no; test++) {
+        offsets[test] = st_randomInt(0, 1000);
+    }
+    Msa **expected_msas[set_no];
+    align_two_ends_in_parallel(string_sets, seq_nos, offsets, window_size, abpt, expected_msas);
+
+    int64_t budgets[] = { 1, 200000 };
+    for(int64_t k=0; k<2; k++) {
+        Msa **msas[set_no];
+        poa_set_memory_budget(budgets[k]);
+        align_two_ends_in_parallel(string_sets, seq_nos, offsets, window_size, abpt, msas);
+        poa_set_memory_budget(0);
+        for(int64_t test=0; test<set_no; test++) {
+            for(int64_t i=0; i<2; i++) {
+                check_msas_equal(testCase, expected_msas[test][i], msas[test][i]);
+                msa_destruct(msas[test][i]);
+            }
+            free(msas[test]);
+        }
+    }
+
+    for(int64_t test=0; test<set_no; test++) {
+        for(int64_t i=0; i<2; i++) {
+            msa_destruct(expected_msas[test][i]);
+        }
+        free(expected_msas[test]);
+    }
+    destruct_random_string_sets(string_sets, seq_nos);
+    abpoa_free_para(abpt);
+}
+
 void test_make_flower_alignment_poa(CuTest *testCase) {
     setup(testCase);
 
@@ -266,7 +518,10 @@ void test_alignment_block_iterator(CuTest *testCase) {
 CuSuite* poaBarAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_make_partial_order_alignment);
+    SUITE_ADD_TEST(suite, test_make_partial_order_alignment_reusing_workspace);
     SUITE_ADD_TEST(suite, test_make_consistent_partial_order_alignments_two_ends);
+    SUITE_ADD_TEST(suite, test_make_consistent_partial_order_alignments_nested);
+    SUITE_ADD_TEST(suite, test_make_consistent_partial_order_alignments_memory_budget);
     SUITE_ADD_TEST(suite, test_make_flower_alignment_poa);
     SUITE_ADD_TEST(suite, test_alignment_block_iterator);
     return suite;
@@ -43,22 +43,22 @@ void stCaf_anneal2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *
 }
 
 static void stCaf_annealWithFilter2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *, stPinch *), void *extraArg,
-                                    bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower) {
+                                    bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs) {
     stPinch *pinch, pinchToFillOut;
     while ((pinch = pinchIterator(extraArg, &pinchToFillOut)) != NULL) {
         stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
         stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
         assert(thread1 != NULL && thread2 != NULL);
         stPinchThread_filterPinch(thread1, thread2, pinch->start1, pinch->start2, pinch->length, pinch->strand,
-                                  (bool(*)(stPinchSegment *, stPinchSegment *, void *))filterFn, flower);
+                                  (bool(*)(stPinchSegment *, stPinchSegment *, void *))filterFn, filterArgs);
     }
 }
 
 void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
-                  bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower) {
+                  bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs) {
     stPinchIterator_reset(pinchIterator);
     if(filterFn != NULL) {
-        stCaf_annealWithFilter2(threadSet, (stPinch *(*)(void *, stPinch *)) stPinchIterator_getNext, pinchIterator, filterFn, flower);
+        stCaf_annealWithFilter2(threadSet, (stPinch *(*)(void *, stPinch *)) stPinchIterator_getNext, pinchIterator, filterFn, filterArgs);
     }
     else {
         stCaf_anneal2(threadSet, (stPinch *(*)(void *, stPinch *)) stPinchIterator_getNext, pinchIterator);
@@ -70,115 +70,191 @@ void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
 // Annealing function that ignores homologies between bases not in the same adjacency component.
 ///////////////////////////////////////////////////////////////////////////
 
-static int64_t getIntersectionLength(int64_t start1, int64_t start2, stPinchInterval *pinchInterval1,
-        stPinchInterval *pinchInterval2) {
-    int64_t length1 = pinchInterval1->length + pinchInterval1->start - start1;
-    int64_t length2 = pinchInterval2->length + pinchInterval2->start - start2;
-    assert(length1 > 0 && length2 > 0);
-    return length1 > length2 ? length2 : length1;
+/*
+ * Index of the adjacency component of each base. For each thread it holds a flat array of the thread's label
+ * intervals sorted by start, so the run of intervals covering a pinch is found with one binary search per side and
+ * then walked linearly, rather than searching a sorted set for every interval boundary.
+ */
+
+typedef struct _componentInterval {
+    int64_t start;
+    int64_t end; // Exclusive
+    void *label;
+} ComponentInterval;
+
+typedef struct _componentIntervalIndex {
+    int64_t threadNumber;
+    Name *threadNames; // Sorted, so threads are found by binary search
+    int64_t *threadOffsets; // The intervals of the ith thread are intervals[threadOffsets[i]..threadOffsets[i+1]-1]
+    ComponentInterval *intervals;
+    stList *adjacencyComponents; // The labels
+} ComponentIntervalIndex;
+
+/*
+ * Returns the index of the last element of the sorted array of length n that is less than or equal to the key, or 0
+ * if there is none. The loop body compiles to a conditional move, so there are no branches to mispredict.
+ */
+static int64_t searchNames(Name *names, int64_t n, Name key) {
+    Name *base = names;
+    while (n > 1) {
+        int64_t half = n / 2;
+        base = base[half] <= key ? base + half : base;
+        n -= half;
+    }
+    return base - names;
 }
 
-static int64_t getIntersectionLengthReverse(int64_t start1, int64_t end2, stPinchInterval *pinchInterval1,
-        stPinchInterval *pinchInterval2) {
-    int64_t length1 = pinchInterval1->length + pinchInterval1->start - start1;
-    int64_t length2 = end2 - pinchInterval2->start + 1;
-    assert(length1 > 0 && length2 > 0);
-    return length1 > length2 ? length2 : length1;
+static int64_t searchIntervals(ComponentInterval *intervals, int64_t n, int64_t position) {
+    ComponentInterval *base = intervals;
+    while (n > 1) {
+        int64_t half = n / 2;
+        base = base[half].start <= position ? base + half : base;
+        n -= half;
+    }
+    return base - intervals;
 }
 
-static stPinchInterval *updatePinchInterval(int64_t start, stPinchInterval *pinchInterval,
-        stSortedSet *adjacencyComponentIntervals) {
-    return start < pinchInterval->start + pinchInterval->length ? pinchInterval : stPinchIntervals_getInterval(
-            adjacencyComponentIntervals, pinchInterval->name, start);
+static ComponentIntervalIndex *componentIntervalIndex_construct(stPinchThreadSet *threadSet) {
+    ComponentIntervalIndex *index = st_malloc(sizeof(ComponentIntervalIndex));
+    stHash *pinchEndsToAdjacencyComponents;
+    index->adjacencyComponents = stPinchThreadSet_getAdjacencyComponents2(threadSet, &pinchEndsToAdjacencyComponents);
+    stSortedSet *labelIntervals = stPinchThreadSet_getLabelIntervals(threadSet, pinchEndsToAdjacencyComponents);
+    stHash_destruct(pinchEndsToAdjacencyComponents);
+
+    // The intervals are ordered by thread name then start, so each thread's intervals are contiguous
+    int64_t intervalNumber = stSortedSet_size(labelIntervals);
+    index->threadNames = st_malloc(sizeof(Name) * (intervalNumber > 0 ? intervalNumber : 1));
+    index->threadOffsets = st_malloc(sizeof(int64_t) * (intervalNumber + 1));
+    index->intervals = st_malloc(sizeof(ComponentInterval) * (intervalNumber > 0 ? intervalNumber : 1));
+    index->threadNumber = 0;
+    stSortedSetIterator *it = stSortedSet_getIterator(labelIntervals);
+    stPinchInterval *pinchInterval;
+    int64_t i = 0;
+    while ((pinchInterval = stSortedSet_getNext(it)) != NULL) {
+        if (index->threadNumber == 0 || index->threadNames[index->threadNumber - 1] != pinchInterval->name) {
+            index->threadNames[index->threadNumber] = pinchInterval->name;
+            index->threadOffsets[index->threadNumber++] = i;
+        }
+        index->intervals[i].start = pinchInterval->start;
+        index->intervals[i].end = pinchInterval->start + pinchInterval->length;
+        index->intervals[i++].label = stPinchInterval_getLabel(pinchInterval);
+    }
+    stSortedSet_destructIterator(it);
+    index->threadOffsets[index->threadNumber] = intervalNumber;
+    stSortedSet_destruct(labelIntervals);
+    return index;
+}
+
+static void componentIntervalIndex_destruct(ComponentIntervalIndex *index) {
+    free(index->threadNames);
+    free(index->threadOffsets);
+    free(index->intervals);
+    stList_destruct(index->adjacencyComponents);
+    free(index);
 }
 
-static stPinchInterval *updatePinchIntervalReverse(int64_t end, stPinchInterval *pinchInterval,
-        stSortedSet *adjacencyComponentIntervals) {
-    return end >= pinchInterval->start ? pinchInterval : stPinchIntervals_getInterval(adjacencyComponentIntervals,
-            pinchInterval->name, end);
+/*
+ * Gets the run of intervals of the thread covering the bases start to end (inclusive), setting first and last to
+ * point at the first and last interval of the run.
+ */
+static void componentIntervalIndex_getIntervals(ComponentIntervalIndex *index, Name threadName, int64_t start,
+                                                int64_t end, ComponentInterval **first, ComponentInterval **last) {
+    int64_t thread = searchNames(index->threadNames, index->threadNumber, threadName);
+    assert(thread < index->threadNumber && index->threadNames[thread] == threadName);
+    ComponentInterval *intervals = index->intervals + index->threadOffsets[thread];
+    int64_t intervalNumber = index->threadOffsets[thread + 1] - index->threadOffsets[thread];
+    int64_t i = searchIntervals(intervals, intervalNumber, start);
+    *first = intervals + i;
+    *last = intervals + i + searchIntervals(intervals + i, intervalNumber - i, end);
+    assert((*first)->start <= start && start < (*first)->end);
+    assert((*last)->start <= end && end < (*last)->end);
 }
 
 static int64_t min(int64_t i, int64_t j) {
     return i < j ? i : j;
 }
 
-static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stSortedSet *adjacencyComponentIntervals,
-                                bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower) {
-    stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
-    stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
-    assert(thread1 != NULL && thread2 != NULL);
-    stPinchInterval *pinchInterval1 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name1,
-            pinch->start1);
+static void pinchSameComponents(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2,
+                                int64_t length, bool strand,
+                                bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs) {
+    if(filterFn != NULL) {
+        stPinchThread_filterPinch(thread1, thread2, start1, start2, length, strand,
+                                  (bool(*)(stPinchSegment *, stPinchSegment *, void *))filterFn, filterArgs);
+    }
+    else {
+        stPinchThread_pinch(thread1, thread2, start1, start2, length, strand);
+    }
+}
+
+static void alignSameComponents(stPinch *pinch, stPinchThread *thread1, stPinchThread *thread2,
+                                ComponentIntervalIndex *index,
+                                bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs) {
+    ComponentInterval *interval1, *lastInterval1, *interval2, *lastInterval2;
+    componentIntervalIndex_getIntervals(index, pinch->name1, pinch->start1, pinch->start1 + pinch->length - 1,
+                                        &interval1, &lastInterval1);
+    componentIntervalIndex_getIntervals(index, pinch->name2, pinch->start2, pinch->start2 + pinch->length - 1,
+                                        &interval2, &lastInterval2);
     int64_t offset = 0;
     if (pinch->strand) { //A bit redundant code wise, but fast.
-        stPinchInterval *pinchInterval2 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name2,
-                pinch->start2);
         while (offset < pinch->length) {
-            assert(pinchInterval1 != NULL && pinchInterval2 != NULL);
-            int64_t length = min(getIntersectionLength(pinch->start1 + offset, pinch->start2 + offset, pinchInterval1,
-                    pinchInterval2), pinch->length - offset);
-            if (stPinchInterval_getLabel(pinchInterval1) == stPinchInterval_getLabel(pinchInterval2)) {
-                if(filterFn != NULL) {
-                    stPinchThread_filterPinch(thread1, thread2, pinch->start1 + offset, pinch->start2 + offset, length, 1,
-                                              (bool(*)(stPinchSegment *, stPinchSegment *, void *))filterFn, flower);
-                }
-                else {
-                    stPinchThread_pinch(thread1, thread2, pinch->start1 + offset, pinch->start2 + offset, length, 1);
-                }
+            assert(interval1 <= lastInterval1 && interval2 <= lastInterval2);
+            int64_t length = min(min(interval1->end - (pinch->start1 + offset), interval2->end - (pinch->start2 + offset)),
+                                 pinch->length - offset);
+            assert(length > 0);
+            if (interval1->label == interval2->label) {
+                pinchSameComponents(thread1, thread2, pinch->start1 + offset, pinch->start2 + offset, length, 1,
+                                    filterFn, filterArgs);
             }
             offset += length;
-            pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1, adjacencyComponentIntervals);
-            pinchInterval2 = updatePinchInterval(pinch->start2 + offset, pinchInterval2, adjacencyComponentIntervals);
+            if (pinch->start1 + offset >= interval1->end) {
+                interval1++;
+            }
+            if (pinch->start2 + offset >= interval2->end) {
+                interval2++;
+            }
         }
     } else {
         int64_t end2 = pinch->start2 + pinch->length - 1;
-        stPinchInterval *pinchInterval2 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name2, end2);
+        ComponentInterval *firstInterval2 = interval2;
+        interval2 = lastInterval2; // Walk backwards along the second thread
         while (offset < pinch->length) {
-            assert(pinchInterval1 != NULL && pinchInterval2 != NULL);
-            int64_t length = min(getIntersectionLengthReverse(pinch->start1 + offset, end2 - offset, pinchInterval1,
-                    pinchInterval2), pinch->length - offset);
-            if (stPinchInterval_getLabel(pinchInterval1) == stPinchInterval_getLabel(pinchInterval2)) {
-                if(filterFn != NULL) {
-                    stPinchThread_filterPinch(thread1, thread2, pinch->start1 + offset, end2 - offset - length + 1, length, 0,
-                                              (bool(*)(stPinchSegment *, stPinchSegment *, void *))filterFn, flower);
-                }
-                else {
-                    stPinchThread_pinch(thread1, thread2, pinch->start1 + offset, end2 - offset - length + 1, length, 0);
-                }
+            assert(interval1 <= lastInterval1 && interval2 >= firstInterval2);
+            int64_t length = min(min(interval1->end - (pinch->start1 + offset), end2 - offset - interval2->start + 1),
+                                 pinch->length - offset);
+            assert(length > 0);
+            if (interval1->label == interval2->label) {
+                pinchSameComponents(thread1, thread2, pinch->start1 + offset, end2 - offset - length + 1, length, 0,
+                                    filterFn, filterArgs);
             }
             offset += length;
-            pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1, adjacencyComponentIntervals);
-            pinchInterval2 = updatePinchIntervalReverse(end2 - offset, pinchInterval2, adjacencyComponentIntervals);
+            if (pinch->start1 + offset >= interval1->end) {
+                interval1++;
+            }
+            if (end2 - offset < interval2->start) {
+                interval2--;
+            }
         }
     }
 }
 
-static stSortedSet *getAdjacencyComponentIntervals(stPinchThreadSet *threadSet, stList **adjacencyComponents) {
-    stHash *pinchEndsToAdjacencyComponents;
-    *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents2(threadSet, &pinchEndsToAdjacencyComponents);
-    stSortedSet *adjacencyComponentIntervals = stPinchThreadSet_getLabelIntervals(threadSet,
-            pinchEndsToAdjacencyComponents);
-    stHash_destruct(pinchEndsToAdjacencyComponents);
-    return adjacencyComponentIntervals;
-}
-
 void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *, stPinch *),
-        void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower) {
+        void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs) {
     //Get the adjacency component intervals
-    stList *adjacencyComponents;
-    stSortedSet *adjacencyComponentIntervals = getAdjacencyComponentIntervals(threadSet, &adjacencyComponents);
+    ComponentIntervalIndex *index = componentIntervalIndex_construct(threadSet);
     //Now do the actual alignments.
     stPinch *pinch, pinchToFillOut;
     while ((pinch = pinchIterator(extraArg, &pinchToFillOut)) != NULL) {
-        alignSameComponents(pinch, threadSet, adjacencyComponentIntervals, filterFn, flower);
+        stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
+        assert(thread1 != NULL && thread2 != NULL);
+        alignSameComponents(pinch, thread1, thread2, index, filterFn, filterArgs);
     }
-    stSortedSet_destruct(adjacencyComponentIntervals);
-    stList_destruct(adjacencyComponents);
+    componentIntervalIndex_destruct(index);
 }
 
 void stCaf_annealBetweenAdjacencyComponents(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
-                                            bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower) {
+                                            bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs) {
     stPinchIterator_reset(pinchIterator);
-    stCaf_annealBetweenAdjacencyComponents2(threadSet, (stPinch *(*)(void *, stPinch *)) stPinchIterator_getNext, pinchIterator, filterFn, flower);
+    stCaf_annealBetweenAdjacencyComponents2(threadSet, (stPinch *(*)(void *, stPinch *)) stPinchIterator_getNext, pinchIterator, filterFn, filterArgs);
     stCaf_joinTrivialBoundaries(threadSet);
 }
@@ -8,136 +8,110 @@
 
 static bool blockFilterFn(stPinchBlock *pinchBlock, void *extraArg) {
     FilterArgs *f = extraArg;
-    if (!stCaf_containsRequiredSpecies(pinchBlock, f->flower, f->minimumIngroupDegree,
+    if (!stCaf_containsRequiredSpecies(pinchBlock, f->flower, f->eventTable, f->minimumIngroupDegree,
                                        f->minimumOutgroupDegree, f->minimumDegree,
                                        f->minimumNumberOfSpecies)) {
         return 1;
     }
-    if (f->minimumTreeCoverage > 0.0 && stCaf_treeCoverage(pinchBlock, f->flower) < f->minimumTreeCoverage) { //Tree coverage
+    if (f->minimumTreeCoverage > 0.0 && stCaf_treeCoverage(pinchBlock, f->flower, f->eventTable) < f->minimumTreeCoverage) { //Tree coverage
         return 1;
     }
     return 0;
 }
 
-static uint64_t choose2(uint64_t n) {
-#define CHOOSE_TWO_CACHE_LEN 256
-    int64_t chooseTwoCache[256] = {0}; // removing static variable, even if fast
-    if (n <= 1) {
-        return 0;
-    } else if (n >= CHOOSE_TWO_CACHE_LEN) {
-        return n * (n - 1) / 2;
-    } else {
-        if (chooseTwoCache[n] != 0) {
-            return chooseTwoCache[n];
-        } else {
-            chooseTwoCache[n] = n * (n - 1) / 2;
-            return chooseTwoCache[n];
-        }
-    }
+// Print a set of statistics for degree and support percentage in the
+// pinch graph, followed by a machine-readable record of them.
+static void printThreadSetStatistics(stPinchThreadSet *threadSet, Flower *flower, const char *stage, int64_t round,
+                                     FILE *f) {
+    stCafThreadSetStatistics *stats = stCaf_getThreadSetStatistics(threadSet, flower);
+    stCafThreadSetStatistics_print(stats, f);
+    stCafThreadSetStatistics_printRecord(stats, stage, round, f);
+    stCafThreadSetStatistics_destruct(stats);
 }
 
-// Get the number of possible pairwise alignments that could support
-// this block. Ordinarily this is (degree choose 2), but since we
-// don't do outgroup self-alignment, it's a bit smaller.
-static uint64_t numPossibleSupportingHomologies(stPinchBlock *block, Flower *flower) {
-    uint64_t outgroupDegree = 0, ingroupDegree = 0;
-    stPinchBlockIt segIt = stPinchBlock_getSegmentIterator(block);
-    stPinchSegment *segment;
-    while ((segment = stPinchBlockIt_getNext(&segIt)) != NULL) {
-        Name capName = stPinchSegment_getName(segment);
-        Cap *cap = flower_getCap(flower, capName);
-        Event *event = cap_getEvent(cap);
-        if (event_isOutgroup(event)) {
-            outgroupDegree++;
-        } else {
-            ingroupDegree++;
-        }
+/*
+ * Destroys the blocks of degree greater than minimumBlockDegreeToCheckSupport whose proportion of possible
+ * supporting homologies is less than minimumBlockHomologySupport. The possible supporting homologies are counted
+ * in parallel, which only reads the graph and the CAF event table, and the blocks then destroyed serially, in block
+ * iteration order.
+ */
+static void destroyMegablocks(stPinchThreadSet *threadSet, Flower *flower, stCafEventTable *eventTable,
+                              int64_t minimumBlockDegreeToCheckSupport, double minimumBlockHomologySupport) {
+    if (minimumBlockDegreeToCheckSupport <= 0) {
+        return;
     }
-    assert(outgroupDegree + ingroupDegree == stPinchBlock_getDegree(block));
-    // We do the ingroup-ingroup alignments as an all-against-all
-    // alignment, so we can see each ingroup-ingroup homology up to
-    // twice.
-    return choose2(ingroupDegree) * 2 + ingroupDegree * outgroupDegree;
-}
-
-// for printThreadSetStatistics
-static int uint64_cmp(const uint64_t *x, const uint64_t *y) {
-    if (*x < *y) {
-        return -1;
-    } else if (*x == *y) {
-        return 0;
-    } else {
-        return 1;
+    stList *blocks = stList_construct();
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        if (stPinchBlock_getDegree(block) > minimumBlockDegreeToCheckSupport) {
+            stList_append(blocks, block);
+        }
     }
-}
 
-// for printThreadSetStatistics
-static int double_cmp(const double *x, const double *y) {
-    if (*x < *y) {
-        return -1;
-    } else if (*x == *y) {
-        return 0;
-    } else {
-        return 1;
+    // Score the blocks
+    int64_t blockNumber = stList_length(blocks);
+    uint64_t *possibleSupportingHomologies = st_malloc(sizeof(uint64_t) * (blockNumber > 0 ? blockNumber : 1));
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (int64_t i = 0; i < blockNumber; i++) {
+        possibleSupportingHomologies[i] = stCaf_numPossibleSupportingHomologies(stList_get(blocks, i), flower, eventTable);
     }
-}
 
-// Print a set of statistics (avg, median, max, min) for degree and
-// support percentage in the pinch graph.
-static void printThreadSetStatistics(stPinchThreadSet *threadSet, Flower *flower, FILE *f)
-{
-    // Naively finds the max, median, and min by sorting: the lists
-    // will have "only" millions of elements, so they should fit
-    // comfortably into tens of MB of memory.
-
-    uint64_t numBlocks = stPinchThreadSet_getTotalBlockNumber(threadSet);
-
-    uint64_t *blockDegrees = malloc(numBlocks * sizeof(uint64_t));
-    double totalDegree = 0.0;
-    double *blockSupports = malloc(numBlocks * sizeof(double));
-    double totalSupport = 0.0;
-
-    uint64_t totalAlignedBases = 0;
-
-    stPinchThreadSetBlockIt it = stPinchThreadSet_getBlockIt(threadSet);
-    uint64_t i = 0;
-    stPinchBlock *block;
-    while ((block = stPinchThreadSetBlockIt_getNext(&it)) != NULL) {
-        blockDegrees[i] = stPinchBlock_getDegree(block);
-        totalDegree += stPinchBlock_getDegree(block);
+    // Destroy the poorly supported blocks
+    int64_t num_megablocks_destroyed = 0;
+    int64_t num_homologies_destroyed = 0;
+    for (int64_t i = 0; i < blockNumber; i++) {
+        stPinchBlock *block = stList_get(blocks, i);
         uint64_t supportingHomologies = stPinchBlock_getNumSupportingHomologies(block);
-        uint64_t possibleSupportingHomologies = numPossibleSupportingHomologies(block, flower);
-        double support = 0.0;
-        if (possibleSupportingHomologies != 0) {
-            support = ((double) supportingHomologies) / possibleSupportingHomologies;
+        double support = ((double) supportingHomologies) / possibleSupportingHomologies[i];
+        if (support < minimumBlockHomologySupport) {
+            st_logDebug("Destroyed a megablock with degree %" PRIi64
+            " and %" PRIi64 " supporting homologies out of a maximum "
+                            "of %" PRIi64 " (%lf%%).\n", stPinchBlock_getDegree(block),
+                    supportingHomologies, possibleSupportingHomologies[i], support);
+            stPinchBlock_destruct(block);
+            ++num_megablocks_destroyed;
+            num_homologies_destroyed += supportingHomologies;
         }
-        blockSupports[i] = support;
-        totalSupport += support;
-
-        totalAlignedBases += stPinchBlock_getLength(block) * stPinchBlock_getDegree(block);
-
-        i++;
     }
+    if (num_megablocks_destroyed > 0) {
+      st_logInfo("Destroyed %" PRIi64 " megablocks with a total of %" PRIi64 " supporting homologies\n",
+                 num_megablocks_destroyed, num_homologies_destroyed);
+    }
+    free(possibleSupportingHomologies);
+    stList_destruct(blocks);
+}
+
+/*
+ * Parses the alignments file once into a binary pinch cache, held in a temp file that is added to tempFiles,
+ * and returns an iterator over the cache. This avoids reparsing the alignments in every annealing round.
+ * If sequenceHeaderToCapHash is non-null the alignments are in input coordinates and are converted as they are read.
+ */
+static stPinchIterator *getCachedPinchIterator(const char *alignmentsFile, stHash *sequenceHeaderToCapHash,
+                                               stList *tempFiles) {
+    char *pinchCacheFile = getTempFile();
+    stList_append(tempFiles, pinchCacheFile);
+    stPinchCacheWriter *writer = stPinchCacheWriter_construct(pinchCacheFile);
+    stPinchCacheWriter_addAlignmentsFile(writer, alignmentsFile, sequenceHeaderToCapHash);
+    stPinchCacheWriter_destruct(writer);
+    return stPinchIterator_constructFromPinchCache(pinchCacheFile);
+}
 
-    fprintf(f, "There were %" PRIu64 " blocks in the sequence graph, representing %" PRIi64
-    " total aligned bases\n", numBlocks, totalAlignedBases);
-
-    qsort(blockDegrees, numBlocks, sizeof(uint64_t),
-          (int (*)(const void *, const void *)) uint64_cmp);
-    qsort(blockSupports, numBlocks, sizeof(double),
-          (int (*)(const void *, const void *)) double_cmp);
-    fprintf(f, "Block degree stats: min %" PRIu64 ", avg %lf, median %" PRIu64 ", max %" PRIu64 "\n",
-            blockDegrees[0], totalDegree/numBlocks, blockDegrees[(numBlocks - 1) / 2],
-            blockDegrees[numBlocks - 1]);
-    fprintf(f, "Block support stats: min %lf, avg %lf, median %lf, max %lf\n",
-           blockSupports[0], totalSupport/numBlocks, blockSupports[(numBlocks - 1) / 2],
-           blockSupports[numBlocks - 1]);
-    free(blockDegrees);
-    free(blockSupports);
+/*
+ * As getCachedPinchIterator, but with the alignments sorted by descending score.
+ */
+static stPinchIterator *getSortedCachedPinchIterator(const char *alignmentsFile, stHash *sequenceHeaderToCapHash,
+                                                     stList *tempFiles) {
+    char *pinchCacheFile = getTempFile();
+    stList_append(tempFiles, pinchCacheFile);
+    stCaf_sortAlignmentsByScoreInDescendingOrder(alignmentsFile, pinchCacheFile, sequenceHeaderToCapHash);
+    return stPinchIterator_constructFromPinchCache(pinchCacheFile);
 }
 
 void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secondaryAlignmentsFile, char *constraintsFile,
-         Event *referenceEvent) {
+         Event *referenceEvent, stHash *sequenceHeaderToCapHash) {
     //////////////////////////////////////////////
     //Parse the many, many necessary parameters from the params file
     //////////////////////////////////////////////
@@ -148,6 +122,7 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
     // These are all variables used by the filter fns
     FilterArgs *fa = st_malloc(sizeof(FilterArgs));
     fa->flower = flower;
+    fa->eventTable = NULL;
     fa->minimumIngroupDegree = cactusParams_get_int(params, 2, "caf", "minimumIngroupDegree");
     fa->minimumOutgroupDegree = cactusParams_get_int(params, 2, "caf", "minimumOutgroupDegree");
     fa->minimumDegree = cactusParams_get_int(params, 2, "caf", "minimumBlockDegree");
@@ -227,8 +202,8 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
     // Setting the alignment filters
     char *alignmentFilter = (char *)cactusParams_get_string(params, 2, "caf", "alignmentFilter");
     bool sortAlignments = false;
-    bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *) = NULL;
-    bool (*secondaryFilterFn)(stPinchSegment *, stPinchSegment *, Flower *) = NULL;
+    bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *) = NULL;
+    bool (*secondaryFilterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *) = NULL;
     char * singleCopyEventName = NULL;
     bool sortSecondaryAlignments = false;
     char *hgvmEventName = NULL;
@@ -314,9 +289,10 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
     // Get the constraints
     ///////////////////////////////////////////////////////////////////////////
 
+    stList *tempFiles = stList_construct3(0, free);
     stPinchIterator *pinchIteratorForConstraints = NULL;
     if (constraintsFile != NULL) {
-        pinchIteratorForConstraints = stPinchIterator_constructFromFile(constraintsFile);
+        pinchIteratorForConstraints = getCachedPinchIterator(constraintsFile, sequenceHeaderToCapHash, tempFiles);
         st_logDebug("Created an iterator for the alignment constraints from file: %s\n", constraintsFile);
     }
 
@@ -324,15 +300,15 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
     // Do the alignment
     ///////////////////////////////////////////////////////////////////////////
 
-    char *tempFile1 = NULL;
-    char *tempFile2 = NULL;
-
     if (!flower_builtBlocks(flower)) { // Do nothing if the flower already has defined blocks
         st_logDebug("Processing flower: %lli\n", flower_getName(flower));
 
         //Set up the graph and add the initial alignments
         stPinchThreadSet *threadSet = stCaf_setup(flower);
 
+        //Build the table of thread events used by the filters
+        fa->eventTable = stCaf_constructEventTable(flower, threadSet);
+
         //Build the set of outgroup threads
         stSet *outgroupThreads = stCaf_getOutgroupThreads(flower, threadSet);
 
@@ -352,20 +328,17 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
         assert(alignmentsFile != NULL);
 
         if (sortAlignments) {
-            tempFile1 = getTempFile();
-            //stCaf_sortCigarsFileByScoreInDescendingOrder(alignmentsFile, tempFile1);
-            pinchIterator = stPinchIterator_constructFromFile(tempFile1);
+            pinchIterator = getSortedCachedPinchIterator(alignmentsFile, sequenceHeaderToCapHash, tempFiles);
         } else {
-            pinchIterator = stPinchIterator_constructFromFile(alignmentsFile);
+            pinchIterator = getCachedPinchIterator(alignmentsFile, sequenceHeaderToCapHash, tempFiles);
         }
 
         if(secondaryAlignmentsFile != NULL) {
             if (sortSecondaryAlignments) {
-                tempFile2 = getTempFile();
-                //stCaf_sortCigarsFileByScoreInDescendingOrder(secondaryAlignmentsFile, tempFile2);
-                secondaryPinchIterator = stPinchIterator_constructFromFile(tempFile2);
+                secondaryPinchIterator = getSortedCachedPinchIterator(secondaryAlignmentsFile, sequenceHeaderToCapHash,
+                                                                      tempFiles);
             } else {
-                secondaryPinchIterator = stPinchIterator_constructFromFile(secondaryAlignmentsFile);
+                secondaryPinchIterator = getCachedPinchIterator(secondaryAlignmentsFile, sequenceHeaderToCapHash, tempFiles);
             }
         }
 
@@ -379,29 +352,35 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
                 stPinchIterator_setTrim(secondaryPinchIterator, alignmentTrim);
             }
 
+            cactusStats_startStage("annealing", annealingRound);
+
             //Add back in the constraints
             if (pinchIteratorForConstraints != NULL) {
-                stCaf_anneal(threadSet, pinchIteratorForConstraints, NULL, flower);
+                stCaf_anneal(threadSet, pinchIteratorForConstraints, NULL, NULL);
             }
 
             //Do the annealing
             if (annealingRound == 0) {
-                stCaf_anneal(threadSet, pinchIterator, filterFn, flower);
+                stCaf_anneal(threadSet, pinchIterator, filterFn, fa);
             } else {
-                stCaf_annealBetweenAdjacencyComponents(threadSet, pinchIterator, filterFn, flower);
+                stCaf_annealBetweenAdjacencyComponents(threadSet, pinchIterator, filterFn, fa);
             }
 
             // Do the secondary annealing
             if(secondaryPinchIterator != NULL) {
                 if (annealingRound == 0) {
-                    stCaf_anneal(threadSet, secondaryPinchIterator, secondaryFilterFn, flower);
+                    stCaf_anneal(threadSet, secondaryPinchIterator, secondaryFilterFn, fa);
                 } else {
-                    stCaf_annealBetweenAdjacencyComponents(threadSet, secondaryPinchIterator, secondaryFilterFn, flower);
+                    stCaf_annealBetweenAdjacencyComponents(threadSet, secondaryPinchIterator, secondaryFilterFn, fa);
                 }
             }
 
+            cactusStats_endStage();
+
             st_logInfo("Sequence graph statistics after annealing:\n");
-            printThreadSetStatistics(threadSet, flower, stderr);
+            printThreadSetStatistics(threadSet, flower, "annealing", annealingRound, stderr);
+
+            cactusStats_startStage("melting", annealingRound);
 
             if (minimumBlockHomologySupport > 0) {
                 // Check for poorly-supported blocks--those that have
@@ -410,44 +389,33 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
                 // alignment. These "megablocks" can snarl up the
                 // graph so that a lot of extra gets thrown away in
                 // the first melting step.
-                stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
-                stPinchBlock *block;
-                int64_t num_megablocks_destroyed = 0;
-                int64_t num_homologies_destroyed = 0;
-                while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
-                    if (minimumBlockDegreeToCheckSupport > 0 && stPinchBlock_getDegree(block) > minimumBlockDegreeToCheckSupport) {
-                        uint64_t supportingHomologies = stPinchBlock_getNumSupportingHomologies(block);
-                        uint64_t possibleSupportingHomologies = numPossibleSupportingHomologies(block, flower);
-                        double support = ((double) supportingHomologies) / possibleSupportingHomologies;
-                        if (support < minimumBlockHomologySupport) {
-                            st_logDebug("Destroyed a megablock with degree %" PRIi64
-                            " and %" PRIi64 " supporting homologies out of a maximum "
-                                            "of %" PRIi64 " (%lf%%).\n", stPinchBlock_getDegree(block),
-                                    supportingHomologies, possibleSupportingHomologies, support);
-                            stPinchBlock_destruct(block);
-                            ++num_megablocks_destroyed;
-                            num_homologies_destroyed += supportingHomologies;
-                        }
-                    }
-                }
-                if (num_megablocks_destroyed > 0) {
-                  st_logInfo("Destroyed %" PRIi64 " megablocks with a total of %" PRIi64 " supporting homologies\n",
-                             num_megablocks_destroyed, num_homologies_destroyed);
-                }
+                destroyMegablocks(threadSet, flower, fa->eventTable, minimumBlockDegreeToCheckSupport, minimumBlockHomologySupport);
             }
 
-            //Do the melting rounds
+            //Do the melting rounds, sharing one chain decomposition between them
+            stCafChainIndex *chainIndex = NULL;
             for (int64_t meltingRound = 0; meltingRound < meltingRoundsLength; meltingRound++) {
                 int64_t minimumChainLengthForMeltingRound = meltingRounds[meltingRound];
                 st_logInfo("Starting melting round with a minimum chain length of %" PRIi64 " \n", minimumChainLengthForMeltingRound);
                 if (minimumChainLengthForMeltingRound >= minimumChainLength) {
                     break;
                 }
-                stCaf_melt(flower, threadSet, NULL, NULL, 0, minimumChainLengthForMeltingRound, 0, INT64_MAX);
-            } st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
+                if (minimumChainLengthForMeltingRound > 1) {
+                    if (chainIndex == NULL) {
+                        chainIndex = stCaf_constructChainIndex(flower, threadSet);
+                    }
+                    stCaf_meltChainsLessThanGivenLength(chainIndex, minimumChainLengthForMeltingRound);
+                }
+            }
+            if (chainIndex != NULL) {
+                stCaf_destructChainIndex(chainIndex);
+            }
+            st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
             stCaf_melt(flower, threadSet, NULL, NULL, 0, minimumChainLength, breakChainsAtReverseTandems, maximumMedianSequenceLengthBetweenLinkedEnds);
             //This does the filtering of blocks that do not have the required species/tree-coverage/degree.
             stCaf_melt(flower, threadSet, blockFilterFn, fa, blockTrim, 0, 0, INT64_MAX);
+
+            cactusStats_endStage();
         }
 
         if (removeRecoverableChains) {
@@ -455,7 +423,7 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
         }
 
         st_logInfo("Sequence graph statistics after melting:\n");
-        printThreadSetStatistics(threadSet, flower, stderr);
+        printThreadSetStatistics(threadSet, flower, "melting", annealingRoundsLength, stderr);
 
         //Sort out case when we allow blocks of degree 1
         if (fa->minimumDegree < 2) {
@@ -472,6 +440,8 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
         st_logDebug("Ran the cactus core script\n");
 
         //Cleanup
+        stCaf_destructEventTable(fa->eventTable);
+        fa->eventTable = NULL;
         stPinchThreadSet_destruct(threadSet);
         stPinchIterator_destruct(pinchIterator);
         if(secondaryPinchIterator != NULL) {
@@ -497,10 +467,8 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
         stPinchIterator_destruct(pinchIteratorForConstraints);
     }
 
-    if (tempFile1 != NULL) {
-        st_system("rm %s", tempFile1);
-    }
-    if (tempFile2 != NULL) {
-        st_system("rm %s", tempFile2);
+    for (int64_t i = 0; i < stList_length(tempFiles); i++) {
+        st_system("rm %s", stList_get(tempFiles, i));
     }
+    stList_destruct(tempFiles);
 }
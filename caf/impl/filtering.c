@@ -3,6 +3,105 @@
 #include "commonC.h"
 #include "stCaf.h"
 
+/*
+ * Table of the event of each thread of the pinch graph, built once by caf so that the filters look up the event
+ * of a segment at array cost rather than by binary searching the caps of the flower. It is an open addressing
+ * hash table keyed by thread name. Each event is also given a dense index, so sets of events can be bit sets.
+ * Once built it is only read, so it can be shared by threads.
+ */
+
+typedef struct _threadEvent {
+    Name threadName;
+    Event *event;
+    int64_t eventIndex;
+    bool isOutgroup;
+} ThreadEvent;
+
+struct _stCafEventTable {
+    ThreadEvent *threadEvents;
+    uint64_t mask;
+    int64_t eventNumber;
+};
+
+static inline uint64_t hashThreadName(Name threadName) {
+    uint64_t h = ((uint64_t) threadName) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 32);
+}
+
+stCafEventTable *stCaf_constructEventTable(Flower *flower, stPinchThreadSet *threadSet) {
+    stCafEventTable *eventTable = st_malloc(sizeof(stCafEventTable));
+
+    // Give each event a dense index
+    stHash *eventIndices = stHash_construct2(NULL, free);
+    EventTree_Iterator *eventIt = eventTree_getIterator(flower_getEventTree(flower));
+    Event *event;
+    eventTable->eventNumber = 0;
+    while ((event = eventTree_getNext(eventIt)) != NULL) {
+        int64_t *eventIndex = st_malloc(sizeof(int64_t));
+        *eventIndex = eventTable->eventNumber++;
+        stHash_insert(eventIndices, event, eventIndex);
+    }
+    eventTree_destructIterator(eventIt);
+
+    // Size the table to be at most half full
+    uint64_t tableSize = 1;
+    while (tableSize < 2 * stPinchThreadSet_getSize(threadSet)) {
+        tableSize *= 2;
+    }
+    eventTable->threadEvents = st_malloc(tableSize * sizeof(ThreadEvent));
+    for (uint64_t i = 0; i < tableSize; i++) {
+        eventTable->threadEvents[i].threadName = NULL_NAME;
+    }
+    eventTable->mask = tableSize - 1;
+
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        Name threadName = stPinchThread_getName(thread);
+        uint64_t i = hashThreadName(threadName) & eventTable->mask;
+        while (eventTable->threadEvents[i].threadName != NULL_NAME) {
+            i = (i + 1) & eventTable->mask;
+        }
+        event = cap_getEvent(flower_getCap(flower, threadName));
+        assert(event != NULL);
+        ThreadEvent *threadEvent = &eventTable->threadEvents[i];
+        threadEvent->threadName = threadName;
+        threadEvent->event = event;
+        threadEvent->eventIndex = *(int64_t *)stHash_search(eventIndices, event);
+        threadEvent->isOutgroup = event_isOutgroup(event);
+    }
+    stHash_destruct(eventIndices);
+    return eventTable;
+}
+
+void stCaf_destructEventTable(stCafEventTable *eventTable) {
+    free(eventTable->threadEvents);
+    free(eventTable);
+}
+
+/*
+ * Returns the entry in the event table for the segment's thread.
+ */
+static inline ThreadEvent *getThreadEvent(stPinchSegment *segment, stCafEventTable *eventTable) {
+    Name threadName = stPinchSegment_getName(segment);
+    uint64_t i = hashThreadName(threadName) & eventTable->mask;
+    while (eventTable->threadEvents[i].threadName != threadName) {
+        if (eventTable->threadEvents[i].threadName == NULL_NAME) {
+            st_errAbort("Thread %" PRIi64 " is missing from the CAF event table", threadName);
+        }
+        i = (i + 1) & eventTable->mask;
+    }
+    return &eventTable->threadEvents[i];
+}
+
+Event *stCafEventTable_getEvent(stCafEventTable *eventTable, stPinchSegment *segment) {
+    return getThreadEvent(segment, eventTable)->event;
+}
+
+bool stCafEventTable_isOutgroup(stCafEventTable *eventTable, stPinchSegment *segment) {
+    return getThreadEvent(segment, eventTable)->isOutgroup;
+}
+
 /*
  * Functions used for prefiltering the alignments.
  */
@@ -13,15 +112,84 @@ Event *stCaf_getEvent(stPinchSegment *segment, Flower *flower) {
     return event;
 }
 
+bool stCaf_isOutgroup(stPinchSegment *segment, Flower *flower) {
+    return event_isOutgroup(stCaf_getEvent(segment, flower));
+}
+
+/*
+ * The event of a segment, from the event table if there is one, else from the caps of the flower.
+ */
+static Event *getEvent(stPinchSegment *segment, Flower *flower, stCafEventTable *eventTable) {
+    return eventTable != NULL ? stCafEventTable_getEvent(eventTable, segment) : stCaf_getEvent(segment, flower);
+}
+
+static bool isOutgroup(stPinchSegment *segment, Flower *flower, stCafEventTable *eventTable) {
+    return eventTable != NULL ? stCafEventTable_isOutgroup(eventTable, segment) : stCaf_isOutgroup(segment, flower);
+}
+
+/*
+ * Bit sets of the events of the segments of a block, using the dense event indices of the event table.
+ */
+
+#define EVENT_BITS_WORDS(eventTable) ((eventTable)->eventNumber / 64 + 1)
+
+static void addEventBits(stPinchSegment *segment, stCafEventTable *eventTable, uint64_t *eventBits, bool ingroupOnly) {
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block != NULL) {
+        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+            ThreadEvent *threadEvent = getThreadEvent(segment, eventTable);
+            if (!ingroupOnly || !threadEvent->isOutgroup) {
+                eventBits[threadEvent->eventIndex / 64] |= ((uint64_t) 1) << (threadEvent->eventIndex % 64);
+            }
+        }
+    } else {
+        ThreadEvent *threadEvent = getThreadEvent(segment, eventTable);
+        if (!ingroupOnly || !threadEvent->isOutgroup) {
+            eventBits[threadEvent->eventIndex / 64] |= ((uint64_t) 1) << (threadEvent->eventIndex % 64);
+        }
+    }
+}
+
+static bool intersectsEventBits(stPinchSegment *segment, stCafEventTable *eventTable, uint64_t *eventBits,
+                                bool ingroupOnly) {
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block != NULL) {
+        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+            ThreadEvent *threadEvent = getThreadEvent(segment, eventTable);
+            if ((!ingroupOnly || !threadEvent->isOutgroup) &&
+                (eventBits[threadEvent->eventIndex / 64] & (((uint64_t) 1) << (threadEvent->eventIndex % 64)))) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    ThreadEvent *threadEvent = getThreadEvent(segment, eventTable);
+    return (!ingroupOnly || !threadEvent->isOutgroup) &&
+           (eventBits[threadEvent->eventIndex / 64] & (((uint64_t) 1) << (threadEvent->eventIndex % 64)));
+}
+
+/*
+ * Returns non-zero if the blocks (or lone segments) of the two segments share an event.
+ */
+static bool sharesEvent(stPinchSegment *segment1, stPinchSegment *segment2, stCafEventTable *eventTable,
+                        bool ingroupOnly) {
+    uint64_t eventBits[EVENT_BITS_WORDS(eventTable)];
+    memset(eventBits, 0, sizeof(eventBits));
+    addEventBits(segment1, eventTable, eventBits, ingroupOnly);
+    return intersectsEventBits(segment2, eventTable, eventBits, ingroupOnly);
+}
+
 /*
  * Filtering by presence of outgroup. This code is efficient and scales linearly with depth.
  */
 
-static bool containsOutgroupSegment(stPinchBlock *block, Flower *flower) {
+static bool containsOutgroupSegment(stPinchBlock *block, Flower *flower, stCafEventTable *eventTable) {
     stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
     stPinchSegment *segment;
     while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-        if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
+        if (isOutgroup(segment, flower, eventTable)) {
             stPinchSegment_putSegmentFirstInBlock(segment);
             assert(stPinchBlock_getFirst(block) == segment);
             return 1;
@@ -30,47 +198,47 @@ static bool containsOutgroupSegment(stPinchBlock *block, Flower *flower) {
     return 0;
 }
 
-static bool isOutgroupSegment(stPinchSegment *segment, Flower *flower) {
-    if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
-        return 1;
-    } else {
-        return 0;
-    }
-}
-
 bool stCaf_filterByOutgroup(stPinchSegment *segment1,
-                            stPinchSegment *segment2, Flower *flower) {
+                            stPinchSegment *segment2, FilterArgs *filterArgs) {
+    Flower *flower = filterArgs->flower;
+    stCafEventTable *eventTable = filterArgs->eventTable;
     stPinchBlock *block1, *block2;
     if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
         if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
             if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, flower);
+                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, flower, eventTable);
             }
             if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-                return containsOutgroupSegment(block1, flower) && containsOutgroupSegment(block2, flower);
+                return containsOutgroupSegment(block1, flower, eventTable) &&
+                       containsOutgroupSegment(block2, flower, eventTable);
             }
-            return containsOutgroupSegment(block2, flower) && containsOutgroupSegment(block1, flower);
+            return containsOutgroupSegment(block2, flower, eventTable) &&
+                   containsOutgroupSegment(block1, flower, eventTable);
         }
-        return isOutgroupSegment(segment2, flower) && containsOutgroupSegment(block1, flower);
+        return isOutgroup(segment2, flower, eventTable) && containsOutgroupSegment(block1, flower, eventTable);
     }
     if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
-        return isOutgroupSegment(segment1, flower) && containsOutgroupSegment(block2, flower);
+        return isOutgroup(segment1, flower, eventTable) && containsOutgroupSegment(block2, flower, eventTable);
     }
-    return isOutgroupSegment(segment1, flower) && isOutgroupSegment(segment2, flower);
+    return isOutgroup(segment1, flower, eventTable) && isOutgroup(segment2, flower, eventTable);
 }
 
 bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
-                                   stPinchSegment *segment2, Flower *flower) {
+                                   stPinchSegment *segment2, FilterArgs *filterArgs) {
+    Flower *flower = filterArgs->flower;
+    stCafEventTable *eventTable = filterArgs->eventTable;
     stPinchBlock *block1, *block2;
     if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
         if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
             if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, flower);
+                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, flower, eventTable);
             }
             if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-                return containsOutgroupSegment(block1, flower) && containsOutgroupSegment(block2, flower);
+                return containsOutgroupSegment(block1, flower, eventTable) &&
+                       containsOutgroupSegment(block2, flower, eventTable);
             }
-            return containsOutgroupSegment(block2, flower) && containsOutgroupSegment(block1, flower);
+            return containsOutgroupSegment(block2, flower, eventTable) &&
+                   containsOutgroupSegment(block1, flower, eventTable);
         }
     }
     // If we get here, we are just adding a segment to a block, not
@@ -91,21 +259,21 @@ static bool checkIntersection(stSortedSet *names1, stSortedSet *names2) {
     return b;
 }
 
-static stSortedSet *getEvents(stPinchSegment *segment, Flower *flower) {
+static stSortedSet *getEvents(stPinchSegment *segment, Flower *flower, stCafEventTable *eventTable) {
     stSortedSet *events = stSortedSet_construct();
     if (stPinchSegment_getBlock(segment) != NULL) {
         stPinchBlock *block = stPinchSegment_getBlock(segment);
         stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
         while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            stSortedSet_insert(events, stCaf_getEvent(segment, flower));
+            stSortedSet_insert(events, getEvent(segment, flower, eventTable));
         }
     } else {
-        stSortedSet_insert(events, stCaf_getEvent(segment, flower));
+        stSortedSet_insert(events, getEvent(segment, flower, eventTable));
     }
     return events;
 }
 
-static bool containsMoreThanOneEvent(stPinchSegment *segment, Flower *flower) {
+static bool containsMoreThanOneEvent(stPinchSegment *segment, Flower *flower, stCafEventTable *eventTable) {
     if(stPinchSegment_getBlock(segment) == NULL) {
         return false;
     }
@@ -119,10 +287,10 @@ static bool containsMoreThanOneEvent(stPinchSegment *segment, Flower *flower) {
         // from blocks during the annealing phase
         return true;
     }
-    Event *event = stCaf_getEvent(segment, flower);
+    Event *event = getEvent(segment, flower, eventTable);
     stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
     while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-        if (stCaf_getEvent(segment, flower) != event) {
+        if (getEvent(segment, flower, eventTable) != event) {
             stPinchBlock_setFilterFlag(block, true);
             return true;
         }
@@ -131,23 +299,27 @@ static bool containsMoreThanOneEvent(stPinchSegment *segment, Flower *flower) {
 }
 
 bool stCaf_filterByMultipleSequences(stPinchSegment *segment1,
-                                     stPinchSegment *segment2, Flower *flower) {
+                                     stPinchSegment *segment2, FilterArgs *filterArgs) {
     // Only reject the alignment if both segments already have blocks
     return stPinchSegment_getBlock(segment1) != NULL && stPinchSegment_getBlock(segment2) != NULL;
 }
 
 bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1,
-                                   stPinchSegment *segment2, Flower *flower) {
+                                   stPinchSegment *segment2, FilterArgs *filterArgs) {
+    Flower *flower = filterArgs->flower;
+    stCafEventTable *eventTable = filterArgs->eventTable;
     stPinchBlock *block1, *block2;
     if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
         if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
             if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsMoreThanOneEvent(segment1, flower);
+                return stPinchBlock_getLength(block1) == 1 ? 0 : containsMoreThanOneEvent(segment1, flower, eventTable);
             }
             if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-                return containsMoreThanOneEvent(segment1, flower) && containsMoreThanOneEvent(segment2, flower);
+                return containsMoreThanOneEvent(segment1, flower, eventTable) &&
+                       containsMoreThanOneEvent(segment2, flower, eventTable);
             }
-            return containsMoreThanOneEvent(segment2, flower) && containsMoreThanOneEvent(segment1, flower);
+            return containsMoreThanOneEvent(segment2, flower, eventTable) &&
+                   containsMoreThanOneEvent(segment1, flower, eventTable);
         }
     }
     // If we get here, we are just adding a segment to a block, not
@@ -155,16 +327,24 @@ bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1,
     return false;
 }
 
+static bool containsRepeatSpecies(stPinchSegment *segment1, stPinchSegment *segment2, FilterArgs *filterArgs) {
+    if (filterArgs->eventTable != NULL) {
+        return sharesEvent(segment1, segment2, filterArgs->eventTable, 0);
+    }
+    return checkIntersection(getEvents(segment1, filterArgs->flower, NULL),
+                             getEvents(segment2, filterArgs->flower, NULL));
+}
+
 bool stCaf_filterByRepeatSpecies(stPinchSegment *segment1,
-                                 stPinchSegment *segment2, Flower *flower) {
-    return checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
+                                 stPinchSegment *segment2, FilterArgs *filterArgs) {
+    return containsRepeatSpecies(segment1, segment2, filterArgs);
 }
 
 bool stCaf_relaxedFilterByRepeatSpecies(stPinchSegment *segment1,
-                                        stPinchSegment *segment2, Flower *flower) {
+                                        stPinchSegment *segment2, FilterArgs *filterArgs) {
     return stPinchSegment_getBlock(segment1) != NULL
         && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
+        && containsRepeatSpecies(segment1, segment2, filterArgs);
 }
 
 static Event* singleCopyEvent = NULL;
@@ -178,19 +358,25 @@ void stCaf_setSingleCopyEvent(Flower* flower, char *singleCopyEventName) {
     }
 }
 
-bool stCaf_filterBySingleCopyEvent(stPinchSegment *segment1,
-                                   stPinchSegment *segment2, Flower *flower) {
-    bool b = false;
-    if (singleCopyEvent != NULL) {
-        stSortedSet *names1 = getEvents(segment1, flower);
-        if (stSortedSet_search(names1, singleCopyEvent) != NULL) {
-            stSortedSet *names2 = getEvents(segment2, flower);
-            b = stSortedSet_search(names2, singleCopyEvent) != NULL;
-            stSortedSet_destruct(names2);
+static bool containsEvent(stPinchSegment *segment, Event *event, Flower *flower, stCafEventTable *eventTable) {
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block != NULL) {
+        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+            if (getEvent(segment, flower, eventTable) == event) {
+                return 1;
+            }
         }
-        stSortedSet_destruct(names1);
+        return 0;
     }
-    return b;
+    return getEvent(segment, flower, eventTable) == event;
+}
+
+bool stCaf_filterBySingleCopyEvent(stPinchSegment *segment1,
+                                   stPinchSegment *segment2, FilterArgs *filterArgs) {
+    return singleCopyEvent != NULL &&
+           containsEvent(segment1, singleCopyEvent, filterArgs->flower, filterArgs->eventTable) &&
+           containsEvent(segment2, singleCopyEvent, filterArgs->flower, filterArgs->eventTable);
 }
 
 static stSortedSet *getChrNames(stPinchSegment *segment, Flower *flower) {
@@ -212,23 +398,23 @@ static stSortedSet *getChrNames(stPinchSegment *segment, Flower *flower) {
 }
 
 bool stCaf_singleCopyChr(stPinchSegment *segment1,
-                         stPinchSegment *segment2, Flower *flower) {
-    return checkIntersection(getChrNames(segment1, flower), getChrNames(segment2, flower));
+                         stPinchSegment *segment2, FilterArgs *filterArgs) {
+    return checkIntersection(getChrNames(segment1, filterArgs->flower), getChrNames(segment2, filterArgs->flower));
 }
 
-static stSortedSet *getIngroupEvents(stPinchSegment *segment, Flower *flower) {
+static stSortedSet *getIngroupEvents(stPinchSegment *segment, Flower *flower, stCafEventTable *eventTable) {
     stSortedSet *events = stSortedSet_construct();
     if (stPinchSegment_getBlock(segment) != NULL) {
         stPinchBlock *block = stPinchSegment_getBlock(segment);
         stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
         while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            Event *event = stCaf_getEvent(segment, flower);
+            Event *event = getEvent(segment, flower, eventTable);
             if (!event_isOutgroup(event)) {
                 stSortedSet_insert(events, event);
             }
         }
     } else {
-        Event *event = stCaf_getEvent(segment, flower);
+        Event *event = getEvent(segment, flower, eventTable);
         if (!event_isOutgroup(event)) {
             stSortedSet_insert(events, event);
         }
@@ -236,16 +422,24 @@ static stSortedSet *getIngroupEvents(stPinchSegment *segment, Flower *flower) {
     return events;
 }
 
+static bool containsRepeatIngroupSpecies(stPinchSegment *segment1, stPinchSegment *segment2, FilterArgs *filterArgs) {
+    if (filterArgs->eventTable != NULL) {
+        return sharesEvent(segment1, segment2, filterArgs->eventTable, 1);
+    }
+    return checkIntersection(getIngroupEvents(segment1, filterArgs->flower, NULL),
+                             getIngroupEvents(segment2, filterArgs->flower, NULL));
+}
+
 bool stCaf_singleCopyIngroup(stPinchSegment *segment1,
-                             stPinchSegment *segment2, Flower *flower) {
-    return checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+                             stPinchSegment *segment2, FilterArgs *filterArgs) {
+    return containsRepeatIngroupSpecies(segment1, segment2, filterArgs);
 }
 
 bool stCaf_relaxedSingleCopyIngroup(stPinchSegment *segment1,
-                                    stPinchSegment *segment2, Flower *flower) {
+                                    stPinchSegment *segment2, FilterArgs *filterArgs) {
     return stPinchSegment_getBlock(segment1) != NULL
         && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+        && containsRepeatIngroupSpecies(segment1, segment2, filterArgs);
 }
 
 /*
@@ -321,7 +515,7 @@ static bool containsSpecialThread(stPinchSegment *segment) {
 }
 
 bool stCaf_filterToEnsureCycleFreeIsolatedComponents(stPinchSegment *segment1,
-                                                     stPinchSegment *segment2, Flower *flower) {
+                                                     stPinchSegment *segment2, FilterArgs *filterArgs) {
     void *component1 = stUnionFind_find(threadToComponent, stPinchSegment_getThread(segment1));
     void *component2 = stUnionFind_find(threadToComponent, stPinchSegment_getThread(segment2));
 
@@ -365,8 +559,7 @@ bool stCaf_chainHasUnequalNumberOfIngroupCopies(stCactusEdgeEnd *chainEnd,
     stPinchSegment *segment;
     stHash *ingroupToNumCopies = stHash_construct2(NULL, free);
     while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-        Cap *cap = flower_getCap(flower, stPinchSegment_getName(segment));
-        Event *event = cap_getEvent(cap);
+        Event *event = stCaf_getEvent(segment, flower);
         if (!event_isOutgroup(event)) {
             if (stHash_search(ingroupToNumCopies, event) == NULL) {
                 stHash_insert(ingroupToNumCopies, event, calloc(1, sizeof(uint64_t)));
@@ -421,9 +614,7 @@ bool stCaf_chainHasUnequalNumberOfIngroupCopiesOrNoOutgroup(stCactusEdgeEnd *cha
     stPinchBlockIt it = stPinchBlock_getSegmentIterator(end->block);
     stPinchSegment *segment;
     while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-        Cap *cap = flower_getCap(flower, stPinchSegment_getName(segment));
-        Event *event = cap_getEvent(cap);
-        if (event_isOutgroup(event)) {
+        if (stCaf_isOutgroup(segment, flower)) {
             numOutgroupCopies++;
         }
     }
@@ -435,16 +626,40 @@ bool stCaf_chainHasUnequalNumberOfIngroupCopiesOrNoOutgroup(stCactusEdgeEnd *cha
 
 bool stCaf_containsRequiredSpecies(stPinchBlock *pinchBlock,
                                    Flower *flower,
+                                   stCafEventTable *eventTable,
                                    int64_t minimumIngroupDegree,
                                    int64_t minimumOutgroupDegree,
                                    int64_t minimumDegree,
                                    int64_t minimumNumberOfSpecies) {
+    stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
+    stPinchSegment *segment;
+    if (eventTable != NULL) {
+        // Count the species with a bit set of the events
+        uint64_t eventBits[EVENT_BITS_WORDS(eventTable)];
+        memset(eventBits, 0, sizeof(eventBits));
+        int64_t numberOfSpecies = 0, outgroupSequences = 0, ingroupSequences = 0;
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            ThreadEvent *threadEvent = getThreadEvent(segment, eventTable);
+            uint64_t bit = ((uint64_t) 1) << (threadEvent->eventIndex % 64);
+            if (!(eventBits[threadEvent->eventIndex / 64] & bit)) {
+                eventBits[threadEvent->eventIndex / 64] |= bit;
+                numberOfSpecies++;
+            }
+            if (threadEvent->isOutgroup) {
+                outgroupSequences++;
+            } else {
+                ingroupSequences++;
+            }
+        }
+        return ingroupSequences >= minimumIngroupDegree &&
+            outgroupSequences >= minimumOutgroupDegree &&
+            outgroupSequences + ingroupSequences >= minimumDegree &&
+            numberOfSpecies >= minimumNumberOfSpecies;
+    }
     stSet *seenEvents = stSet_construct();
     int64_t numberOfSpecies = 0;
     int64_t outgroupSequences = 0;
     int64_t ingroupSequences = 0;
-    stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
-    stPinchSegment *segment;
     while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
         Event *event = stCaf_getEvent(segment, flower);
         if (!stSet_search(seenEvents, event)) {
@@ -464,13 +679,13 @@ bool stCaf_containsRequiredSpecies(stPinchBlock *pinchBlock,
         numberOfSpecies >= minimumNumberOfSpecies;
 }
 
-bool stCaf_treeCoverage(stPinchBlock *pinchBlock, Flower *flower) {
+bool stCaf_treeCoverage(stPinchBlock *pinchBlock, Flower *flower, stCafEventTable *eventTable) {
     EventTree *eventTree = flower_getEventTree(flower);
     Event *commonAncestorEvent = NULL;
     stPinchSegment *segment;
     stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
     while ((segment = stPinchBlockIt_getNext(&segmentIt))) {
-        Event *event = stCaf_getEvent(segment, flower);
+        Event *event = getEvent(segment, flower, eventTable);
         commonAncestorEvent = commonAncestorEvent == NULL ? event : eventTree_getCommonAncestor(event, commonAncestorEvent);
     }
     assert(commonAncestorEvent != NULL);
@@ -479,7 +694,7 @@ bool stCaf_treeCoverage(stPinchBlock *pinchBlock, Flower *flower) {
 
     segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
     while ((segment = stPinchBlockIt_getNext(&segmentIt))) {
-        Event *event = stCaf_getEvent(segment, flower);
+        Event *event = getEvent(segment, flower, eventTable);
         while (event != commonAncestorEvent && stHash_search(hash, event) == NULL) {
             treeCoverage += event_getBranchLength(event);
             stHash_insert(hash, event, event);
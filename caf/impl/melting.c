@@ -144,6 +144,109 @@ void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(
     stCaf_joinTrivialBoundaries(threadSet);
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Incremental melting of chains over successive minimum chain lengths
+///////////////////////////////////////////////////////////////////////////
+
+/*
+ * Destroying every block of a chain contracts the chain to a single node of the cactus graph.
+ * Any two chains of a cactus share at most one node, so this contraction leaves the remaining
+ * chains, and their lengths, unchanged. The chain decomposition can therefore be computed once
+ * and the chains melted in order of increasing length, each threshold only touching the blocks
+ * it removes. Joining trivial boundaries is deferred to the destruction of the index, as it
+ * merges blocks and would invalidate the stored block pointers.
+ */
+
+typedef struct _meltingChain {
+    int64_t length;
+    int64_t firstBlock;
+    int64_t blockNumber;
+} MeltingChain;
+
+struct _stCafChainIndex {
+    stPinchThreadSet *threadSet;
+    MeltingChain *chains; // Sorted by ascending length
+    int64_t chainNumber;
+    int64_t nextChain; // Index of the shortest chain not yet melted
+    stList *blocks; // The non-thread-end blocks of each chain, stored contiguously
+};
+
+static int meltingChain_cmp(const void *a, const void *b) {
+    const MeltingChain *c1 = a, *c2 = b;
+    if (c1->length != c2->length) {
+        return c1->length < c2->length ? -1 : 1;
+    }
+    return c1->firstBlock < c2->firstBlock ? -1 : (c1->firstBlock > c2->firstBlock ? 1 : 0);
+}
+
+stCafChainIndex *stCaf_constructChainIndex(Flower *flower, stPinchThreadSet *threadSet) {
+    stCafChainIndex *chainIndex = st_malloc(sizeof(stCafChainIndex));
+    chainIndex->threadSet = threadSet;
+    chainIndex->blocks = stList_construct();
+    chainIndex->nextChain = 0;
+
+    stCactusNode *startCactusNode;
+    stList *deadEndComponent;
+    stCactusGraph *cactusGraph = stCaf_getCactusGraphForThreadSet(flower, threadSet, &startCactusNode, &deadEndComponent, 0, INT64_MAX,
+            0.0, 0, INT64_MAX);
+
+    stList *chains = stList_construct3(0, free);
+    stCactusGraphNodeIt *nodeIt = stCactusGraphNodeIterator_construct(cactusGraph);
+    stCactusNode *cactusNode;
+    while ((cactusNode = stCactusGraphNodeIterator_getNext(nodeIt)) != NULL) {
+        stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
+        stCactusEdgeEnd *cactusEdgeEnd;
+        while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt)) != NULL) {
+            if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) {
+                MeltingChain *chain = st_malloc(sizeof(MeltingChain));
+                chain->length = getChainLength(cactusEdgeEnd);
+                chain->firstBlock = stList_length(chainIndex->blocks);
+                addChainBlocksToBlocksToDelete(cactusEdgeEnd, chainIndex->blocks);
+                chain->blockNumber = stList_length(chainIndex->blocks) - chain->firstBlock;
+                stList_append(chains, chain);
+            }
+        }
+    }
+    stCactusGraphNodeIterator_destruct(nodeIt);
+    stCactusGraph_destruct(cactusGraph);
+
+    chainIndex->chainNumber = stList_length(chains);
+    chainIndex->chains = st_malloc(sizeof(MeltingChain) * (chainIndex->chainNumber > 0 ? chainIndex->chainNumber : 1));
+    for (int64_t i = 0; i < chainIndex->chainNumber; i++) {
+        chainIndex->chains[i] = *(MeltingChain *)stList_get(chains, i);
+    }
+    stList_destruct(chains);
+    qsort(chainIndex->chains, chainIndex->chainNumber, sizeof(MeltingChain), meltingChain_cmp);
+    return chainIndex;
+}
+
+void stCaf_meltChainsLessThanGivenLength(stCafChainIndex *chainIndex, int64_t minimumChainLength) {
+    stList *blocksToDelete = stList_construct3(0, (void(*)(void *)) stPinchBlock_destruct);
+    while (chainIndex->nextChain < chainIndex->chainNumber &&
+           chainIndex->chains[chainIndex->nextChain].length < minimumChainLength) {
+        MeltingChain *chain = &chainIndex->chains[chainIndex->nextChain++];
+        for (int64_t i = 0; i < chain->blockNumber; i++) {
+            stList_append(blocksToDelete, stList_get(chainIndex->blocks, chain->firstBlock + i));
+        }
+    }
+
+    st_logInfo("A melting round is destroying %" PRIi64 " blocks with an average degree "
+           "of %lf from chains with length less than %" PRIi64 ". Total aligned bases"
+           " lost: %" PRIu64 "\n",
+           stList_length(blocksToDelete), stCaf_averageBlockDegree(blocksToDelete),
+           minimumChainLength, stCaf_totalAlignedBases(blocksToDelete));
+
+    stList_destruct(blocksToDelete); //This will destroy the blocks
+}
+
+void stCaf_destructChainIndex(stCafChainIndex *chainIndex) {
+    //Now heal up the trivial boundaries left by the melted chains
+    stCaf_joinTrivialBoundaries(chainIndex->threadSet);
+    stList_destruct(chainIndex->blocks);
+    free(chainIndex->chains);
+    free(chainIndex);
+}
+
 static bool isTelomere(stPinchEnd *end, stSet *deadEndComponent) {
     stPinchSegment *segment = stPinchBlock_getFirst(end->block);
     bool atEndOfThread = stPinchThread_getFirst(stPinchSegment_getThread(segment)) == segment || stPinchThread_getLast(stPinchSegment_getThread(segment)) == segment;
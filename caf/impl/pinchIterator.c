@@ -6,6 +6,10 @@
  */
 
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sonLib.h"
 #include "stPinchGraphs.h"
 #include "stPinchIterator.h"
@@ -38,6 +42,79 @@ void stPinchIterator_destruct(stPinchIterator *pinchIterator) {
     free(pinchIterator);
 }
 
+/*
+ * Mapping of alignments in input coordinates to cactus coordinates.
+ */
+
+stHash *stPinchIterator_makeSequenceHeaderToCapHash(Flower *flower) {
+    stHash *sequenceHeaderToCapsHash = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, free, NULL);
+    Cap *cap;
+    Flower_CapIterator *capIt = flower_getCapIterator(flower);
+    while ((cap = flower_getNextCap(capIt)) != NULL) {
+        cap = cap_getStrand(cap) ? cap : cap_getReverse(cap);
+        assert(cap_getAdjacency(cap) != NULL);
+        if (!cap_getSide(cap)) {
+            Sequence *sequence = cap_getSequence(cap);
+            assert(sequence != NULL);
+            stList *sequenceHeaderTokens = stString_split(sequence_getHeader(sequence));
+            if (stList_length(sequenceHeaderTokens) == 0) {
+                st_errAbort("Sequence has absent header: %s", sequence_getHeader(sequence));
+            }
+            char *sequenceNameString = stString_copy(stList_get(sequenceHeaderTokens, 0));
+            stList_destruct(sequenceHeaderTokens);
+            if (stHash_search(sequenceHeaderToCapsHash, sequenceNameString) != NULL) {
+                st_errAbort("Could not make a unique map of fasta headers to sequence names: '%s'", sequenceNameString);
+            }
+            stHash_insert(sequenceHeaderToCapsHash, sequenceNameString, cap);
+        }
+    }
+    flower_destructCapIterator(capIt);
+    return sequenceHeaderToCapsHash;
+}
+
+/*
+ * Finds the caps of the two sequences of the alignment and shifts its coordinates into cactus coordinates,
+ * leaving the sequence names as they are. Checks the alignment is consistent and lies within the sequences.
+ */
+static void convertPafCoordinates(Paf *paf, stHash *sequenceHeaderToCapHash, Cap **cap1, Cap **cap2) {
+    *cap1 = stHash_search(sequenceHeaderToCapHash, paf->query_name);
+    *cap2 = stHash_search(sequenceHeaderToCapHash, paf->target_name);
+    if (*cap1 == NULL) {
+        st_errAbort("Could not match contig name in alignment to cactus cap: '%s'", paf->query_name);
+    }
+    if (*cap2 == NULL) {
+        st_errAbort("Could not match contig name in alignment to cactus cap: '%s'", paf->target_name);
+    }
+    //Now fix the coordinates by adding one
+    paf->query_start += 2;
+    paf->target_start += 2;
+    paf->query_end += 2;
+    paf->target_end += 2;
+    paf->query_length += 2;
+    paf->target_length += 2;
+    paf_check(paf);
+    if (paf->query_start <= cap_getCoordinate(*cap1) || paf->query_end > cap_getCoordinate(cap_getAdjacency(*cap1))) {
+        st_errAbort("Coordinates of pairwise alignment appear incorrect: %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 "",
+                    paf->query_start, paf->query_end,
+                    cap_getCoordinate(*cap1), cap_getCoordinate(cap_getAdjacency(*cap1)));
+    }
+    if (paf->target_start <= cap_getCoordinate(*cap2) || paf->target_end > cap_getCoordinate(cap_getAdjacency(*cap2))) {
+        st_errAbort("Coordinates of pairwise alignment appear incorrect: %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 "",
+                    paf->target_start, paf->target_end,
+                    cap_getCoordinate(*cap2), cap_getCoordinate(cap_getAdjacency(*cap2)));
+    }
+}
+
+void stPinchIterator_convertPafCoordinates(Paf *paf, stHash *sequenceHeaderToCapHash) {
+    Cap *cap1, *cap2;
+    convertPafCoordinates(paf, sequenceHeaderToCapHash, &cap1, &cap2);
+    //Fix the names
+    free(paf->query_name);
+    paf->query_name = cactusMisc_nameToString(cap_getName(cap1));
+    free(paf->target_name);
+    paf->target_name = cactusMisc_nameToString(cap_getName(cap2));
+}
+
 typedef struct _pairwiseAlignmentToPinch {
     void *alignmentArg;
     Paf *(*getPairwiseAlignment)(void *);
@@ -45,6 +122,8 @@ typedef struct _pairwiseAlignmentToPinch {
     int64_t xCoordinate, yCoordinate, xName, yName;
     Cigar *op;
     bool freeAlignments;
+    stHash *sequenceHeaderToCapHash; // If non-null, used to convert the alignments from input coordinates
+    bool destructSequenceHeaderToCapHash;
 } PairwiseAlignmentToPinch;
 
 static PairwiseAlignmentToPinch *pairwiseAlignmentToPinch_construct(void *alignmentArg,
@@ -63,11 +142,18 @@ static stPinch *pairwiseAlignmentToPinch_getNext(PairwiseAlignmentToPinch *pA, s
             if (pA->paf == NULL) {
                 return NULL;
             }
+            if (pA->sequenceHeaderToCapHash != NULL) {
+                Cap *cap1, *cap2;
+                convertPafCoordinates(pA->paf, pA->sequenceHeaderToCapHash, &cap1, &cap2);
+                pA->xName = cap_getName(cap1);
+                pA->yName = cap_getName(cap2);
+            } else {
+                pA->xName = cactusMisc_stringToName(pA->paf->query_name);
+                pA->yName = cactusMisc_stringToName(pA->paf->target_name);
+            }
             pA->op = pA->paf->cigar;
             pA->xCoordinate = pA->paf->same_strand ? pA->paf->query_start : pA->paf->query_end;
             pA->yCoordinate = pA->paf->target_start;
-            pA->xName = cactusMisc_stringToName(pA->paf->query_name);
-            pA->yName = cactusMisc_stringToName(pA->paf->target_name);
         }
         while (pA->op != NULL) {
             assert(pA->op->length >= 1);
@@ -124,6 +210,9 @@ static PairwiseAlignmentToPinch *pairwiseAlignmentToPinch_resetForFile(PairwiseA
 
 static void pairwiseAlignmentToPinch_destructForFile(PairwiseAlignmentToPinch *pA) {
     fclose(pA->alignmentArg);
+    if (pA->destructSequenceHeaderToCapHash) {
+        stHash_destruct(pA->sequenceHeaderToCapHash);
+    }
     free(pA);
 }
 
@@ -137,6 +226,236 @@ stPinchIterator *stPinchIterator_constructFromFile(const char *alignmentFile) {
     return pinchIterator;
 }
 
+/*
+ * Binary pinch cache, a memory mapped array of pinches.
+ */
+
+#define PINCH_CACHE_MAGIC "stPinchC"
+
+typedef struct _pinchCacheHeader {
+    char magic[8];
+    int64_t recordNumber;
+} PinchCacheHeader;
+
+typedef struct _pinchCache {
+    int fileDescriptor;
+    void *map;
+    size_t mapLength;
+    stPinchCacheRecord *records;
+    int64_t recordNumber;
+    int64_t nextRecord;
+} PinchCache;
+
+struct _stPinchCacheWriter {
+    FILE *fileHandle;
+    char *pinchCacheFile;
+    PinchCacheHeader header;
+};
+
+static void writeHeader(stPinchCacheWriter *writer) {
+    if (fseek(writer->fileHandle, 0, SEEK_SET) != 0 ||
+        fwrite(&writer->header, sizeof(PinchCacheHeader), 1, writer->fileHandle) != 1) {
+        st_errAbort("Error writing the header of pinch cache file: %s", writer->pinchCacheFile);
+    }
+}
+
+stPinchCacheWriter *stPinchCacheWriter_construct(const char *pinchCacheFile) {
+    stPinchCacheWriter *writer = st_calloc(1, sizeof(stPinchCacheWriter));
+    writer->fileHandle = fopen(pinchCacheFile, "w");
+    if (writer->fileHandle == NULL) {
+        st_errAbort("Could not open pinch cache file for writing: %s", pinchCacheFile);
+    }
+    writer->pinchCacheFile = stString_copy(pinchCacheFile);
+    memcpy(writer->header.magic, PINCH_CACHE_MAGIC, sizeof(writer->header.magic));
+    writer->header.recordNumber = 0;
+    // Rewritten with the final count when the writer is destructed
+    writeHeader(writer);
+    return writer;
+}
+
+void stPinchCacheWriter_addPinch(stPinchCacheWriter *writer, stPinch *pinch) {
+    assert(pinch->length > 0 && pinch->length <= UINT32_MAX);
+    stPinchCacheRecord record;
+    memset(&record, 0, sizeof(stPinchCacheRecord));
+    record.name1 = pinch->name1;
+    record.name2 = pinch->name2;
+    record.start1 = pinch->start1;
+    record.start2 = pinch->start2;
+    record.length = pinch->length;
+    record.strand = pinch->strand;
+    if (fwrite(&record, sizeof(stPinchCacheRecord), 1, writer->fileHandle) != 1) {
+        st_errAbort("Error writing to pinch cache file: %s", writer->pinchCacheFile);
+    }
+    writer->header.recordNumber++;
+}
+
+static Paf *getAlignmentOnce(Paf **paf) {
+    Paf *paf2 = *paf;
+    *paf = NULL;
+    return paf2;
+}
+
+void stPinchCacheWriter_addAlignment(stPinchCacheWriter *writer, Paf *paf, stHash *sequenceHeaderToCapHash) {
+    Paf *pafToReturn = paf;
+    PairwiseAlignmentToPinch *pA = pairwiseAlignmentToPinch_construct(&pafToReturn,
+            (Paf *(*)(void *)) getAlignmentOnce, 0);
+    pA->sequenceHeaderToCapHash = sequenceHeaderToCapHash;
+    stPinch *pinch, pinchToFillOut;
+    while ((pinch = pairwiseAlignmentToPinch_getNext(pA, &pinchToFillOut)) != NULL) {
+        stPinchCacheWriter_addPinch(writer, pinch);
+    }
+    free(pA);
+}
+
+void stPinchCacheWriter_destruct(stPinchCacheWriter *writer) {
+    writeHeader(writer);
+    if (fclose(writer->fileHandle) != 0) {
+        st_errAbort("Error closing pinch cache file: %s", writer->pinchCacheFile);
+    }
+    st_logDebug("Wrote %" PRIi64 " pinches to the pinch cache: %s\n", writer->header.recordNumber,
+                writer->pinchCacheFile);
+    free(writer->pinchCacheFile);
+    free(writer);
+}
+
+void stPinchIterator_readChunkOfLines(FILE *fileHandle, stList *lines, int64_t maxBytes) {
+    int64_t bytes = 0;
+    char *line;
+    while (bytes < maxBytes && (line = stFile_getLineFromFile(fileHandle)) != NULL) {
+        int64_t lineLength = strlen(line);
+        if (lineLength == 0) {
+            free(line);
+            continue;
+        }
+        stList_append(lines, line);
+        bytes += lineLength;
+    }
+}
+
+/*
+ * Number of bytes of an alignments file read into memory and parsed in parallel at a time.
+ */
+#define PINCH_CACHE_CHUNK_BYTES 67108864
+
+void stPinchCacheWriter_addAlignmentsFile(stPinchCacheWriter *writer, const char *alignmentsFile,
+                                          stHash *sequenceHeaderToCapHash) {
+    FILE *fileHandle = fopen(alignmentsFile, "r");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open alignments file: %s", alignmentsFile);
+    }
+    while (1) {
+        stList *lines = stList_construct3(0, free);
+        stPinchIterator_readChunkOfLines(fileHandle, lines, PINCH_CACHE_CHUNK_BYTES);
+        int64_t lineNumber = stList_length(lines);
+        if (lineNumber == 0) {
+            stList_destruct(lines);
+            break;
+        }
+
+        // Parse and convert the alignments of the chunk on all threads (the map is only read)...
+        Paf **pafs = st_malloc(sizeof(Paf *) * lineNumber);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+        for (int64_t i = 0; i < lineNumber; i++) {
+            pafs[i] = paf_parse(stList_get(lines, i), 1);
+            if (sequenceHeaderToCapHash != NULL) {
+                stPinchIterator_convertPafCoordinates(pafs[i], sequenceHeaderToCapHash);
+            }
+        }
+
+        // ...then write their pinches in input order
+        for (int64_t i = 0; i < lineNumber; i++) {
+            stPinchCacheWriter_addAlignment(writer, pafs[i], NULL);
+            paf_destruct(pafs[i]);
+        }
+        free(pafs);
+        stList_destruct(lines);
+    }
+    fclose(fileHandle);
+}
+
+void stPinchIterator_writePinchCache(stPinchIterator *pinchIterator, const char *pinchCacheFile) {
+    stPinchCacheWriter *writer = stPinchCacheWriter_construct(pinchCacheFile);
+    int64_t alignmentTrim = pinchIterator->alignmentTrim;
+    pinchIterator->alignmentTrim = 0; // The cache holds the untrimmed pinches, trimming is done when reading
+    stPinchIterator_reset(pinchIterator);
+    stPinch *pinch, pinchToFillOut;
+    while ((pinch = stPinchIterator_getNext(pinchIterator, &pinchToFillOut)) != NULL) {
+        stPinchCacheWriter_addPinch(writer, pinch);
+    }
+    stPinchIterator_reset(pinchIterator);
+    pinchIterator->alignmentTrim = alignmentTrim;
+    stPinchCacheWriter_destruct(writer);
+}
+
+static stPinch *pinchCache_getNext(PinchCache *pC, stPinch *pinchToFillOut) {
+    if (pC->nextRecord >= pC->recordNumber) {
+        return NULL;
+    }
+    stPinchCacheRecord *record = &pC->records[pC->nextRecord++];
+    stPinch_fillOut(pinchToFillOut, record->name1, record->name2, record->start1, record->start2, record->length,
+                    record->strand);
+    return pinchToFillOut;
+}
+
+static PinchCache *pinchCache_reset(PinchCache *pC) {
+    pC->nextRecord = 0;
+    return pC;
+}
+
+static void pinchCache_destruct(PinchCache *pC) {
+    munmap(pC->map, pC->mapLength);
+    close(pC->fileDescriptor);
+    free(pC);
+}
+
+stPinchIterator *stPinchIterator_constructFromPinchCache(const char *pinchCacheFile) {
+    PinchCache *pC = st_calloc(1, sizeof(PinchCache));
+    pC->fileDescriptor = open(pinchCacheFile, O_RDONLY);
+    if (pC->fileDescriptor == -1) {
+        st_errAbort("Could not open pinch cache file: %s", pinchCacheFile);
+    }
+    struct stat fileStats;
+    if (fstat(pC->fileDescriptor, &fileStats) != 0 || (size_t)fileStats.st_size < sizeof(PinchCacheHeader)) {
+        st_errAbort("Pinch cache file is truncated: %s", pinchCacheFile);
+    }
+    pC->mapLength = fileStats.st_size;
+    pC->map = mmap(NULL, pC->mapLength, PROT_READ, MAP_PRIVATE, pC->fileDescriptor, 0);
+    if (pC->map == MAP_FAILED) {
+        st_errAbort("Could not memory map pinch cache file: %s", pinchCacheFile);
+    }
+    madvise(pC->map, pC->mapLength, MADV_SEQUENTIAL);
+    PinchCacheHeader *header = pC->map;
+    if (memcmp(header->magic, PINCH_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        sizeof(PinchCacheHeader) + header->recordNumber * sizeof(stPinchCacheRecord) != pC->mapLength) {
+        st_errAbort("Not a valid pinch cache file: %s", pinchCacheFile);
+    }
+    pC->recordNumber = header->recordNumber;
+    pC->records = (stPinchCacheRecord *)((char *)pC->map + sizeof(PinchCacheHeader));
+
+    stPinchIterator *pinchIterator = st_calloc(1, sizeof(stPinchIterator));
+    pinchIterator->alignmentArg = pC;
+    pinchIterator->getNextAlignment = (stPinch *(*)(void *, stPinch *)) pinchCache_getNext;
+    pinchIterator->destructAlignmentArg = (void(*)(void *)) pinchCache_destruct;
+    pinchIterator->startAlignmentStack = (void *(*)(void *)) pinchCache_reset;
+    return pinchIterator;
+}
+
+stPinchIterator *stPinchIterator_constructFromFileWithHeaderMap(const char *alignmentFile,
+                                                                stHash *sequenceHeaderToCapHash) {
+    stPinchIterator *pinchIterator = stPinchIterator_constructFromFile(alignmentFile);
+    ((PairwiseAlignmentToPinch *)pinchIterator->alignmentArg)->sequenceHeaderToCapHash = sequenceHeaderToCapHash;
+    return pinchIterator;
+}
+
+stPinchIterator *stPinchIterator_constructFromFileAndFlower(const char *alignmentFile, Flower *flower) {
+    stPinchIterator *pinchIterator = stPinchIterator_constructFromFileWithHeaderMap(alignmentFile,
+            stPinchIterator_makeSequenceHeaderToCapHash(flower));
+    ((PairwiseAlignmentToPinch *)pinchIterator->alignmentArg)->destructSequenceHeaderToCapHash = 1;
+    return pinchIterator;
+}
+
 stSortedSetIterator *startAlignmentStackForAlignedPairs(stSortedSetIterator *it) {
     while (stSortedSet_getPrevious(it) != NULL) {
         ;
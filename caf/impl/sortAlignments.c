@@ -0,0 +1,207 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLib.h"
+#include "cactus.h"
+#include "paf.h"
+#include "stPinchIterator.h"
+#include "stCaf.h"
+
+// OpenMP
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+ * External merge sort of an alignments file by descending score, used to give the greedy alignment
+ * filters their high-score-first ordering without loading the whole file into memory.
+ *
+ * The file is read in chunks of at most SORT_RUN_BYTES, the scores of each chunk are parsed in parallel
+ * and the chunk split into a slice per thread, each sorted in parallel and written out as a run. The runs
+ * are then merged with a heap, converting each alignment into pinches written straight into a pinch cache.
+ * Ties are broken by input order, so the sort is stable.
+ */
+
+#define SORT_RUN_BYTES 1073741824
+
+typedef struct _scoredLine {
+    int64_t score;
+    int64_t index;
+    char *line;
+} ScoredLine;
+
+static int scoredLine_cmp(const void *a, const void *b) {
+    const ScoredLine *l1 = a, *l2 = b;
+    if (l1->score != l2->score) {
+        return l1->score > l2->score ? -1 : 1; // Descending order of score
+    }
+    return l1->index < l2->index ? -1 : (l1->index > l2->index ? 1 : 0);
+}
+
+/*
+ * Sorts the lines and writes them to a new run file.
+ */
+static void writeSortedRun(ScoredLine *scoredLines, int64_t lineNumber, char *runFile) {
+    qsort(scoredLines, lineNumber, sizeof(ScoredLine), scoredLine_cmp);
+    FILE *runFileHandle = fopen(runFile, "w");
+    if (runFileHandle == NULL) {
+        st_errAbort("Could not open temporary file for sorting alignments: %s", runFile);
+    }
+    for (int64_t i = 0; i < lineNumber; i++) {
+        fprintf(runFileHandle, "%s\n", scoredLines[i].line);
+    }
+    fclose(runFileHandle);
+    st_logDebug("Wrote a sorted run of %" PRIi64 " alignments to %s\n", lineNumber, runFile);
+}
+
+/*
+ * Splits the alignments file into sorted runs, returning the list of run files in input order.
+ *
+ * Each chunk is split into one slice per thread, and the slices are sorted and written in parallel, each as its own
+ * run. The merge breaks ties by run index, so keeping the runs in input order keeps the sort stable.
+ */
+static stList *makeSortedRuns(const char *alignmentsFile) {
+    FILE *fileHandle = fopen(alignmentsFile, "r");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open alignments file: %s", alignmentsFile);
+    }
+    stList *runFiles = stList_construct3(0, free);
+    while (1) {
+        stList *lines = stList_construct3(0, free);
+        stPinchIterator_readChunkOfLines(fileHandle, lines, SORT_RUN_BYTES);
+        int64_t lineNumber = stList_length(lines);
+        if (lineNumber == 0) {
+            stList_destruct(lines);
+            break;
+        }
+
+        ScoredLine *scoredLines = st_malloc(sizeof(ScoredLine) * lineNumber);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+        for (int64_t i = 0; i < lineNumber; i++) {
+            Paf *paf = paf_parse(stList_get(lines, i), 0);
+            scoredLines[i].score = paf->score;
+            scoredLines[i].index = i;
+            scoredLines[i].line = stList_get(lines, i);
+            paf_destruct(paf);
+        }
+
+#if defined(_OPENMP)
+        int64_t sliceNumber = omp_get_max_threads();
+#else
+        int64_t sliceNumber = 1;
+#endif
+        sliceNumber = sliceNumber < lineNumber ? sliceNumber : lineNumber;
+        char **sliceRunFiles = st_malloc(sizeof(char *) * sliceNumber);
+        for (int64_t i = 0; i < sliceNumber; i++) {
+            sliceRunFiles[i] = getTempFile();
+            stList_append(runFiles, sliceRunFiles[i]);
+        }
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static, 1)
+#endif
+        for (int64_t i = 0; i < sliceNumber; i++) {
+            int64_t sliceStart = lineNumber * i / sliceNumber, sliceEnd = lineNumber * (i + 1) / sliceNumber;
+            writeSortedRun(scoredLines + sliceStart, sliceEnd - sliceStart, sliceRunFiles[i]);
+        }
+        free(sliceRunFiles);
+        free(scoredLines);
+        stList_destruct(lines);
+    }
+    fclose(fileHandle);
+    return runFiles;
+}
+
+/*
+ * The head alignment of each run, kept in a binary heap ordered by descending score, then run index.
+ */
+typedef struct _runHead {
+    Paf *paf;
+    int64_t run;
+    FILE *fileHandle;
+} RunHead;
+
+static bool runHead_before(RunHead *r1, RunHead *r2) {
+    if (r1->paf->score != r2->paf->score) {
+        return r1->paf->score > r2->paf->score;
+    }
+    return r1->run < r2->run;
+}
+
+static void siftDown(RunHead *heap, int64_t heapLength, int64_t i) {
+    while (1) {
+        int64_t best = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < heapLength && runHead_before(&heap[left], &heap[best])) {
+            best = left;
+        }
+        if (right < heapLength && runHead_before(&heap[right], &heap[best])) {
+            best = right;
+        }
+        if (best == i) {
+            return;
+        }
+        RunHead r = heap[i];
+        heap[i] = heap[best];
+        heap[best] = r;
+        i = best;
+    }
+}
+
+static Paf *readNextAlignment(FILE *fileHandle) {
+    char *line;
+    while ((line = stFile_getLineFromFile(fileHandle)) != NULL) {
+        if (line[0] != '\0') {
+            Paf *paf = paf_parse(line, 1);
+            free(line);
+            return paf;
+        }
+        free(line);
+    }
+    return NULL;
+}
+
+void stCaf_sortAlignmentsByScoreInDescendingOrder(const char *alignmentsFile, const char *pinchCacheFile,
+                                                  stHash *sequenceHeaderToCapHash) {
+    stList *runFiles = makeSortedRuns(alignmentsFile);
+    int64_t runNumber = stList_length(runFiles);
+    st_logInfo("Sorting alignments file %s by score using %" PRIi64 " sorted runs\n", alignmentsFile, runNumber);
+
+    // K-way merge of the runs
+    RunHead *heap = st_malloc(sizeof(RunHead) * (runNumber > 0 ? runNumber : 1));
+    int64_t heapLength = 0;
+    for (int64_t i = 0; i < runNumber; i++) {
+        FILE *fileHandle = fopen(stList_get(runFiles, i), "r");
+        if (fileHandle == NULL) {
+            st_errAbort("Could not open temporary file for sorting alignments: %s", (char *)stList_get(runFiles, i));
+        }
+        Paf *paf = readNextAlignment(fileHandle);
+        assert(paf != NULL); // Runs are never empty
+        heap[heapLength].paf = paf;
+        heap[heapLength].run = i;
+        heap[heapLength++].fileHandle = fileHandle;
+    }
+    for (int64_t i = heapLength / 2 - 1; i >= 0; i--) {
+        siftDown(heap, heapLength, i);
+    }
+
+    stPinchCacheWriter *writer = stPinchCacheWriter_construct(pinchCacheFile);
+    while (heapLength > 0) {
+        stPinchCacheWriter_addAlignment(writer, heap[0].paf, sequenceHeaderToCapHash);
+        paf_destruct(heap[0].paf);
+        if ((heap[0].paf = readNextAlignment(heap[0].fileHandle)) == NULL) { // Run is exhausted
+            fclose(heap[0].fileHandle);
+            heap[0] = heap[--heapLength];
+        }
+        siftDown(heap, heapLength, 0);
+    }
+    stPinchCacheWriter_destruct(writer);
+
+    // Cleanup
+    free(heap);
+    for (int64_t i = 0; i < runNumber; i++) {
+        st_system("rm %s", stList_get(runFiles, i));
+    }
+    stList_destruct(runFiles);
+}
@@ -0,0 +1,320 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <float.h>
+#include "sonLib.h"
+#include "cactus.h"
+#include "stPinchGraphs.h"
+#include "stCaf.h"
+
+/*
+ * Statistics of the blocks of a pinch graph, gathered in a single parallel pass over the threads into fixed-size
+ * histograms, so that no per-block arrays are allocated or sorted.
+ *
+ * Integer valued quantities (degrees and aligned bases) go into log-linear histograms: values below
+ * LOG_HISTOGRAM_LINEAR_BINS have a bin each, larger values share bins with a relative width of
+ * 1 / LOG_HISTOGRAM_SUB_BINS, so quantiles are exact for small values and within about 3% otherwise. The minimum
+ * and maximum are exact.
+ * Supports, which lie in [0, 1], go into SUPPORT_HISTOGRAM_BINS equal width bins.
+ */
+
+#define LOG_HISTOGRAM_LINEAR_BITS 6
+#define LOG_HISTOGRAM_LINEAR_BINS (1 << LOG_HISTOGRAM_LINEAR_BITS)
+#define LOG_HISTOGRAM_SUB_BITS 5
+#define LOG_HISTOGRAM_SUB_BINS (1 << LOG_HISTOGRAM_SUB_BITS)
+#define LOG_HISTOGRAM_BINS (LOG_HISTOGRAM_LINEAR_BINS + (64 - LOG_HISTOGRAM_LINEAR_BITS) * LOG_HISTOGRAM_SUB_BINS)
+#define SUPPORT_HISTOGRAM_BINS 1000
+
+typedef struct _logHistogram {
+    uint64_t counts[LOG_HISTOGRAM_BINS];
+    uint64_t min;
+    uint64_t max;
+    double total;
+} LogHistogram;
+
+typedef struct _supportHistogram {
+    uint64_t counts[SUPPORT_HISTOGRAM_BINS + 1]; // The last bin is for a support of exactly one
+    double min;
+    double max;
+    double total;
+} SupportHistogram;
+
+struct _stCafThreadSetStatistics {
+    uint64_t blockNumber;
+    uint64_t totalAlignedBases;
+    LogHistogram degrees;
+    LogHistogram alignedBases; // Aligned bases per block
+    SupportHistogram supports;
+};
+
+static int64_t logHistogram_getBin(uint64_t value) {
+    if (value < LOG_HISTOGRAM_LINEAR_BINS) {
+        return value;
+    }
+    int64_t exponent = 63 - __builtin_clzll(value); // >= LOG_HISTOGRAM_LINEAR_BITS
+    int64_t subBin = (value >> (exponent - LOG_HISTOGRAM_SUB_BITS)) & (LOG_HISTOGRAM_SUB_BINS - 1);
+    return LOG_HISTOGRAM_LINEAR_BINS + (exponent - LOG_HISTOGRAM_LINEAR_BITS) * LOG_HISTOGRAM_SUB_BINS + subBin;
+}
+
+/*
+ * Smallest value that falls in the bin.
+ */
+static uint64_t logHistogram_getBinStart(int64_t bin) {
+    if (bin < LOG_HISTOGRAM_LINEAR_BINS) {
+        return bin;
+    }
+    int64_t exponent = (bin - LOG_HISTOGRAM_LINEAR_BINS) / LOG_HISTOGRAM_SUB_BINS + LOG_HISTOGRAM_LINEAR_BITS;
+    uint64_t subBin = (bin - LOG_HISTOGRAM_LINEAR_BINS) % LOG_HISTOGRAM_SUB_BINS;
+    return (((uint64_t) 1) << exponent) | (subBin << (exponent - LOG_HISTOGRAM_SUB_BITS));
+}
+
+static void logHistogram_init(LogHistogram *histogram) {
+    memset(histogram, 0, sizeof(LogHistogram));
+    histogram->min = UINT64_MAX;
+}
+
+static void logHistogram_add(LogHistogram *histogram, uint64_t value) {
+    histogram->counts[logHistogram_getBin(value)]++;
+    histogram->min = value < histogram->min ? value : histogram->min;
+    histogram->max = value > histogram->max ? value : histogram->max;
+    histogram->total += value;
+}
+
+static void logHistogram_merge(LogHistogram *histogram, LogHistogram *histogram2) {
+    for (int64_t i = 0; i < LOG_HISTOGRAM_BINS; i++) {
+        histogram->counts[i] += histogram2->counts[i];
+    }
+    histogram->min = histogram2->min < histogram->min ? histogram2->min : histogram->min;
+    histogram->max = histogram2->max > histogram->max ? histogram2->max : histogram->max;
+    histogram->total += histogram2->total;
+}
+
+/*
+ * Gets the index of the bin containing the element of the given rank (starting from 0) in sorted order.
+ */
+static int64_t getBinOfRank(uint64_t *counts, int64_t binNumber, uint64_t rank) {
+    uint64_t cumulativeCount = 0;
+    for (int64_t i = 0; i < binNumber; i++) {
+        cumulativeCount += counts[i];
+        if (cumulativeCount > rank) {
+            return i;
+        }
+    }
+    return binNumber - 1;
+}
+
+static uint64_t getRank(uint64_t n, double quantile) {
+    assert(n > 0 && quantile >= 0.0 && quantile <= 1.0);
+    return (uint64_t) (quantile * (n - 1)); // For the median this is the lower median
+}
+
+static uint64_t logHistogram_getQuantile(LogHistogram *histogram, uint64_t n, double quantile) {
+    if (n == 0) {
+        return 0;
+    }
+    if (getRank(n, quantile) == n - 1) {
+        return histogram->max;
+    }
+    uint64_t value = logHistogram_getBinStart(getBinOfRank(histogram->counts, LOG_HISTOGRAM_BINS,
+                                                           getRank(n, quantile)));
+    return value < histogram->min ? histogram->min : (value > histogram->max ? histogram->max : value);
+}
+
+static void supportHistogram_init(SupportHistogram *histogram) {
+    memset(histogram, 0, sizeof(SupportHistogram));
+    histogram->min = DBL_MAX;
+}
+
+static void supportHistogram_add(SupportHistogram *histogram, double support) {
+    int64_t bin = support * SUPPORT_HISTOGRAM_BINS;
+    bin = bin < 0 ? 0 : (bin > SUPPORT_HISTOGRAM_BINS ? SUPPORT_HISTOGRAM_BINS : bin);
+    histogram->counts[bin]++;
+    histogram->min = support < histogram->min ? support : histogram->min;
+    histogram->max = support > histogram->max ? support : histogram->max;
+    histogram->total += support;
+}
+
+static void supportHistogram_merge(SupportHistogram *histogram, SupportHistogram *histogram2) {
+    for (int64_t i = 0; i <= SUPPORT_HISTOGRAM_BINS; i++) {
+        histogram->counts[i] += histogram2->counts[i];
+    }
+    histogram->min = histogram2->min < histogram->min ? histogram2->min : histogram->min;
+    histogram->max = histogram2->max > histogram->max ? histogram2->max : histogram->max;
+    histogram->total += histogram2->total;
+}
+
+static double supportHistogram_getQuantile(SupportHistogram *histogram, uint64_t n, double quantile) {
+    if (n == 0) {
+        return 0.0;
+    }
+    if (getRank(n, quantile) == n - 1) {
+        return histogram->max;
+    }
+    double value = ((double) getBinOfRank(histogram->counts, SUPPORT_HISTOGRAM_BINS + 1, getRank(n, quantile)))
+            / SUPPORT_HISTOGRAM_BINS;
+    return value < histogram->min ? histogram->min : (value > histogram->max ? histogram->max : value);
+}
+
+static uint64_t choose2(uint64_t n) {
+    return n <= 1 ? 0 : n * (n - 1) / 2;
+}
+
+uint64_t stCaf_numPossibleSupportingHomologies(stPinchBlock *block, Flower *flower, stCafEventTable *eventTable) {
+    uint64_t outgroupDegree = 0, ingroupDegree = 0;
+    stPinchBlockIt segIt = stPinchBlock_getSegmentIterator(block);
+    stPinchSegment *segment;
+    while ((segment = stPinchBlockIt_getNext(&segIt)) != NULL) {
+        if (eventTable != NULL ? stCafEventTable_isOutgroup(eventTable, segment) : stCaf_isOutgroup(segment, flower)) {
+            outgroupDegree++;
+        } else {
+            ingroupDegree++;
+        }
+    }
+    assert(outgroupDegree + ingroupDegree == stPinchBlock_getDegree(block));
+    // We do the ingroup-ingroup alignments as an all-against-all
+    // alignment, so we can see each ingroup-ingroup homology up to
+    // twice.
+    return choose2(ingroupDegree) * 2 + ingroupDegree * outgroupDegree;
+}
+
+static void stCafThreadSetStatistics_init(stCafThreadSetStatistics *stats) {
+    stats->blockNumber = 0;
+    stats->totalAlignedBases = 0;
+    logHistogram_init(&stats->degrees);
+    logHistogram_init(&stats->alignedBases);
+    supportHistogram_init(&stats->supports);
+}
+
+static void stCafThreadSetStatistics_addBlock(stCafThreadSetStatistics *stats, stPinchBlock *block, Flower *flower) {
+    uint64_t degree = stPinchBlock_getDegree(block);
+    uint64_t alignedBases = stPinchBlock_getLength(block) * degree;
+    uint64_t possibleSupportingHomologies = stCaf_numPossibleSupportingHomologies(block, flower, NULL);
+    double support = 0.0;
+    if (possibleSupportingHomologies != 0) {
+        support = ((double) stPinchBlock_getNumSupportingHomologies(block)) / possibleSupportingHomologies;
+    }
+    stats->blockNumber++;
+    stats->totalAlignedBases += alignedBases;
+    logHistogram_add(&stats->degrees, degree);
+    logHistogram_add(&stats->alignedBases, alignedBases);
+    supportHistogram_add(&stats->supports, support);
+}
+
+static void stCafThreadSetStatistics_merge(stCafThreadSetStatistics *stats, stCafThreadSetStatistics *stats2) {
+    stats->blockNumber += stats2->blockNumber;
+    stats->totalAlignedBases += stats2->totalAlignedBases;
+    logHistogram_merge(&stats->degrees, &stats2->degrees);
+    logHistogram_merge(&stats->alignedBases, &stats2->alignedBases);
+    supportHistogram_merge(&stats->supports, &stats2->supports);
+}
+
+stCafThreadSetStatistics *stCaf_getThreadSetStatistics(stPinchThreadSet *threadSet, Flower *flower) {
+    // Each block is counted from the thread holding its first segment
+    stList *threads = stList_construct();
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stList_append(threads, thread);
+    }
+
+    stCafThreadSetStatistics *stats = st_malloc(sizeof(stCafThreadSetStatistics));
+    stCafThreadSetStatistics_init(stats);
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+    {
+        stCafThreadSetStatistics *localStats = st_malloc(sizeof(stCafThreadSetStatistics));
+        stCafThreadSetStatistics_init(localStats);
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int64_t i = 0; i < stList_length(threads); i++) {
+            stPinchSegment *segment = stPinchThread_getFirst(stList_get(threads, i));
+            while (segment != NULL) {
+                stPinchBlock *block = stPinchSegment_getBlock(segment);
+                if (block != NULL && stPinchBlock_getFirst(block) == segment) {
+                    stCafThreadSetStatistics_addBlock(localStats, block, flower);
+                }
+                segment = stPinchSegment_get3Prime(segment);
+            }
+        }
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+        {
+            stCafThreadSetStatistics_merge(stats, localStats);
+        }
+        free(localStats);
+    }
+    stList_destruct(threads);
+    return stats;
+}
+
+void stCafThreadSetStatistics_destruct(stCafThreadSetStatistics *stats) {
+    free(stats);
+}
+
+uint64_t stCafThreadSetStatistics_getBlockNumber(stCafThreadSetStatistics *stats) {
+    return stats->blockNumber;
+}
+
+uint64_t stCafThreadSetStatistics_getTotalAlignedBases(stCafThreadSetStatistics *stats) {
+    return stats->totalAlignedBases;
+}
+
+uint64_t stCafThreadSetStatistics_getDegreeQuantile(stCafThreadSetStatistics *stats, double quantile) {
+    return logHistogram_getQuantile(&stats->degrees, stats->blockNumber, quantile);
+}
+
+double stCafThreadSetStatistics_getSupportQuantile(stCafThreadSetStatistics *stats, double quantile) {
+    return supportHistogram_getQuantile(&stats->supports, stats->blockNumber, quantile);
+}
+
+uint64_t stCafThreadSetStatistics_getAlignedBasesQuantile(stCafThreadSetStatistics *stats, double quantile) {
+    return logHistogram_getQuantile(&stats->alignedBases, stats->blockNumber, quantile);
+}
+
+static double mean(double total, uint64_t n) {
+    return n > 0 ? total / n : 0.0;
+}
+
+void stCafThreadSetStatistics_print(stCafThreadSetStatistics *stats, FILE *f) {
+    fprintf(f, "There were %" PRIu64 " blocks in the sequence graph, representing %" PRIu64
+            " total aligned bases\n", stats->blockNumber, stats->totalAlignedBases);
+    fprintf(f, "Block degree stats: min %" PRIu64 ", avg %lf, median %" PRIu64 ", max %" PRIu64 "\n",
+            stCafThreadSetStatistics_getDegreeQuantile(stats, 0.0), mean(stats->degrees.total, stats->blockNumber),
+            stCafThreadSetStatistics_getDegreeQuantile(stats, 0.5),
+            stCafThreadSetStatistics_getDegreeQuantile(stats, 1.0));
+    fprintf(f, "Block support stats: min %lf, avg %lf, median %lf, max %lf\n",
+            stCafThreadSetStatistics_getSupportQuantile(stats, 0.0), mean(stats->supports.total, stats->blockNumber),
+            stCafThreadSetStatistics_getSupportQuantile(stats, 0.5),
+            stCafThreadSetStatistics_getSupportQuantile(stats, 1.0));
+}
+
+static const double recordQuantiles[] = { 0.0, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 1.0 };
+static const char *recordQuantileNames[] = { "min", "p10", "p25", "median", "p75", "p90", "p99", "max" };
+#define RECORD_QUANTILE_NUMBER 8
+
+static void printLogHistogramRecord(stCafThreadSetStatistics *stats, LogHistogram *histogram, const char *name,
+                                    FILE *f) {
+    fprintf(f, ", \"%s\": {\"mean\": %lf", name, mean(histogram->total, stats->blockNumber));
+    for (int64_t i = 0; i < RECORD_QUANTILE_NUMBER; i++) {
+        fprintf(f, ", \"%s\": %" PRIu64, recordQuantileNames[i],
+                logHistogram_getQuantile(histogram, stats->blockNumber, recordQuantiles[i]));
+    }
+    fprintf(f, "}");
+}
+
+void stCafThreadSetStatistics_printRecord(stCafThreadSetStatistics *stats, const char *stage, int64_t round, FILE *f) {
+    fprintf(f, "{\"stage\": \"%s\", \"round\": %" PRIi64 ", \"blocks\": %" PRIu64 ", \"alignedBases\": %" PRIu64,
+            stage, round, stats->blockNumber, stats->totalAlignedBases);
+    printLogHistogramRecord(stats, &stats->degrees, "degree", f);
+    printLogHistogramRecord(stats, &stats->alignedBases, "blockAlignedBases", f);
+    fprintf(f, ", \"support\": {\"mean\": %lf", mean(stats->supports.total, stats->blockNumber));
+    for (int64_t i = 0; i < RECORD_QUANTILE_NUMBER; i++) {
+        fprintf(f, ", \"%s\": %lf", recordQuantileNames[i],
+                supportHistogram_getQuantile(&stats->supports, stats->blockNumber, recordQuantiles[i]));
+    }
+    fprintf(f, "}}\n");
+}
@@ -15,9 +15,12 @@
 #include "cactus.h"
 
 /*
- * The function to run the overall caf algorithm.
+ * The function to run the overall caf algorithm. If sequenceHeaderToCapHash is non-null (see
+ * stPinchIterator_makeSequenceHeaderToCapHash) the alignment files are in input coordinates and are converted
+ * to cactus coordinates as they are read, otherwise they must already be in cactus coordinates.
  */
-void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secondaryAlignmentsFile, char *constraintsFile, Event *referenceEvent);
+void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secondaryAlignmentsFile, char *constraintsFile,
+         Event *referenceEvent, stHash *sequenceHeaderToCapHash);
 
 ///////////////////////////////////////////////////////////////////////////
 // Setup the pinch graph from a cactus graph
@@ -34,21 +37,51 @@ stPinchThreadSet *stCaf_constructEmptyPinchGraph(Flower *flower);
  */
 stPinchThreadSet *stCaf_setup(Flower *flower);
 
+///////////////////////////////////////////////////////////////////////////
+// Sorting alignments
+///////////////////////////////////////////////////////////////////////////
+
+/*
+ * Sorts the alignments in the file by descending score (stably) with an external merge sort, bounded in
+ * memory, writing their pinches in that order into the given pinch cache file. If sequenceHeaderToCapHash is
+ * non-null the alignments are in input coordinates, see stPinchIterator_constructFromFileWithHeaderMap.
+ */
+void stCaf_sortAlignmentsByScoreInDescendingOrder(const char *alignmentsFile, const char *pinchCacheFile,
+                                                  stHash *sequenceHeaderToCapHash);
+
 ///////////////////////////////////////////////////////////////////////////
 // Annealing functions -- adding alignments to pinch graph
 ///////////////////////////////////////////////////////////////////////////
 
+/*
+ * Table of the event of each thread of a pinch graph, see stCaf_constructEventTable.
+ */
+typedef struct _stCafEventTable stCafEventTable;
+
+/*
+ * The arguments of the alignment and block filters.
+ */
+typedef struct _filterArgs {
+    Flower *flower;
+    stCafEventTable *eventTable; // The event table of the flower's pinch graph, or NULL to look events up in the flower
+    int64_t minimumIngroupDegree;
+    int64_t minimumOutgroupDegree;
+    int64_t minimumDegree;
+    int64_t minimumNumberOfSpecies;
+    float minimumTreeCoverage;
+} FilterArgs;
+
 /*
  * Add the set of alignments, represented as pinches, to the graph.
  */
 void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
-                  bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower);
+                  bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs);
 
 /*
  * Add the set of alignments, represented as pinches, to the graph, allowing alignments only between segments in the same component.
  */
 void stCaf_annealBetweenAdjacencyComponents(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
-                                            bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower);
+                                            bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs);
 
 /*
  * Joins all trivial boundaries, but not joining stub boundaries.
@@ -59,15 +92,6 @@ void stCaf_joinTrivialBoundaries(stPinchThreadSet *threadSet);
 // Melting functions -- removing alignments from the pinch graph
 ///////////////////////////////////////////////////////////////////////////
 
-typedef struct _filterArgs {
-    Flower *flower;
-    int64_t minimumIngroupDegree;
-    int64_t minimumOutgroupDegree;
-    int64_t minimumDegree;
-    int64_t minimumNumberOfSpecies;
-    float minimumTreeCoverage;
-} FilterArgs;
-
 /*
  * Removes homologies from the graph.
  */
@@ -75,6 +99,29 @@ void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(
                 int64_t blockEndTrim, int64_t minimumChainLength,
                 bool breakChainsAtReverseTandems, int64_t maximumMedianSpacingBetweenLinkedEnds);
 
+/*
+ * The chain decomposition of a thread set, built once so that chains can be melted over a series of
+ * increasing minimum chain lengths without rebuilding the cactus graph for each one.
+ */
+typedef struct _stCafChainIndex stCafChainIndex;
+
+/*
+ * Builds the cactus graph of the thread set once and records the blocks and length of each chain.
+ */
+stCafChainIndex *stCaf_constructChainIndex(Flower *flower, stPinchThreadSet *threadSet);
+
+/*
+ * Destroys the blocks of chains with length less than the given minimum that have not already been melted.
+ * Equivalent to stCaf_melt with only a minimum chain length, provided successive calls use non-decreasing
+ * lengths and the thread set is otherwise unmodified while the index exists.
+ */
+void stCaf_meltChainsLessThanGivenLength(stCafChainIndex *chainIndex, int64_t minimumChainLength);
+
+/*
+ * Joins the trivial boundaries left by melting and frees the index.
+ */
+void stCaf_destructChainIndex(stCafChainIndex *chainIndex);
+
 /*
  * Removes any recoverable chains (those expected to be picked up by
  * bar phase) from the graph. Only chains that are recoverable *and*
@@ -92,6 +139,54 @@ double stCaf_averageBlockDegree(stList *blocks);
  */
 uint64_t stCaf_totalAlignedBases(stList *blocks);
 
+///////////////////////////////////////////////////////////////////////////
+// Thread set statistics
+///////////////////////////////////////////////////////////////////////////
+
+/*
+ * Distributions of the degree, homology support and aligned bases of the blocks of a thread set, held in
+ * fixed-size histograms. Quantiles of degree and aligned bases are exact below 64 and within about 3% above,
+ * quantiles of support are to within 0.001. Minimums and maximums are exact.
+ */
+typedef struct _stCafThreadSetStatistics stCafThreadSetStatistics;
+
+/*
+ * Gathers the statistics of the blocks in one parallel pass over the threads.
+ */
+stCafThreadSetStatistics *stCaf_getThreadSetStatistics(stPinchThreadSet *threadSet, Flower *flower);
+
+void stCafThreadSetStatistics_destruct(stCafThreadSetStatistics *stats);
+
+uint64_t stCafThreadSetStatistics_getBlockNumber(stCafThreadSetStatistics *stats);
+
+uint64_t stCafThreadSetStatistics_getTotalAlignedBases(stCafThreadSetStatistics *stats);
+
+/*
+ * Quantiles, for a quantile in [0, 1]. The median (0.5) is the lower median.
+ */
+uint64_t stCafThreadSetStatistics_getDegreeQuantile(stCafThreadSetStatistics *stats, double quantile);
+
+double stCafThreadSetStatistics_getSupportQuantile(stCafThreadSetStatistics *stats, double quantile);
+
+uint64_t stCafThreadSetStatistics_getAlignedBasesQuantile(stCafThreadSetStatistics *stats, double quantile);
+
+/*
+ * Prints a human readable summary (min, avg, median, max) of the statistics.
+ */
+void stCafThreadSetStatistics_print(stCafThreadSetStatistics *stats, FILE *f);
+
+/*
+ * Prints the statistics as a single line JSON record, labelled with the stage of the algorithm and round, so the
+ * evolution of the graph can be followed across annealing rounds.
+ */
+void stCafThreadSetStatistics_printRecord(stCafThreadSetStatistics *stats, const char *stage, int64_t round, FILE *f);
+
+/*
+ * Returns the number of pairwise alignments that could support the block. Ordinarily this is (degree choose 2),
+ * but since outgroups are not self-aligned it's a bit smaller. The event table may be NULL, as in FilterArgs.
+ */
+uint64_t stCaf_numPossibleSupportingHomologies(stPinchBlock *block, Flower *flower, stCafEventTable *eventTable);
+
 ///////////////////////////////////////////////////////////////////////////
 // Pinch graph to cactus graph
 ///////////////////////////////////////////////////////////////////////////
@@ -139,7 +234,7 @@ void stCaf_finish(Flower *flower, stPinchThreadSet *threadSet, int64_t minLength
  */
 
 bool stCaf_filterByOutgroup(stPinchSegment *segment1,
-                            stPinchSegment *segment2, Flower *flower);
+                            stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /*
  * A "relaxed" version of the above which allows the addition of more
@@ -147,34 +242,34 @@ bool stCaf_filterByOutgroup(stPinchSegment *segment1,
  * different blocks containing outgroups to be pinched.
  */
 bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
-                                   stPinchSegment *segment2, Flower *flower);
+                                   stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /*
  * Filters incoming alignments by presence of repeat species in
  * block. This code is inefficient and does not scale.
  */
 bool stCaf_filterByRepeatSpecies(stPinchSegment *segment1,
-                                 stPinchSegment *segment2, Flower *flower);
+                                 stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /*
  * As above, but allows pinching a duplicated segment to a block, but
  * not pinching two duplicated blocks together.
  */
 bool stCaf_relaxedFilterByRepeatSpecies(stPinchSegment *segment1,
-                                        stPinchSegment *segment2, Flower *flower);
+                                        stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /**
  * As stCaf_filterByRepeatSpecies, but apply filter only to a particular event
  */
 void stCaf_setSingleCopyEvent(Flower* flower, char *singleCopyEventName);
 bool stCaf_filterBySingleCopyEvent(stPinchSegment *segment1,
-                                   stPinchSegment *segment2, Flower *flower);
+                                   stPinchSegment *segment2, FilterArgs *filterArgs);
 
 bool stCaf_singleCopyIngroup(stPinchSegment *segment1,
-                             stPinchSegment *segment2, Flower *flower);
+                             stPinchSegment *segment2, FilterArgs *filterArgs);
 
 bool stCaf_relaxedSingleCopyIngroup(stPinchSegment *segment1,
-                                    stPinchSegment *segment2, Flower *flower);
+                                    stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /*
  * Filters block alignments that would merge blocks that each already contain
@@ -182,19 +277,19 @@ bool stCaf_relaxedSingleCopyIngroup(stPinchSegment *segment1,
  * unaligned sequences.
  */
 bool stCaf_filterByMultipleSequences(stPinchSegment *segment1,
-                                     stPinchSegment *segment2, Flower *flower);
+                                     stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /*
  * Filters block alignments that would merge blocks that each already contain
  * sequences from multiple species. The rationale of this filter is to avoid
  * aligning together paralogous alignments that predate the speciation event.
  */
-bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1, stPinchSegment *segment2, Flower *flower);
+bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1, stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /*
  * Forbids pinching together two copies within the same sequence.
  */
-bool stCaf_singleCopyChr(stPinchSegment *segment1, stPinchSegment *segment2, Flower *flower);
+bool stCaf_singleCopyChr(stPinchSegment *segment1, stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /*
  * Run stCaf_filterToEnsureCycleFreeIsolatedComponents so that every
@@ -218,7 +313,7 @@ void stCaf_setThreadsToBeCycleFreeIsolatedComponents(stPinchThreadSet *threadSet
  * cycles.
  */
 bool stCaf_filterToEnsureCycleFreeIsolatedComponents(stPinchSegment *segment1,
-                                                     stPinchSegment *segment2, Flower *flower);
+                                                     stPinchSegment *segment2, FilterArgs *filterArgs);
 
 /*
  * Returns true for chains that have an unequal number of ingroup
@@ -239,17 +334,38 @@ bool stCaf_chainHasUnequalNumberOfIngroupCopiesOrNoOutgroup(stCactusEdgeEnd *cha
 /*
  * Function used to determine if blocks contains sufficient numbers of sequences of ingroup/outgroup species.
  */
-bool stCaf_containsRequiredSpecies(stPinchBlock *pinchBlock, Flower *flower, int64_t minimumIngroupDegree,
-        int64_t minimumOutgroupDegree, int64_t minimumDegree, int64_t minimumNumberOfSpecies);
+bool stCaf_containsRequiredSpecies(stPinchBlock *pinchBlock, Flower *flower, stCafEventTable *eventTable,
+        int64_t minimumIngroupDegree, int64_t minimumOutgroupDegree, int64_t minimumDegree,
+        int64_t minimumNumberOfSpecies);
 
 /*
  * Returns the proportion of the tree covered by the block.
  */
-bool stCaf_treeCoverage(stPinchBlock *pinchBlock, Flower *flower);
+bool stCaf_treeCoverage(stPinchBlock *pinchBlock, Flower *flower, stCafEventTable *eventTable);
 
 /*
  * Short way to get the event corresponding to a given segment.
  */
 Event *stCaf_getEvent(stPinchSegment *segment, Flower *flower);
 
+/*
+ * Returns non-zero if the segment is from an outgroup event.
+ */
+bool stCaf_isOutgroup(stPinchSegment *segment, Flower *flower);
+
+/*
+ * Builds a table of the event of each thread in the pinch graph, used by the filters (through FilterArgs) in place of
+ * looking up the cap of each segment in the flower. It is only read once built, so it can be shared between threads.
+ */
+stCafEventTable *stCaf_constructEventTable(Flower *flower, stPinchThreadSet *threadSet);
+
+void stCaf_destructEventTable(stCafEventTable *eventTable);
+
+/*
+ * As stCaf_getEvent and stCaf_isOutgroup, looking the segment's thread up in the event table.
+ */
+Event *stCafEventTable_getEvent(stCafEventTable *eventTable, stPinchSegment *segment);
+
+bool stCafEventTable_isOutgroup(stCafEventTable *eventTable, stPinchSegment *segment);
+
 #endif /* STCAF_H_ */
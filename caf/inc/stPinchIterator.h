@@ -10,6 +10,8 @@
 
 #include "sonLib.h"
 #include "stPinchGraphs.h"
+#include "cactus.h"
+#include "paf.h"
 
 typedef struct _stPinchIterator {
     int64_t alignmentTrim;
@@ -42,12 +44,102 @@ void stPinchIterator_destruct(
  */
 stPinchIterator *stPinchIterator_constructFromFile(const char *alignmentFile);
 
+/*
+ * Builds a map from the first token of the header of each sequence in the flower to the 5' cap of the sequence's
+ * thread. Used to map alignments in input coordinates to cactus coordinates.
+ */
+stHash *stPinchIterator_makeSequenceHeaderToCapHash(Flower *flower);
+
+/*
+ * Converts an alignment in input coordinates into cactus coordinates, replacing the sequence names with the names of
+ * the corresponding caps (as a string) and shifting the coordinates to account for the stub at the start of each thread.
+ */
+void stPinchIterator_convertPafCoordinates(Paf *paf, stHash *sequenceHeaderToCapHash);
+
+/*
+ * Get a pairwise alignment iterator from a file of alignments in input coordinates. Each alignment is mapped into cactus
+ * coordinates on the fly, as by stPinchIterator_convertPafCoordinates, so the file does not need to be rewritten first.
+ * The map is not owned by the iterator.
+ */
+stPinchIterator *stPinchIterator_constructFromFileWithHeaderMap(const char *alignmentFile,
+                                                                stHash *sequenceHeaderToCapHash);
+
+/*
+ * As stPinchIterator_constructFromFileWithHeaderMap, building the map from the flower. The sequence headers of the
+ * flower must be those used in the alignments, i.e. before any unique ids are stripped.
+ */
+stPinchIterator *stPinchIterator_constructFromFileAndFlower(const char *alignmentFile, Flower *flower);
+
 /*
  * Constructs iterator from aligned pairs.
  */
 stPinchIterator *stPinchIterator_constructFromAlignedPairs(stSortedSet *alignedPairs,
                                                            stPinch *(*getNextAlignedPairAlignment)(stSortedSetIterator *, stPinch *));
 
+/*
+ * Record of the binary pinch cache. The cache file is a short header followed by a flat array of these records,
+ * one per pinch, in the order the pinches were produced.
+ */
+typedef struct _stPinchCacheRecord {
+    int64_t name1;
+    int64_t name2;
+    int64_t start1;
+    int64_t start2;
+    uint32_t length;
+    uint32_t strand;
+} stPinchCacheRecord;
+
+/*
+ * Writes all the (untrimmed) pinches of the iterator into a binary pinch cache file. Resets the iterator before
+ * and after.
+ */
+void stPinchIterator_writePinchCache(stPinchIterator *pinchIterator, const char *pinchCacheFile);
+
+/*
+ * Incremental writer of a binary pinch cache file.
+ */
+typedef struct _stPinchCacheWriter stPinchCacheWriter;
+
+/*
+ * Opens a pinch cache file for writing.
+ */
+stPinchCacheWriter *stPinchCacheWriter_construct(const char *pinchCacheFile);
+
+/*
+ * Appends a pinch to the cache.
+ */
+void stPinchCacheWriter_addPinch(stPinchCacheWriter *writer, stPinch *pinch);
+
+/*
+ * Appends the pinches of the alignment to the cache. If sequenceHeaderToCapHash is non-null the alignment is in input
+ * coordinates and is converted as by stPinchIterator_convertPafCoordinates (modifying the alignment's coordinates).
+ */
+void stPinchCacheWriter_addAlignment(stPinchCacheWriter *writer, Paf *paf, stHash *sequenceHeaderToCapHash);
+
+/*
+ * Appends the pinches of all the alignments in the file to the cache, in file order. The file is read in chunks whose
+ * alignments are parsed (and converted, if sequenceHeaderToCapHash is non-null) on all threads.
+ */
+void stPinchCacheWriter_addAlignmentsFile(stPinchCacheWriter *writer, const char *alignmentsFile,
+                                          stHash *sequenceHeaderToCapHash);
+
+/*
+ * Reads whole lines of the file into the list until at least maxBytes have been read or the file is exhausted.
+ * Empty lines are skipped.
+ */
+void stPinchIterator_readChunkOfLines(FILE *fileHandle, stList *lines, int64_t maxBytes);
+
+/*
+ * Finishes writing the cache file and cleans up the writer.
+ */
+void stPinchCacheWriter_destruct(stPinchCacheWriter *writer);
+
+/*
+ * Get a pairwise alignment iterator from a binary pinch cache file, as written by stPinchIterator_writePinchCache.
+ * The file is memory mapped, so resetting the iterator is free and no alignments are reparsed.
+ */
+stPinchIterator *stPinchIterator_constructFromPinchCache(const char *pinchCacheFile);
+
 /*
  * Sets the amount to trim from the ends of each pinch in bases.
  */
@@ -9,18 +9,17 @@
 #include "stCaf.h"
 #include "stPinchGraphs.h"
 
-void stCaf_anneal2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg);
+void stCaf_anneal2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *, stPinch *), void *extraArg);
 
-void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *),
-        void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
+void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *, stPinch *),
+        void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *, FilterArgs *), FilterArgs *filterArgs);
 
-static stPinch *randomPinch(void *extraArg) {
+static stPinch *randomPinch(void *extraArg, stPinch *pinchToFillOut) {
     if(st_random() < 0.01) {
         return NULL;
     }
-    static stPinch pinch;
-    pinch = stPinchThreadSet_getRandomPinch(extraArg);
-    return &pinch;
+    *pinchToFillOut = stPinchThreadSet_getRandomPinch(extraArg);
+    return pinchToFillOut;
 }
 
 static void testAnnealing(CuTest *testCase) {
@@ -37,7 +36,7 @@ static void testAnnealingBetweenAdjacencyComponents(CuTest *testCase) {
     for (int64_t test = 0; test < 100; test++) {
         st_logInfo("Starting annealing between adjacency components random test %" PRIi64 "\n", test);
         stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
-        stCaf_annealBetweenAdjacencyComponents2(threadSet, randomPinch, threadSet, NULL);
+        stCaf_annealBetweenAdjacencyComponents2(threadSet, randomPinch, threadSet, NULL, NULL);
     }
 }
 
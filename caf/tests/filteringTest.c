@@ -320,6 +320,7 @@ static void testHGVMFiltering(CuTest *testCase) {
         stSet_insert(isolatedThreads, stPinchThreadSet_getThread(threadSet, ingroup1Seq1));
         stSet_insert(isolatedThreads, stPinchThreadSet_getThread(threadSet, ingroup1Seq2));
         stCaf_setThreadsToBeCycleFreeIsolatedComponents(threadSet, isolatedThreads);
+        FilterArgs filterArgs = { .flower = flower, .eventTable = NULL };
 
         for (int64_t i = 0; i < numRandomPinches; i++) {
             stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
@@ -329,7 +330,7 @@ static void testHGVMFiltering(CuTest *testCase) {
                                       pinch.start2,
                                       pinch.length,
                                       pinch.strand,
-                                      (bool(*)(stPinchSegment *, stPinchSegment *, void *))stCaf_filterToEnsureCycleFreeIsolatedComponents, flower);
+                                      (bool(*)(stPinchSegment *, stPinchSegment *, void *))stCaf_filterToEnsureCycleFreeIsolatedComponents, &filterArgs);
             stSortedSet *threadComponents = stPinchThreadSet_getThreadComponents(threadSet);
             CuAssertTrue(testCase, stSortedSet_size(threadComponents) >= 2);
         }
@@ -348,11 +349,65 @@ static void testHGVMFiltering(CuTest *testCase) {
     }
 }
 
+// Checks the filters give the same answers using the event table as they do looking up the
+// caps of segments in the flower.
+static void testEventTable(CuTest *testCase) {
+    for (int64_t testNum = 0; testNum < 20; testNum++) {
+        setup(testCase, true);
+        addThreadToFlower(flower, ingroup1, 100);
+        addThreadToFlower(flower, ingroup1, 100);
+        addThreadToFlower(flower, ingroup2, 100);
+        addThreadToFlower(flower, outgroup1, 100);
+        addThreadToFlower(flower, outgroup2, 100);
+
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        for (int64_t i = 0; i < 100; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1),
+                                stPinchThreadSet_getThread(threadSet, pinch.name2),
+                                pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        }
+
+        FilterArgs withoutTable = { .flower = flower, .eventTable = NULL };
+        FilterArgs withTable = { .flower = flower, .eventTable = stCaf_constructEventTable(flower, threadSet) };
+        for (int64_t i = 0; i < 100; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchSegment *segment1 = stPinchThread_getSegment(stPinchThreadSet_getThread(threadSet, pinch.name1), pinch.start1);
+            stPinchSegment *segment2 = stPinchThread_getSegment(stPinchThreadSet_getThread(threadSet, pinch.name2), pinch.start2);
+            stPinchBlock *block = stPinchSegment_getBlock(segment1);
+
+            CuAssertPtrEquals(testCase, stCaf_getEvent(segment1, flower),
+                              stCafEventTable_getEvent(withTable.eventTable, segment1));
+            CuAssertIntEquals(testCase, stCaf_isOutgroup(segment1, flower),
+                              stCafEventTable_isOutgroup(withTable.eventTable, segment1));
+            CuAssertIntEquals(testCase, stCaf_filterByRepeatSpecies(segment1, segment2, &withoutTable),
+                              stCaf_filterByRepeatSpecies(segment1, segment2, &withTable));
+            CuAssertIntEquals(testCase, stCaf_singleCopyIngroup(segment1, segment2, &withoutTable),
+                              stCaf_singleCopyIngroup(segment1, segment2, &withTable));
+            CuAssertIntEquals(testCase, stCaf_filterByOutgroup(segment1, segment2, &withoutTable),
+                              stCaf_filterByOutgroup(segment1, segment2, &withTable));
+            CuAssertIntEquals(testCase, stCaf_filterByMultipleSpecies(segment1, segment2, &withoutTable),
+                              stCaf_filterByMultipleSpecies(segment1, segment2, &withTable));
+            if (block != NULL) {
+                CuAssertIntEquals(testCase, stCaf_containsRequiredSpecies(block, flower, NULL, 1, 1, 2, 2),
+                                  stCaf_containsRequiredSpecies(block, flower, withTable.eventTable, 1, 1, 2, 2));
+                CuAssertIntEquals(testCase, stCaf_numPossibleSupportingHomologies(block, flower, NULL),
+                                  stCaf_numPossibleSupportingHomologies(block, flower, withTable.eventTable));
+            }
+        }
+
+        stCaf_destructEventTable(withTable.eventTable);
+        stPinchThreadSet_destruct(threadSet);
+        teardown(testCase);
+    }
+}
+
 CuSuite* filteringTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopies);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup_noOutgroups);
     SUITE_ADD_TEST(suite, testHGVMFiltering);
+    SUITE_ADD_TEST(suite, testEventTable);
     return suite;
 }
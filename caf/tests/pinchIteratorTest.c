@@ -7,6 +7,7 @@
 #include "CuTest.h"
 #include "sonLib.h"
 #include "stPinchIterator.h"
+#include "stCaf.h"
 #include "pairwiseAlignment.h"
 #include "paf.h"
 #include <math.h>
@@ -113,8 +114,99 @@ static void testPinchIteratorFromFile(CuTest *testCase) {
     }
 }
 
+static void testPinchIteratorFromPinchCache(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random pinch iterator from pinch cache test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        //Put alignments in a file
+        char *tempFile = "tempFileForPinchIteratorTest.cig";
+        FILE *fileHandle = fopen(tempFile, "w");
+        assert(fileHandle != NULL);
+        write_pafs(fileHandle, pairwiseAlignments);
+        fclose(fileHandle);
+        //Convert them to a pinch cache
+        char *pinchCacheFile = "tempFileForPinchIteratorTest.pinches";
+        stPinchIterator *pinchIterator = stPinchIterator_constructFromFile(tempFile);
+        stPinchIterator_writePinchCache(pinchIterator, pinchCacheFile);
+        stPinchIterator_destruct(pinchIterator);
+        //Get an iterator
+        pinchIterator = stPinchIterator_constructFromPinchCache(pinchCacheFile);
+        //Now test it
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmtree(tempFile);
+        stFile_rmtree(pinchCacheFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
+static void testPinchCacheFromAlignmentsFile(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random pinch cache from alignments file test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        //Put alignments in a file
+        char *tempFile = "tempFileForPinchIteratorTest.cig";
+        FILE *fileHandle = fopen(tempFile, "w");
+        assert(fileHandle != NULL);
+        write_pafs(fileHandle, pairwiseAlignments);
+        fclose(fileHandle);
+        //Parse them straight into a pinch cache
+        char *pinchCacheFile = "tempFileForPinchIteratorTest.pinches";
+        stPinchCacheWriter *writer = stPinchCacheWriter_construct(pinchCacheFile);
+        stPinchCacheWriter_addAlignmentsFile(writer, tempFile, NULL);
+        stPinchCacheWriter_destruct(writer);
+        //Get an iterator
+        stPinchIterator *pinchIterator = stPinchIterator_constructFromPinchCache(pinchCacheFile);
+        //Now test it
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmtree(tempFile);
+        stFile_rmtree(pinchCacheFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
+static int paf_scoreCmp(const void *a, const void *b) {
+    const Paf *paf1 = a, *paf2 = b;
+    return paf1->score > paf2->score ? -1 : (paf1->score < paf2->score ? 1 : 0);
+}
+
+static void testSortAlignmentsByScore(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random sort alignments by score test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+            Paf *paf = stList_get(pairwiseAlignments, i);
+            paf->score = st_randomInt(0, 1000) * 100 + i; // Unique scores, so the sorted order is well defined
+        }
+        //Put alignments in a file
+        char *tempFile = "tempFileForPinchIteratorTest.cig";
+        FILE *fileHandle = fopen(tempFile, "w");
+        assert(fileHandle != NULL);
+        write_pafs(fileHandle, pairwiseAlignments);
+        fclose(fileHandle);
+        //Sort them into a pinch cache
+        char *pinchCacheFile = "tempFileForPinchIteratorTest.pinches";
+        stCaf_sortAlignmentsByScoreInDescendingOrder(tempFile, pinchCacheFile, NULL);
+        stPinchIterator *pinchIterator = stPinchIterator_constructFromPinchCache(pinchCacheFile);
+        //Now test it against the alignments in sorted order
+        stList_sort(pairwiseAlignments, paf_scoreCmp);
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmtree(tempFile);
+        stFile_rmtree(pinchCacheFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
 CuSuite* pinchIteratorTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testPinchIteratorFromFile);
+    SUITE_ADD_TEST(suite, testPinchIteratorFromPinchCache);
+    SUITE_ADD_TEST(suite, testPinchCacheFromAlignmentsFile);
+    SUITE_ADD_TEST(suite, testSortAlignmentsByScore);
     return suite;
 }
@@ -118,10 +118,79 @@ static void testRecoverableTelomereAdjacentChainsNotKept(CuTest *testCase) {
     cactusDisk_destruct(cactusDisk);
 }
 
+// Melting chains through a chain index over a series of increasing
+// minimum chain lengths should remove the same blocks as rebuilding the
+// cactus graph and melting for each length.
+static void pinchRandomly(stPinchThreadSet *threadSet, stList *threadNames, int64_t pinchNumber, int64_t threadLength) {
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, *(Name *)st_randomChoice(threadNames));
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, *(Name *)st_randomChoice(threadNames));
+        int64_t length = st_randomInt(1, 20);
+        int64_t start1 = st_randomInt(0, threadLength - length);
+        int64_t start2 = st_randomInt(0, threadLength - length);
+        stPinchThread_pinch(thread1, thread2, stPinchThread_getStart(thread1) + start1,
+                            stPinchThread_getStart(thread2) + start2, length, st_random() > 0.5);
+    }
+}
+
+static void testChainIndexMeltingMatchesMelting(CuTest *testCase) {
+    for (int64_t test = 0; test < 20; test++) {
+        CactusDisk *cactusDisk = cactusDisk_construct();
+        eventTree_construct2(cactusDisk);
+        Flower *flower = flower_construct2(0, cactusDisk);
+        group_construct2(flower);
+
+        int64_t threadLength = 200;
+        stList *threadNames = stList_construct3(0, free);
+        char *headers[] = { "one", "two", "three", "four" };
+        for (int64_t i = 0; i < 4; i++) {
+            Name *threadName = st_malloc(sizeof(Name));
+            *threadName = testCommon_addThreadToFlower(flower, headers[i], threadLength);
+            stList_append(threadNames, threadName);
+        }
+        int64_t minimumChainLengths[] = { 2, 5, 10, 30 };
+
+        int64_t seed = st_randomInt(0, INT32_MAX);
+        srand(seed);
+        stPinchThreadSet *threadSet1 = stCaf_setup(flower);
+        pinchRandomly(threadSet1, threadNames, 30, threadLength);
+        for (int64_t i = 0; i < 4; i++) {
+            stCaf_melt(flower, threadSet1, NULL, NULL, 0, minimumChainLengths[i], 0, INT64_MAX);
+        }
+
+        srand(seed);
+        stPinchThreadSet *threadSet2 = stCaf_setup(flower);
+        pinchRandomly(threadSet2, threadNames, 30, threadLength);
+        stCafChainIndex *chainIndex = stCaf_constructChainIndex(flower, threadSet2);
+        for (int64_t i = 0; i < 4; i++) {
+            stCaf_meltChainsLessThanGivenLength(chainIndex, minimumChainLengths[i]);
+        }
+        stCaf_destructChainIndex(chainIndex);
+
+        CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1),
+                          stPinchThreadSet_getTotalBlockNumber(threadSet2));
+        for (int64_t i = 0; i < stList_length(threadNames); i++) {
+            Name threadName = *(Name *)stList_get(threadNames, i);
+            stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet1, threadName);
+            stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet2, threadName);
+            for (int64_t j = stPinchThread_getStart(thread1); j < stPinchThread_getStart(thread1) + stPinchThread_getLength(thread1); j++) {
+                CuAssertIntEquals(testCase, stPinchSegment_getBlock(stPinchThread_getSegment(thread1, j)) != NULL,
+                                  stPinchSegment_getBlock(stPinchThread_getSegment(thread2, j)) != NULL);
+            }
+        }
+
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+        stList_destruct(threadNames);
+        cactusDisk_destruct(cactusDisk);
+    }
+}
+
 CuSuite *recoverableChainsTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testDoesNotRemoveIsolatedChain);
     SUITE_ADD_TEST(suite, testRemovesIndel);
     SUITE_ADD_TEST(suite, testRecoverableTelomereAdjacentChainsNotKept);
+    SUITE_ADD_TEST(suite, testChainIndexMeltingMatchesMelting);
     return suite;
 }
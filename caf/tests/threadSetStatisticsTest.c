@@ -0,0 +1,108 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stCaf.h"
+#include "stPinchGraphs.h"
+
+static int uint64_cmp(const uint64_t *x, const uint64_t *y) {
+    return *x < *y ? -1 : (*x > *y ? 1 : 0);
+}
+
+static int double_cmp(const double *x, const double *y) {
+    return *x < *y ? -1 : (*x > *y ? 1 : 0);
+}
+
+static void checkApproximately(CuTest *testCase, uint64_t expected, uint64_t value) {
+    if (expected < 64) {
+        CuAssertIntEquals(testCase, expected, value);
+    } else {
+        CuAssertTrue(testCase, value <= expected && value >= expected - expected / 32);
+    }
+}
+
+// Compare the histogram based statistics against sorting the values of every block.
+static void testThreadSetStatistics(CuTest *testCase) {
+    for (int64_t test = 0; test < 20; test++) {
+        CactusDisk *cactusDisk = cactusDisk_construct();
+        eventTree_construct2(cactusDisk);
+        Flower *flower = flower_construct2(0, cactusDisk);
+        group_construct2(flower);
+
+        int64_t threadNumber = st_randomInt(2, 10);
+        stList *threadNames = stList_construct3(0, free);
+        for (int64_t i = 0; i < threadNumber; i++) {
+            char *header = stString_print("thread%" PRIi64, i);
+            Name *threadName = st_malloc(sizeof(Name));
+            *threadName = testCommon_addThreadToFlower(flower, header, 1000);
+            stList_append(threadNames, threadName);
+            free(header);
+        }
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        int64_t pinchNumber = st_randomInt(0, 200);
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, *(Name *)st_randomChoice(threadNames));
+            stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, *(Name *)st_randomChoice(threadNames));
+            int64_t length = st_randomInt(1, 100);
+            stPinchThread_pinch(thread1, thread2, stPinchThread_getStart(thread1) + 1 + st_randomInt(0, 1000 - length),
+                                stPinchThread_getStart(thread2) + 1 + st_randomInt(0, 1000 - length), length,
+                                st_random() > 0.5);
+        }
+
+        // Get the exact values
+        uint64_t blockNumber = stPinchThreadSet_getTotalBlockNumber(threadSet);
+        uint64_t *degrees = st_malloc(sizeof(uint64_t) * (blockNumber + 1));
+        uint64_t *alignedBases = st_malloc(sizeof(uint64_t) * (blockNumber + 1));
+        double *supports = st_malloc(sizeof(double) * (blockNumber + 1));
+        uint64_t totalAlignedBases = 0;
+        stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+        stPinchBlock *block;
+        int64_t i = 0;
+        while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+            degrees[i] = stPinchBlock_getDegree(block);
+            alignedBases[i] = stPinchBlock_getDegree(block) * stPinchBlock_getLength(block);
+            uint64_t possibleSupportingHomologies = stCaf_numPossibleSupportingHomologies(block, flower, NULL);
+            supports[i] = possibleSupportingHomologies == 0 ? 0.0 :
+                    ((double) stPinchBlock_getNumSupportingHomologies(block)) / possibleSupportingHomologies;
+            totalAlignedBases += alignedBases[i++];
+        }
+        qsort(degrees, blockNumber, sizeof(uint64_t), (int (*)(const void *, const void *)) uint64_cmp);
+        qsort(alignedBases, blockNumber, sizeof(uint64_t), (int (*)(const void *, const void *)) uint64_cmp);
+        qsort(supports, blockNumber, sizeof(double), (int (*)(const void *, const void *)) double_cmp);
+
+        stCafThreadSetStatistics *stats = stCaf_getThreadSetStatistics(threadSet, flower);
+        CuAssertIntEquals(testCase, blockNumber, stCafThreadSetStatistics_getBlockNumber(stats));
+        CuAssertIntEquals(testCase, totalAlignedBases, stCafThreadSetStatistics_getTotalAlignedBases(stats));
+        double quantiles[] = { 0.0, 0.1, 0.5, 0.9, 1.0 };
+        for (int64_t j = 0; j < 5 && blockNumber > 0; j++) {
+            uint64_t rank = quantiles[j] * (blockNumber - 1);
+            checkApproximately(testCase, degrees[rank], stCafThreadSetStatistics_getDegreeQuantile(stats, quantiles[j]));
+            checkApproximately(testCase, alignedBases[rank],
+                               stCafThreadSetStatistics_getAlignedBasesQuantile(stats, quantiles[j]));
+            CuAssertDblEquals(testCase, supports[rank], stCafThreadSetStatistics_getSupportQuantile(stats, quantiles[j]),
+                              0.001);
+        }
+        // The extremes are exact
+        if (blockNumber > 0) {
+            CuAssertIntEquals(testCase, alignedBases[0], stCafThreadSetStatistics_getAlignedBasesQuantile(stats, 0.0));
+            CuAssertIntEquals(testCase, alignedBases[blockNumber - 1],
+                              stCafThreadSetStatistics_getAlignedBasesQuantile(stats, 1.0));
+        }
+
+        stCafThreadSetStatistics_destruct(stats);
+        free(degrees);
+        free(alignedBases);
+        free(supports);
+        stList_destruct(threadNames);
+        stPinchThreadSet_destruct(threadSet);
+        cactusDisk_destruct(cactusDisk);
+    }
+}
+
+CuSuite* threadSetStatisticsTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testThreadSetStatistics);
+    return suite;
+}
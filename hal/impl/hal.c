@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <stdarg.h>
 
 #include "cactus.h"
 #include "sonLib.h"
@@ -75,18 +76,177 @@ static Name globalReferenceEventName;
  * alignmentOrientation :
  *      0
  *      1
+ *
+ * The binary .c2h variant holds the same sequences and segments, but as a stream of tagged records of
+ * unsigned LEB128 varints (seven bits per byte, least significant group first, the high bit set on all but the
+ * last byte), with each value v stored as v + 1. This makes every record free of zero bytes, so records can
+ * still be handled as C strings by the thread builder, while being a fraction of the size of the decimal text.
+ *
+ * binaryFile :
+ *      "c2hb" version binarySequences
+ *
+ * version :
+ *      varint(1)
+ *
+ * binarySequence :
+ *      's' varint(length(eventHeader)) eventHeader varint(length(sequenceHeader)) sequenceHeader varint(isBottom)
+ *      binarySegments
+ *
+ * binarySegment :
+ *      #Bottom segment
+ *      'b' varint(segmentName) varint(start) varint(length)
+ *      #Top segment with a parent
+ *      't' varint(start) varint(length) varint(parentSegment) varint(alignmentOrientation)
+ *      #Top segment that was an insertion
+ *      'i' varint(start) varint(length)
+ */
+
+#define C2H_BINARY_VERSION 1
+#define MAX_BINARY_RECORD_LENGTH (1 + 4 * 10 + 1) // Tag, up to four 10 byte varints and a terminating zero
+
+static int64_t writeVarint(char *buffer, int64_t value) {
+    assert(value >= 0);
+    uint64_t i = ((uint64_t)value) + 1;
+    int64_t length = 0;
+    while (i >= 0x80) {
+        buffer[length++] = (char)((i & 0x7F) | 0x80);
+        i >>= 7;
+    }
+    buffer[length++] = (char)i;
+    return length;
+}
+
+/*
+ * Makes a binary record from the tag and values, which are terminated by a -1.
  */
+static char *binaryRecord(char tag, ...) {
+    char *record = st_malloc(MAX_BINARY_RECORD_LENGTH);
+    int64_t length = 0;
+    record[length++] = tag;
+    va_list args;
+    va_start(args, tag);
+    int64_t value;
+    while ((value = va_arg(args, int64_t)) != -1) {
+        length += writeVarint(record + length, value);
+        assert(length < MAX_BINARY_RECORD_LENGTH);
+    }
+    va_end(args);
+    record[length] = '\0';
+    return record;
+}
 
-static void writeSequenceHeader(FILE *fileHandle, Sequence *sequence) {
+/*
+ * Reads a varint, returning -1 if the file ends before it starts. A file ending inside the varint is an error.
+ */
+static int64_t readVarint(FILE *fileHandle) {
+    uint64_t i = 0;
+    int64_t shift = 0;
+    int c;
+    while ((c = fgetc(fileHandle)) != EOF) {
+        if (shift > 63) {
+            st_errAbort("Varint too long in binary c2h file");
+        }
+        i |= ((uint64_t)(c & 0x7F)) << shift;
+        shift += 7;
+        if (!(c & 0x80)) {
+            if (i == 0) {
+                st_errAbort("Zero varint in binary c2h file");
+            }
+            return (int64_t)(i - 1);
+        }
+    }
+    if (shift > 0) {
+        st_errAbort("Binary c2h file ends inside a varint");
+    }
+    return -1;
+}
+
+static int64_t readRecordVarint(FILE *fileHandle) {
+    int64_t value = readVarint(fileHandle);
+    if (value == -1) {
+        st_errAbort("Binary c2h file ends inside a record");
+    }
+    return value;
+}
+
+static char *readBinaryString(FILE *fileHandle) {
+    int64_t length = readRecordVarint(fileHandle);
+    char *string = st_malloc(length + 1);
+    if (fread(string, sizeof(char), length, fileHandle) != length) {
+        st_errAbort("Binary c2h file ends inside a string");
+    }
+    string[length] = '\0';
+    return string;
+}
+
+static void writeBinaryString(FILE *fileHandle, const char *string) {
+    char buffer[10];
+    int64_t length = strlen(string);
+    fwrite(buffer, sizeof(char), writeVarint(buffer, length), fileHandle);
+    fwrite(string, sizeof(char), length, fileHandle);
+}
+
+static void writeSequenceHeader(FILE *fileHandle, Sequence *sequence, bool binary) {
     //s eventName sequenceName isBottom
     Event *event = sequence_getEvent(sequence);
     assert(event != NULL);
     assert(event_getHeader(event) != NULL);
     assert(sequence_getHeader(sequence) != NULL);
+    if (binary) {
+        char buffer[10];
+        fputc('s', fileHandle);
+        writeBinaryString(fileHandle, event_getHeader(event));
+        writeBinaryString(fileHandle, sequence_getHeader(sequence));
+        fwrite(buffer, sizeof(char), writeVarint(buffer, event_getName(event) == globalReferenceEventName), fileHandle);
+        return;
+    }
     fprintf(fileHandle, "s\t'%s'\t'%s'\t%i\n", event_getHeader(event), sequence_getHeader(sequence),
             event_getName(event) == globalReferenceEventName);
 }
 
+static char *writeBinaryTerminalAdjacency(Cap *cap, void *extraArg) {
+    Cap *adjacentCap = cap_getAdjacency(cap);
+    assert(adjacentCap != NULL);
+    int64_t adjacencyLength = cap_getCoordinate(adjacentCap) - cap_getCoordinate(cap) - 1;
+    assert(adjacencyLength >= 0);
+    if (adjacencyLength > 0) {
+        Sequence *sequence = cap_getSequence(cap);
+        assert(sequence != NULL);
+        assert(cap_getEvent(cap) != NULL);
+        int64_t start = cap_getCoordinate(cap) + 1 - sequence_getStart(sequence);
+        if (event_getName(cap_getEvent(cap)) == globalReferenceEventName) {
+            return binaryRecord('b', cap_getName(cap), start, adjacencyLength, (int64_t)-1);
+        }
+        return binaryRecord('i', start, adjacencyLength, (int64_t)-1);
+    }
+    else {
+        return stString_copy("");
+    }
+}
+
+static char *writeBinarySegment(Segment *segment, void *extraArg) {
+    Block *block = segment_getBlock(segment);
+    Segment *referenceSegment = block_getSegmentForEvent(block, globalReferenceEventName);
+    if (referenceSegment == NULL) {
+        Cap *cap5 = segment_get5Cap(segment);
+        Cap *cap3 = segment_get3Cap(segment);
+        Sequence *sequence = cap_getSequence(cap5);
+        return binaryRecord('i', cap_getCoordinate(cap5) - sequence_getStart(sequence),
+                            cap_getCoordinate(cap3) - cap_getCoordinate(cap5) + 1, (int64_t)-1);
+    }
+    Sequence *sequence = segment_getSequence(segment);
+    assert(sequence != NULL);
+    Name eventName = event_getName(segment_getEvent(segment));
+    if (referenceSegment != segment && eventName != globalReferenceEventName) { //Is a top segment
+        return binaryRecord('t', segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment),
+                            segment_getName(referenceSegment), (int64_t)segment_getStrand(referenceSegment), (int64_t)-1);
+    } else {
+        //Is a bottom segment
+        return binaryRecord('b', segment_getName(segment), segment_getStart(segment) - sequence_getStart(sequence),
+                            segment_getLength(segment), (int64_t)-1);
+    }
+}
+
 static char *writeTerminalAdjacency(Cap *cap, void *extraArg) {
     //a start length reference-segment block-orientation
     Cap *adjacentCap = cap_getAdjacency(cap);
@@ -180,7 +340,7 @@ void makeHalFormat(Flower *flower, stKVDatabase *database, Name referenceEventNa
             Cap *cap = stList_get(caps, i);
             if(!sequence_isTrivialSequence(cap_getSequence(cap))) {
                 char *threadString = stList_get(threadStrings, i);
-                writeSequenceHeader(fileHandle, cap_getSequence(cap));
+                writeSequenceHeader(fileHandle, cap_getSequence(cap), 0);
                 fprintf(fileHandle, "%s\n", threadString);
             }
         }
@@ -188,23 +348,85 @@ void makeHalFormat(Flower *flower, stKVDatabase *database, Name referenceEventNa
     stList_destruct(caps);
 }
 
-void makeHalFormatNoDb(Flower *flower, RecordHolder *rh, Name referenceEventName, FILE *fileHandle) {
+static bool startThread(Cap *cap, FILE *fileHandle, void *extraArg) {
+    if (sequence_isTrivialSequence(cap_getSequence(cap))) {
+        return 0;
+    }
+    writeSequenceHeader(fileHandle, cap_getSequence(cap), *(bool *)extraArg);
+    return 1;
+}
+
+static void endThread(Cap *cap, FILE *fileHandle, void *extraArg) {
+    fputc('\n', fileHandle);
+}
+
+void makeHalFormatNoDb(Flower *flower, RecordHolder *rh, Name referenceEventName, bool binary, FILE *fileHandle) {
     globalReferenceEventName = referenceEventName;
+    char *(*segmentWriteFn)(Segment *, void *) = binary ? writeBinarySegment : writeSegment;
+    char *(*terminalAdjacencyWriteFn)(Cap *, void *) = binary ? writeBinaryTerminalAdjacency : writeTerminalAdjacency;
     stList *caps = getCaps(flower);
     if (fileHandle == NULL) {
-        buildRecursiveThreadsNoDb(rh, caps, writeSegment, writeTerminalAdjacency, NULL);
+        buildRecursiveThreadsNoDb(rh, caps, segmentWriteFn, terminalAdjacencyWriteFn, NULL);
     } else {
-        stList *threadStrings = buildRecursiveThreadsInListNoDb(rh, caps, writeSegment, writeTerminalAdjacency, NULL);
-        assert(stList_length(threadStrings) == stList_length(caps));
-        for (int64_t i = 0; i < stList_length(threadStrings); i++) {
-            Cap *cap = stList_get(caps, i);
-            if(!sequence_isTrivialSequence(cap_getSequence(cap))) {
-                char *threadString = stList_get(threadStrings, i);
-                writeSequenceHeader(fileHandle, cap_getSequence(cap));
-                fprintf(fileHandle, "%s\n", threadString);
-            }
+        if (binary) {
+            char buffer[10];
+            fputs("c2hb", fileHandle);
+            fwrite(buffer, sizeof(char), writeVarint(buffer, C2H_BINARY_VERSION), fileHandle);
         }
-        stList_destruct(threadStrings);
+        // Stream the threads record by record, rather than building each as one (potentially huge) string
+        writeRecursiveThreadsNoDb(rh, caps, segmentWriteFn, terminalAdjacencyWriteFn, &binary,
+                                  startThread, binary ? NULL : endThread, fileHandle);
     }
     stList_destruct(caps);
-}
\ No newline at end of file
+}
+
+void convertBinaryC2hToText(FILE *binaryFileHandle, FILE *textFileHandle) {
+    char magic[4];
+    if (fread(magic, sizeof(char), 4, binaryFileHandle) != 4 || memcmp(magic, "c2hb", 4) != 0) {
+        st_errAbort("Binary c2h file does not start with c2hb");
+    }
+    int64_t version = readVarint(binaryFileHandle);
+    if (version != C2H_BINARY_VERSION) {
+        st_errAbort("Unsupported binary c2h version: %" PRIi64, version);
+    }
+    bool inSequence = 0;
+    int tag;
+    while ((tag = fgetc(binaryFileHandle)) != EOF) {
+        if (tag != 's' && !inSequence) {
+            st_errAbort("Binary c2h segment record before the first sequence record");
+        }
+        if (tag == 's') {
+            if (inSequence) {
+                fputc('\n', textFileHandle); // The blank line ending each thread of the text format
+            }
+            char *eventHeader = readBinaryString(binaryFileHandle);
+            char *sequenceHeader = readBinaryString(binaryFileHandle);
+            int64_t isBottom = readRecordVarint(binaryFileHandle);
+            fprintf(textFileHandle, "s\t'%s'\t'%s'\t%i\n", eventHeader, sequenceHeader, (int)isBottom);
+            free(eventHeader);
+            free(sequenceHeader);
+            inSequence = 1;
+        } else if (tag == 'b') {
+            int64_t segmentName = readRecordVarint(binaryFileHandle);
+            int64_t start = readRecordVarint(binaryFileHandle);
+            int64_t length = readRecordVarint(binaryFileHandle);
+            fprintf(textFileHandle, "a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", segmentName, start, length);
+        } else if (tag == 't') {
+            int64_t start = readRecordVarint(binaryFileHandle);
+            int64_t length = readRecordVarint(binaryFileHandle);
+            int64_t parentSegment = readRecordVarint(binaryFileHandle);
+            int64_t orientation = readRecordVarint(binaryFileHandle);
+            fprintf(textFileHandle, "a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", start, length,
+                    parentSegment, orientation);
+        } else if (tag == 'i') {
+            int64_t start = readRecordVarint(binaryFileHandle);
+            int64_t length = readRecordVarint(binaryFileHandle);
+            fprintf(textFileHandle, "a\t%" PRIi64 "\t%" PRIi64 "\n", start, length);
+        } else {
+            st_errAbort("Unknown record tag in binary c2h file: %i", tag);
+        }
+    }
+    if (inSequence) {
+        fputc('\n', textFileHandle);
+    }
+}
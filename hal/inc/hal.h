@@ -15,7 +15,17 @@
 void makeHalFormat(Flower *flower, stKVDatabase *database, Name referenceEventName,
                    FILE *fileHandle);
 
-void makeHalFormatNoDb(Flower *flower, RecordHolder *rh, Name referenceEventName, FILE *fileHandle);
+/*
+ * Makes the c2h records of the flower's threads, adding them to rh. If fileHandle is not NULL (the root flower) the
+ * threads are written to it instead. If binary is set the compact binary c2h format is used (see hal.c).
+ */
+void makeHalFormatNoDb(Flower *flower, RecordHolder *rh, Name referenceEventName, bool binary, FILE *fileHandle);
+
+/*
+ * Decodes a binary c2h file, as written by makeHalFormatNoDb with binary set, writing the equivalent text c2h file.
+ * Aborts if the binary file is malformed.
+ */
+void convertBinaryC2hToText(FILE *binaryFileHandle, FILE *textFileHandle);
 
 void printFastaSequences(Flower *flower, FILE *fileHandle, Name referenceEventName);
 
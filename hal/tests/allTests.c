@@ -10,10 +10,12 @@
 #include <string.h>
 #include "sonLib.h"
 
+CuSuite* halTestSuite(void);
 
 int halGeneratorAllTests(void) {
 	CuString *output = CuStringNew();
 	CuSuite* suite = CuSuiteNew();
+	CuSuiteAddSuite(suite, halTestSuite());
 	CuSuiteRun(suite);
 	CuSuiteSummary(suite, output);
 	CuSuiteDetails(suite, output);
@@ -0,0 +1,97 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "cactus.h"
+#include "hal.h"
+
+/*
+ * Makes a flower with a block aligning a reference sequence and a leaf sequence, and a second leaf sequence with no
+ * segments, so the threads contain sequence, bottom, top and insertion records.
+ */
+static Flower *makeFlower(CactusDisk *cactusDisk, Event **referenceEvent) {
+    EventTree *eventTree = eventTree_construct2(cactusDisk);
+    *referenceEvent = eventTree_getRootEvent(eventTree);
+    Event *leafEvent = event_construct3("leaf", 1.0, *referenceEvent, eventTree);
+    Flower *flower = flower_construct(cactusDisk);
+    End *end1 = end_construct2(0, 1, flower);
+    End *end2 = end_construct2(1, 1, flower);
+    Block *block = block_construct(2, flower);
+
+    Sequence *referenceSequence = sequence_construct(1, 6, "ACGTAC", "reference", *referenceEvent, cactusDisk);
+    Sequence *leafSequence = sequence_construct(1, 6, "ACGTTC", "leaf1", leafEvent, cactusDisk);
+    Sequence *leafSequence2 = sequence_construct(1, 4, "GGCC", "leaf2", leafEvent, cactusDisk);
+    Sequence *sequences[2] = { referenceSequence, leafSequence };
+    for (int64_t i = 0; i < 2; i++) {
+        flower_addSequence(flower, sequences[i]);
+        Cap *cap1 = cap_construct2(end1, 0, 1, sequences[i]);
+        Cap *cap2 = cap_construct2(end2, 7, 1, sequences[i]);
+        Segment *segment = segment_construct2(block, 3, 1, sequences[i]);
+        cap_makeAdjacent(cap1, segment_get5Cap(segment));
+        cap_makeAdjacent(segment_get3Cap(segment), cap2);
+    }
+    flower_addSequence(flower, leafSequence2);
+    cap_makeAdjacent(cap_construct2(end1, 0, 1, leafSequence2), cap_construct2(end2, 5, 1, leafSequence2));
+
+    Group *group = group_construct2(flower);
+    End *end;
+    Flower_EndIterator *endIt = flower_getEndIterator(flower);
+    while ((end = flower_getNextEnd(endIt)) != NULL) {
+        end_setGroup(end, group);
+    }
+    flower_destructEndIterator(endIt);
+    return flower;
+}
+
+static void testBinaryC2hMatchesText(CuTest *testCase) {
+    CactusDisk *cactusDisk = cactusDisk_construct();
+    Event *referenceEvent;
+    Flower *flower = makeFlower(cactusDisk, &referenceEvent);
+
+    // Write the cactus both ways
+    FILE *textFileHandle = tmpfile();
+    RecordHolder *rh = recordHolder_construct();
+    makeHalFormatNoDb(flower, rh, event_getName(referenceEvent), 0, textFileHandle);
+    recordHolder_destruct(rh);
+    FILE *binaryFileHandle = tmpfile();
+    rh = recordHolder_construct();
+    makeHalFormatNoDb(flower, rh, event_getName(referenceEvent), 1, binaryFileHandle);
+    recordHolder_destruct(rh);
+
+    // Decode the binary file
+    FILE *decodedFileHandle = tmpfile();
+    rewind(binaryFileHandle);
+    convertBinaryC2hToText(binaryFileHandle, decodedFileHandle);
+
+    // The decoded file should match the text file record for record
+    rewind(textFileHandle);
+    rewind(decodedFileHandle);
+    int64_t sequenceRecords = 0, segmentRecords = 0;
+    char *line;
+    while ((line = stFile_getLineFromFile(textFileHandle)) != NULL) {
+        char *decodedLine = stFile_getLineFromFile(decodedFileHandle);
+        CuAssertTrue(testCase, decodedLine != NULL);
+        CuAssertStrEquals(testCase, line, decodedLine);
+        sequenceRecords += line[0] == 's';
+        segmentRecords += line[0] == 'a';
+        free(line);
+        free(decodedLine);
+    }
+    CuAssertTrue(testCase, stFile_getLineFromFile(decodedFileHandle) == NULL);
+    // Three sequences; two segments and two terminal adjacencies in each aligned sequence and one insertion
+    CuAssertIntEquals(testCase, 3, sequenceRecords);
+    CuAssertIntEquals(testCase, 7, segmentRecords);
+
+    fclose(textFileHandle);
+    fclose(binaryFileHandle);
+    fclose(decodedFileHandle);
+    cactusDisk_destruct(cactusDisk);
+}
+
+CuSuite* halTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testBinaryC2hMatchesText);
+    return suite;
+}
@@ -15,6 +15,7 @@
 #include "blockMLString.h"
 #include "hal.h"
 #include "convertAlignmentCoordinates.h"
+#include "resourceEstimate.h"
 
 // OpenMP
 #if defined(_OPENMP)
@@ -45,67 +46,106 @@ void usage() {
     fprintf(stderr, "-r --referenceEvent : [Required] The name of the reference event\n");
     fprintf(stderr, "-t --runChecks : Run cactus checks after each stage, used for debugging\n");
     fprintf(stderr, "-T --threads : (int > 0) Use up to this many threads [default: all available]\n");
+    fprintf(stderr, "-j --statsFile : Write a JSON report of the time and memory used by each stage to this file\n");
+    fprintf(stderr, "-C --checkpointDir : Write snapshots of the cactus disk after CAF and after BAR to caf.snapshot and bar.snapshot in this directory\n");
+    fprintf(stderr, "-R --resumeFrom : Resume from a snapshot written with --checkpointDir, skipping the stages it was taken after\n");
+    fprintf(stderr, "-b --binaryC2h : Write the output file in the compact binary c2h format instead of text\n");
+    fprintf(stderr, "-m --reclaimMemory : Free the flowers and sequence strings as the hal and fasta stages finish with them, and clean up before exiting\n");
+    fprintf(stderr, "-E --estimateResources : Print a JSON prediction of the peak memory and core hours of each stage, without running them (--outputFile is not needed)\n");
     fprintf(stderr, "-h --help : Print this help message\n");
 }
 
-static char *convertAlignments(char *alignmentsFile, Flower *flower) {
-    char *tempFile = getTempFile();
-    convertAlignmentCoordinates(alignmentsFile, tempFile, flower);
-    return tempFile;
+static void callBottomUp(Flower *flower, RecordHolder *rh, void *extraArg) {
+    bottomUpNoDb(flower, rh, (Name)extraArg, 0, generateJukesCantorMatrix);
 }
 
-static RecordHolder *getMergedRecordHolders(stHash *recordHolders, Flower *flower) {
-    stList *children = stList_construct();
-    getChildFlowers(flower, children);
-    RecordHolder *rh = recordHolder_construct();
-    for(int64_t i=0; i<stList_length(children); i++) {
-        RecordHolder *rh2 = stHash_search(recordHolders, stList_get(children, i));
-        assert(rh2 != NULL);
-        recordHolder_transferAll(rh, rh2);
-    }
-    stList_destruct(children);
-    return rh;
+typedef struct _halArgs {
+    Name referenceEventName;
+    bool binary;
+} HalArgs;
+
+static void callHalFn(Flower *flower, RecordHolder *rh, void *extraArg) {
+    HalArgs *halArgs = extraArg;
+    makeHalFormatNoDb(flower, rh, halArgs->referenceEventName, halArgs->binary, NULL);
 }
 
-static void callBottomUp(Flower *flower, RecordHolder *rh, void *extraArg) {
-    bottomUpNoDb(flower, rh, (Name)extraArg, 0, generateJukesCantorMatrix);
+static void callHalAndDestructFn(Flower *flower, RecordHolder *rh, void *extraArg) {
+    callHalFn(flower, rh, extraArg);
+    // The flower's records are now in rh and its children are already gone, so it is no longer needed.
+    // The parent group is left marked as a non-leaf, as the thread building for the parent relies on it.
+    flower_destruct(flower, 0, 0);
 }
 
-static void callHalFn(Flower *flower, RecordHolder *rh, void *extraArg) {
-    makeHalFormatNoDb(flower, rh, (Name)extraArg, NULL);
+/*
+ * Frees the strings of the sequences in the flower that will not be written to the hal fasta file
+ * (if keepHalFastaSequences is set) or to the reference file (if keepReferenceSequences is set).
+ */
+static void freeSequenceStrings(Flower *flower, bool keepHalFastaSequences, bool keepReferenceSequences,
+                                char *referenceEventString) {
+    Flower_SequenceIterator *seqIt = flower_getSequenceIterator(flower);
+    Sequence *sequence;
+    int64_t freedBases = 0;
+    while ((sequence = flower_getNextSequence(seqIt)) != NULL) {
+        if (keepHalFastaSequences && !sequence_isTrivialSequence(sequence)) {
+            continue;
+        }
+        if (keepReferenceSequences && strcmp(event_getHeader(sequence_getEvent(sequence)), referenceEventString) == 0) {
+            continue;
+        }
+        sequence_freeString(sequence);
+        freedBases += sequence_getLength(sequence);
+    }
+    flower_destructSequenceIterator(seqIt);
+    st_logInfo("Freed the strings of %" PRIi64 " bases\n", freedBases);
 }
 
-static RecordHolder *doBottomUpTraversal(stList *flowerLayers,
-                                         void (*bottomUpFn)(Flower *, RecordHolder *, void *), void *extraArgs) {
-    // Bottom-up reference coordinates phase
-    stHash *recordHolders = stHash_construct();
-    for(int64_t i=stList_length(flowerLayers)-1; i>0 ; i--) {
-        stList *flowers = stList_get(flowerLayers, i);
+static void callMakeReference(Flower *flower, void *extraArg) {
+    double startTime = cactusStats_getWallTime();
+    cactus_make_reference_for_flower(flower, (ReferenceParameters *)extraArg);
+    cactusStats_recordFlowerTime("reference", startTime);
+}
 
-        // List to keep the RecordHolder for each flower
-        stList *recordHoldersForFlowers = stList_construct3(stList_length(flowers), NULL);
+static void callTopDown(Flower *flower, void *extraArg) {
+    topDown(flower, (Name)extraArg);
+}
 
-#if defined(_OPENMP)
-#pragma omp parallel for schedule(dynamic)
-#endif
-        for (int64_t j = 0; j < stList_length(flowers); j++) {
-            stList_set(recordHoldersForFlowers, j, getMergedRecordHolders(recordHolders, stList_get(flowers, j)));
-            bottomUpFn(stList_get(flowers, j), stList_get(recordHoldersForFlowers, j), extraArgs);
-        }
+static void writeCheckpoint(CactusDisk *cactusDisk, Flower *flower, const char *checkpointDir, const char *stage) {
+    char *snapshotFile = stString_print("%s/%s.snapshot", checkpointDir, stage);
+    cactusStats_startStage("checkpoint", -1);
+    cactusSnapshot_write(cactusDisk, flower, stage, snapshotFile);
+    cactusStats_endStage();
+    st_logInfo("Wrote the snapshot taken after %s to %s\n", stage, snapshotFile);
+    free(snapshotFile);
+}
 
-        // Make new map of flowers in the layer to RecordHolders
-        stHash_destruct(recordHolders);
-        recordHolders = stHash_construct();
-        for (int64_t j = 0; j < stList_length(flowers); j++) {
-            stHash_insert(recordHolders, stList_get(flowers, j), stList_get(recordHoldersForFlowers, j));
-        }
-        stList_destruct(recordHoldersForFlowers);
+typedef struct _bottomUpArgs {
+    Flower *rootFlower;
+    void (*bottomUpFn)(Flower *, RecordHolder *, void *);
+    void *extraArgs;
+} BottomUpArgs;
+
+/*
+ * Merges the records of the children, in order, then calls the function on the flower.
+ * The function is not called on the root; its merged records are returned by the traversal.
+ */
+static void *mergeRecordsAndCallBottomUpFn(Flower *flower, stList *childRecordHolders, void *extraArg) {
+    BottomUpArgs *args = extraArg;
+    RecordHolder *rh = recordHolder_construct();
+    for (int64_t i = 0; i < stList_length(childRecordHolders); i++) {
+        recordHolder_transferAll(rh, stList_get(childRecordHolders, i)); // Also destructs the child's holder
+    }
+    if (flower != args->rootFlower) {
+        args->bottomUpFn(flower, rh, args->extraArgs);
     }
-    RecordHolder *rh = getMergedRecordHolders(recordHolders, stList_get(stList_get(flowerLayers, 0), 0));
-    stHash_destruct(recordHolders);
     return rh;
 }
 
+static RecordHolder *doBottomUpTraversal(Flower *rootFlower,
+                                         void (*bottomUpFn)(Flower *, RecordHolder *, void *), void *extraArgs) {
+    BottomUpArgs args = { rootFlower, bottomUpFn, extraArgs };
+    return traverseFlowersBottomUp(rootFlower, mergeRecordsAndCallBottomUpFn, &args);
+}
+
 // check if a reference fasta was provided with the --sequences option
 // if it was, then we don't need to run the reference phase
 static bool refSequenceProvided(char *sequenceFilesAndEvents, char *referenceEventString) {
@@ -122,12 +162,6 @@ static bool refSequenceProvided(char *sequenceFilesAndEvents, char *referenceEve
     return found_ref;
 }
 
-int flower_sizeCmpFn(const void *a, const void *b) {
-    // Sort by number of caps the flowers contains
-    int64_t i = flower_getCapNumber((Flower *)a), j = flower_getCapNumber((Flower *)b);
-    return i < j ? 1 : (i > j ? -1 : 0); // Sort in descending order
-}
-
 int main(int argc, char *argv[]) {
     time_t startTime = time(NULL);
 
@@ -146,7 +180,13 @@ int main(int argc, char *argv[]) {
     char *speciesTree = NULL;
     char *outgroupEvents = NULL;
     char *referenceEventString = NULL;
+    char *statsFile = NULL;
+    char *checkpointDir = NULL;
+    char *resumeFrom = NULL;
     bool runChecks = 0;
+    bool estimateResources = 0;
+    bool reclaimMemory = 0;
+    bool binaryC2h = 0;
 
     ///////////////////////////////////////////////////////////////////////////
     // (0) Parse the inputs handed by genomeCactus.py / setup stuff.
@@ -176,11 +216,17 @@ int main(int argc, char *argv[]) {
                 { "referenceEvent", required_argument, 0, 'r' },
                 { "runChecks", no_argument, 0, 't' },
                 { "threads", required_argument, 0, 'T' }, 
+                { "statsFile", required_argument, 0, 'j' },
+                { "checkpointDir", required_argument, 0, 'C' },
+                { "resumeFrom", required_argument, 0, 'R' },
+                { "estimateResources", no_argument, 0, 'E' },
+                { "reclaimMemory", no_argument, 0, 'm' },
+                { "binaryC2h", no_argument, 0, 'b' },
                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int64_t key = getopt_long(argc, argv, "l:p:s:a:S:c:g:o:hr:F:G:tT:", long_options, &option_index);
+        int64_t key = getopt_long(argc, argv, "l:p:s:a:S:c:g:o:hr:F:G:tT:j:C:R:Emb", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -234,6 +280,24 @@ int main(int argc, char *argv[]) {
                 omp_set_num_threads(num_threads);
                 break;
             }
+            case 'j':
+                statsFile = optarg;
+                break;
+            case 'C':
+                checkpointDir = optarg;
+                break;
+            case 'R':
+                resumeFrom = optarg;
+                break;
+            case 'E':
+                estimateResources = 1;
+                break;
+            case 'm':
+                reclaimMemory = 1;
+                break;
+            case 'b':
+                binaryC2h = 1;
+                break;
             case 'h':
                 usage();
                 return 0;
@@ -250,7 +314,7 @@ int main(int argc, char *argv[]) {
     if (paramsFile == NULL) {
         st_errAbort("must supply --params (-p)");
     }
-    if (outputFile == NULL) {
+    if (outputFile == NULL && !estimateResources) {
         st_errAbort("must supply --outputFile (-f))");
     }
     if (sequenceFilesAndEvents == NULL) {
@@ -287,32 +351,74 @@ int main(int argc, char *argv[]) {
     st_logInfo("Species tree: %s\n", speciesTree);
     st_logInfo("Outgroup events: %s\n", outgroupEvents);
     st_logInfo("Reference event: %s\n", referenceEventString);
+    st_logInfo("Stats file: %s\n", statsFile);
+    st_logInfo("Checkpoint directory: %s\n", checkpointDir);
+    st_logInfo("Resume from: %s\n", resumeFrom);
+    st_logInfo("Reclaim memory: %i\n", (int)reclaimMemory);
+    st_logInfo("Binary c2h: %i\n", (int)binaryC2h);
+
+    if (statsFile != NULL) {
+        cactusStats_enable();
+    }
 
     //////////////////////////////////////////////
     //Parse stuff
     //////////////////////////////////////////////
 
+    cactusStats_startStage("setup", -1);
+
     // Load the params file
     CactusParams *params = cactusParams_load(paramsFile);
     st_logInfo("Loaded the parameters files, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
-    // Load the cactus disk
-    CactusDisk *cactusDisk = cactusDisk_construct();
+    if (estimateResources) {
+        // Predict the resources needed from the inputs and exit, without building anything
+        stList *alignmentFiles = stList_construct();
+        stList_append(alignmentFiles, alignmentsFile);
+        if (secondaryAlignmentsFile != NULL) {
+            stList_append(alignmentFiles, secondaryAlignmentsFile);
+        }
+        if (constraintAlignmentsFile != NULL) {
+            stList_append(alignmentFiles, constraintAlignmentsFile);
+        }
+        resourceEstimate_write(stdout, params, sequenceFilesAndEvents, alignmentFiles, omp_get_max_threads());
+        stList_destruct(alignmentFiles);
+        cactusParams_destruct(params);
+        return 0;
+    }
 
-    st_logInfo("Set up the cactus disk, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+    CactusDisk *cactusDisk;
+    Flower *flower;
+    char *resumedStage = NULL; // The stage the snapshot being resumed from was taken after, if any
+    if (resumeFrom != NULL) {
+        // Load the cactus disk from the snapshot
+        cactusDisk = cactusSnapshot_load(resumeFrom, &flower, &resumedStage);
+        if (strcmp(resumedStage, "caf") != 0 && strcmp(resumedStage, "bar") != 0) {
+            st_errAbort("Can not resume from a snapshot taken after stage %s", resumedStage);
+        }
+        st_logInfo("Loaded the snapshot taken after %s, %" PRIi64 " seconds have elapsed\n", resumedStage,
+                   time(NULL) - startTime);
+    } else {
+        // Load the cactus disk
+        cactusDisk = cactusDisk_construct();
 
-    //////////////////////////////////////////////
-    //Call cactus setup
-    //////////////////////////////////////////////
+        st_logInfo("Set up the cactus disk, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
-    Flower *flower = cactus_setup_first_flower(cactusDisk, params, speciesTree, outgroupEvents, sequenceFilesAndEvents);
-    st_logInfo("Established the first Flower in the hierarchy, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        //////////////////////////////////////////////
+        //Call cactus setup
+        //////////////////////////////////////////////
+
+        flower = cactus_setup_first_flower(cactusDisk, params, speciesTree, outgroupEvents, sequenceFilesAndEvents);
+        st_logInfo("Established the first Flower in the hierarchy, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+    }
 
     if(runChecks) {
         flower_checkRecursive(flower);
         st_logInfo("Checked the first flower in the hierarchy, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
     }
 
+    cactusStats_endStage();
+
     // Get the Name of the reference event - do this early so we don't fail late in the process
     Event *referenceEvent = eventTree_getEventByHeader(flower_getEventTree(flower), referenceEventString);
     if (referenceEvent == NULL) {
@@ -324,53 +430,62 @@ int main(int argc, char *argv[]) {
     // Check if we got the reference sequence as input
     bool skipReferencePhase = refSequenceProvided(sequenceFilesAndEvents, referenceEventString);
 
-    //////////////////////////////////////////////
-    //Convert alignment coordinates
-    //////////////////////////////////////////////
+    if (resumedStage == NULL) {
+        //////////////////////////////////////////////
+        //Map alignment coordinates
+        //////////////////////////////////////////////
 
-    alignmentsFile = convertAlignments(alignmentsFile, flower);
-    if(secondaryAlignmentsFile != NULL) {
-        secondaryAlignmentsFile = convertAlignments(secondaryAlignmentsFile, flower);
-    }
-    if(constraintAlignmentsFile != NULL) {
-        constraintAlignmentsFile = convertAlignments(constraintAlignmentsFile, flower);
-    }
-    st_logInfo("Converted alignment coordinates, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        cactusStats_startStage("convert", -1);
 
-    //////////////////////////////////////////////
-    //Strip the unique IDs
-    //////////////////////////////////////////////
+        // The alignments are converted to cactus coordinates as CAF reads them, using this map of the
+        // sequence headers (which must be built before the unique IDs are stripped) to caps
+        stHash *sequenceHeaderToCapHash = stPinchIterator_makeSequenceHeaderToCapHash(flower);
+        st_logInfo("Built the map of sequence headers to caps, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
-    stripUniqueIdsFromLeafSequences(flower);
-    st_logInfo("Stripped any unique IDs, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        //////////////////////////////////////////////
+        //Strip the unique IDs
+        //////////////////////////////////////////////
 
-    //////////////////////////////////////////////
-    //Call cactus caf
-    //////////////////////////////////////////////
+        stripUniqueIdsFromLeafSequences(flower);
+        st_logInfo("Stripped any unique IDs, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        cactusStats_endStage();
 
-    assert(!flower_builtBlocks(flower));
-    caf(flower, params, alignmentsFile, secondaryAlignmentsFile, constraintAlignmentsFile, referenceEvent);
-    assert(flower_builtBlocks(flower));
-    st_logInfo("Ran cactus caf, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        //////////////////////////////////////////////
+        //Call cactus caf
+        //////////////////////////////////////////////
 
-    if(runChecks) {
-        flower_checkRecursive(flower);
-        st_logInfo("Checked the flowers in the hierarchy created by CAF, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        assert(!flower_builtBlocks(flower));
+        cactusStats_startStage("caf", -1);
+        caf(flower, params, alignmentsFile, secondaryAlignmentsFile, constraintAlignmentsFile, referenceEvent,
+            sequenceHeaderToCapHash);
+        stHash_destruct(sequenceHeaderToCapHash);
+        assert(flower_builtBlocks(flower));
+        cactusStats_endStage();
+        st_logInfo("Ran cactus caf, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+
+        if(runChecks) {
+            flower_checkRecursive(flower);
+            st_logInfo("Checked the flowers in the hierarchy created by CAF, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        }
+
+        if (checkpointDir != NULL) {
+            writeCheckpoint(cactusDisk, flower, checkpointDir, "caf");
+        }
     }
 
     //////////////////////////////////////////////
     //Call cactus bar
     //////////////////////////////////////////////
 
-    if (cactusParams_get_int(params, 2, "bar", "runBar")) {
+    if (cactusParams_get_int(params, 2, "bar", "runBar") && (resumedStage == NULL || strcmp(resumedStage, "caf") == 0)) {
         stList *leafFlowers = stList_construct();
-        extendFlowers(flower, leafFlowers, 1); // Get nested flowers to complete
-        stList_sort(leafFlowers, flower_sizeCmpFn); // Sort by descending order of size, so that we start processing the
-// largest flower as quickly as possible
+        extendFlowers(flower, leafFlowers, 1); // Get nested flowers to complete, bar() orders them by predicted cost
         st_logInfo("Ran extended flowers ready for bar, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
 
+        cactusStats_startStage("bar", -1);
         bar(leafFlowers, params, cactusDisk, NULL);
+        cactusStats_endStage();
         int64_t usePoa = cactusParams_get_int(params, 2, "bar", "partialOrderAlignment");
         st_logInfo("Ran cactus bar (use poa:%i), %" PRIi64 " seconds have elapsed\n", (int)usePoa, time(NULL) - startTime);
 
@@ -380,49 +495,39 @@ int main(int argc, char *argv[]) {
             flower_checkRecursive(flower);
             st_logInfo("Checked the flowers in the hierarchy created by BAR, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
         }
+
+        if (checkpointDir != NULL) {
+            writeCheckpoint(cactusDisk, flower, checkpointDir, "bar");
+        }
     }
 
     //////////////////////////////////////////////
     //Call cactus reference
     //////////////////////////////////////////////
 
-    // Get the flowers in the tree so that level 0 contains just the root flower,
-    // level 1 contains the flowers that are children of the root flower, etc.
-    stList *flowerLayers = getFlowerHierarchyInLayers(flower);
-    for(int64_t i=0; i<stList_length(flowerLayers); i++) {
-        stList_sort(stList_get(flowerLayers, i), flower_sizeCmpFn); // Sort by descending order of size, so that we start processing the
-// largest flower as quickly as possible
-    }
-    st_logInfo("There are %" PRIi64 " layers in the flowers hierarchy\n", stList_length(flowerLayers));
-
     RecordHolder *rh = NULL;
     if (!skipReferencePhase) {
         // Top-down this constructs the reference sequence
-        for(int64_t i=0; i<stList_length(flowerLayers); i++) {
-            stList *flowerLayer = stList_get(flowerLayers, i);
-            st_logInfo("In the %" PRIi64 " layer there are %" PRIi64 " flowers in the flowers hierarchy\n", i,
-                       stList_length(flowerLayer));
-            cactus_make_reference(flowerLayer, referenceEventString, cactusDisk, params);
-        }
+        cactusStats_startStage("reference", -1);
+        ReferenceParameters *referenceParameters = referenceParameters_constructFromCactusParams(params, referenceEventString);
+        traverseFlowersTopDown(flower, callMakeReference, referenceParameters);
+        referenceParameters_destruct(referenceParameters);
+        cactusStats_endStage();
         st_logInfo("Ran cactus make reference, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
         // Bottom-up reference coordinates phase
-        RecordHolder *rh = doBottomUpTraversal(flowerLayers, callBottomUp, (void *)referenceEventName);
+        cactusStats_startStage("bottomUp", -1);
+        RecordHolder *rh = doBottomUpTraversal(flower, callBottomUp, (void *)referenceEventName);
         bottomUpNoDb(flower, rh, referenceEventName, 1, generateJukesCantorMatrix);
         assert(recordHolder_size(rh) == 0);
         recordHolder_destruct(rh);
+        cactusStats_endStage();
         st_logInfo("Ran cactus make reference bottom up coordinates, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
         // Top-down reference coordinates phase
-        for(int64_t i=0; i<stList_length(flowerLayers); i++) {
-            stList *flowers = stList_get(flowerLayers, i);
-#if defined(_OPENMP)
-#pragma omp parallel for schedule(dynamic)
-#endif
-            for(int64_t j=0; j<stList_length(flowers); j++) {
-                topDown(stList_get(flowers, j), referenceEventName);
-            }
-        }
+        cactusStats_startStage("topDown", -1);
+        traverseFlowersTopDown(flower, callTopDown, (void *)referenceEventName);
+        cactusStats_endStage();
         st_logInfo("Ran cactus make reference top down coordinates, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
     } else {
         st_logInfo("Skipped reference phase because input sequence was provided for %s\n", referenceEventString);
@@ -437,23 +542,39 @@ int main(int argc, char *argv[]) {
     //Make c2h files, then build hal
     //////////////////////////////////////////////
 
-    rh = doBottomUpTraversal(flowerLayers, callHalFn, (void *)referenceEventName);
-    FILE *fileHandle = fopen(outputFile, "w");
-    makeHalFormatNoDb(flower, rh, referenceEventName, fileHandle);
+    cactusStats_startStage("hal", -1);
+    // When reclaiming memory each flower below the root is destroyed as soon as its records are made,
+    // as the fasta stage only needs the sequences of the root flower
+    HalArgs halArgs = { referenceEventName, binaryC2h };
+    rh = doBottomUpTraversal(flower, reclaimMemory ? callHalAndDestructFn : callHalFn, &halArgs);
+    FILE *fileHandle = fopen(outputFile, binaryC2h ? "wb" : "w");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open output file: %s", outputFile);
+    }
+    setvbuf(fileHandle, NULL, _IOFBF, 4 * 1024 * 1024); // The threads are streamed out in many small writes
+    makeHalFormatNoDb(flower, rh, referenceEventName, binaryC2h, fileHandle);
     fclose(fileHandle);
     assert(recordHolder_size(rh) == 0);
     recordHolder_destruct(rh);
+    if (reclaimMemory) {
+        freeSequenceStrings(flower, outputHalFastaFile != NULL, outputReferenceFile != NULL, referenceEventString);
+    }
+    cactusStats_endStage();
     st_logInfo("Ran cactus to hal stage, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
     //////////////////////////////////////////////
     //Get reference sequences
     //////////////////////////////////////////////
 
+    cactusStats_startStage("fasta", -1);
     if(outputHalFastaFile != NULL) {
         fileHandle = fopen(outputHalFastaFile, "w");
         printFastaSequences(flower, fileHandle, referenceEventName);
         fclose(fileHandle);
         st_logInfo("Dumped sequences for hal file, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        if (reclaimMemory) {
+            freeSequenceStrings(flower, 0, outputReferenceFile != NULL, referenceEventString);
+        }
     }
 
     if(outputReferenceFile != NULL) {
@@ -462,24 +583,29 @@ int main(int argc, char *argv[]) {
         fclose(fileHandle);
         st_logInfo("Dumped reference sequences, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
     }
+    cactusStats_endStage();
+
+    if (statsFile != NULL) {
+        fileHandle = fopen(statsFile, "w");
+        if (fileHandle == NULL) {
+            st_errAbort("Could not open stats file: %s", statsFile);
+        }
+        cactusStats_write(fileHandle);
+        fclose(fileHandle);
+        st_logInfo("Wrote the stats file, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+    }
 
     //////////////////////////////////////////////
     //Cleanup
     //////////////////////////////////////////////
 
-    st_system("rm %s", alignmentsFile);
-    if(secondaryAlignmentsFile != NULL) {
-        st_system("rm %s", secondaryAlignmentsFile);
-    }
-    if(constraintAlignmentsFile != NULL) {
-        st_system("rm %s", constraintAlignmentsFile);
-    }
     st_logInfo("Cactus consolidated is done!, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
-    return 0; // Exit without cleaning
+    if (!reclaimMemory) {
+        return 0; // Exit without cleaning
+    }
 
     // Cleanup the memory
-    stList_destruct(flowerLayers);
     cactusParams_destruct(params);
     cactusDisk_destruct(cactusDisk);
 
@@ -0,0 +1,178 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <sys/stat.h>
+#include "sonLib.h"
+#include "cactus.h"
+#include "cactus_setup.h"
+#include "paf.h"
+#include "resourceEstimate.h"
+
+#define ALIGNMENT_SAMPLE_CHUNKS 64
+#define DEFAULT_MAX_SAMPLE_BYTES (64 * 1024 * 1024)
+
+static int64_t getFileSize(const char *fileName) {
+    struct stat fileStat;
+    if (stat(fileName, &fileStat) != 0) {
+        st_errAbort("Could not stat alignments file: %s", fileName);
+    }
+    return fileStat.st_size;
+}
+
+static void addAlignment(AlignmentSample *sample, char *line) {
+    Paf *paf = paf_parse(line, 1);
+    sample->alignments++;
+    if (paf->cigar == NULL) { // Without a cigar treat the alignment as one gapless block
+        sample->alignedBases += paf->target_end - paf->target_start;
+        sample->gaplessBlocks++;
+    } else {
+        // Count the maximal runs of matches, as each becomes a pinch (see pairwiseAlignmentToPinch_getNext)
+        bool inMatch = 0;
+        for (Cigar *op = paf->cigar; op != NULL; op = op->next) {
+            if (op->op == match || op->op == sequence_match || op->op == sequence_mismatch) {
+                sample->alignedBases += op->length;
+                sample->gaplessBlocks += !inMatch;
+                inMatch = 1;
+            } else {
+                inMatch = 0;
+            }
+        }
+    }
+    paf_destruct(paf);
+}
+
+/*
+ * Parses lines from the current position of the file until at least chunkBytes have been read or the file ends.
+ */
+static void sampleChunk(AlignmentSample *sample, FILE *fileHandle, int64_t chunkBytes) {
+    int64_t bytesRead = 0;
+    char *line;
+    while (bytesRead < chunkBytes && (line = stFile_getLineFromFile(fileHandle)) != NULL) {
+        bytesRead += strlen(line) + 1;
+        if (line[0] != '\0') {
+            addAlignment(sample, line);
+        }
+        free(line);
+    }
+    sample->sampledBytes += bytesRead;
+}
+
+void alignmentSample_addFile(AlignmentSample *sample, const char *alignmentsFile, int64_t maxSampleBytes) {
+    int64_t fileBytes = getFileSize(alignmentsFile);
+    sample->fileBytes += fileBytes;
+    FILE *fileHandle = fopen(alignmentsFile, "r");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open alignments file: %s", alignmentsFile);
+    }
+    if (fileBytes <= maxSampleBytes) {
+        sampleChunk(sample, fileHandle, INT64_MAX);
+    } else {
+        for (int64_t i = 0; i < ALIGNMENT_SAMPLE_CHUNKS; i++) {
+            int64_t offset = i * (fileBytes / ALIGNMENT_SAMPLE_CHUNKS);
+            fseek(fileHandle, offset, SEEK_SET);
+            if (offset > 0) { // Skip the partial line, it is not counted as sampled
+                int c;
+                while ((c = fgetc(fileHandle)) != EOF && c != '\n');
+            }
+            sampleChunk(sample, fileHandle, maxSampleBytes / ALIGNMENT_SAMPLE_CHUNKS);
+        }
+    }
+    fclose(fileHandle);
+}
+
+/*
+ * The coefficients of the linear models, read from the consolidated/resourceModel node of the params.
+ */
+typedef struct _resourceModel {
+    double sequenceBytesPerBase; // The sequence strings, as held by the cactus disk
+    double bytesPerSequence; // The sequence, its ends, caps and thread
+    double pinchBytesPerGaplessBlock; // The pinch graph, including the splitting of threads by each pinch
+    double cactusBytesPerGaplessBlock; // The flowers built from the pinch graph
+    double poaBytesPerSquaredWindow; // Each thread's abPOA matrices, quadratic in the window length
+    double referenceBytesPerBase; // The records and strings of the reference, bottom up and HAL stages
+    double setupSecondsPerBase;
+    double cafSecondsPerAlignedBase;
+    double barSecondsPerBase;
+    double referenceSecondsPerBase;
+} ResourceModel;
+
+static void resourceModel_load(ResourceModel *model, CactusParams *params) {
+    model->sequenceBytesPerBase = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "sequenceBytesPerBase");
+    model->bytesPerSequence = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "bytesPerSequence");
+    model->pinchBytesPerGaplessBlock = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "pinchBytesPerGaplessBlock");
+    model->cactusBytesPerGaplessBlock = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "cactusBytesPerGaplessBlock");
+    model->poaBytesPerSquaredWindow = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "poaBytesPerSquaredWindow");
+    model->referenceBytesPerBase = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "referenceBytesPerBase");
+    model->setupSecondsPerBase = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "setupSecondsPerBase");
+    model->cafSecondsPerAlignedBase = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "cafSecondsPerAlignedBase");
+    model->barSecondsPerBase = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "barSecondsPerBase");
+    model->referenceSecondsPerBase = cactusParams_get_float(params, 3, "consolidated", "resourceModel", "referenceSecondsPerBase");
+}
+
+static void writeStage(FILE *fileHandle, const char *name, double peakBytes, double coreSeconds, int64_t parallelism,
+                       bool first) {
+    fprintf(fileHandle, "%s\n{\"name\": \"%s\", \"peakBytes\": %" PRIi64 ", \"coreHours\": %.4f, \"wallHours\": %.4f}",
+            first ? "" : ",", name, (int64_t)peakBytes, coreSeconds / 3600.0, coreSeconds / parallelism / 3600.0);
+}
+
+void resourceEstimate_write(FILE *fileHandle, CactusParams *params, char *sequenceFilesAndEvents,
+                            stList *alignmentFiles, int64_t threadNumber) {
+    ResourceModel model;
+    resourceModel_load(&model, params);
+
+    SequenceSummary sequences;
+    cactus_setup_summariseSequences(sequenceFilesAndEvents, &sequences);
+
+    AlignmentSample sample = { 0, 0, 0, 0, 0 };
+    for (int64_t i = 0; i < stList_length(alignmentFiles); i++) {
+        alignmentSample_addFile(&sample, stList_get(alignmentFiles, i), DEFAULT_MAX_SAMPLE_BYTES);
+    }
+    double scale = sample.sampledBytes > 0 ? ((double)sample.fileBytes) / sample.sampledBytes : 0.0;
+    double alignments = sample.alignments * scale;
+    double alignedBases = sample.alignedBases * scale;
+    double gaplessBlocks = sample.gaplessBlocks * scale;
+
+    double length = sequences.totalSequenceLength;
+    double sequenceBytes = model.sequenceBytesPerBase * length + model.bytesPerSequence * sequences.sequenceNumber;
+    double cactusBytes = model.cactusBytesPerGaplessBlock * gaplessBlocks;
+
+    // Setup holds one sequence at a time while reading it in
+    double setupBytes = sequenceBytes + sequences.maxSequenceLength;
+    // CAF holds the pinch graph and the cactus graph built from it at the same time
+    double cafBytes = sequenceBytes + model.pinchBytesPerGaplessBlock * gaplessBlocks + cactusBytes;
+    // BAR aligns up to one window per thread
+    bool runBar = cactusParams_get_int(params, 2, "bar", "runBar");
+    double barBytes = sequenceBytes + cactusBytes;
+    if (runBar && cactusParams_get_int(params, 2, "bar", "partialOrderAlignment")) {
+        double window = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentWindow");
+        double poaBytes = threadNumber * model.poaBytesPerSquaredWindow * window * window;
+        int64_t poaBudget = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentMemoryBudget");
+        barBytes += poaBudget > 0 && poaBudget < poaBytes ? poaBudget : poaBytes; // The windows are held to the budget
+    }
+    double referenceBytes = sequenceBytes + cactusBytes + model.referenceBytesPerBase * length;
+
+    double setupSeconds = model.setupSecondsPerBase * length;
+    double cafSeconds = model.cafSecondsPerAlignedBase * alignedBases;
+    double barSeconds = runBar ? model.barSecondsPerBase * length : 0.0;
+    double referenceSeconds = model.referenceSecondsPerBase * length;
+
+    fprintf(fileHandle, "{\n\"inputs\": {\"sequences\": %" PRIi64 ", \"totalSequenceLength\": %" PRIi64
+            ", \"maxSequenceLength\": %" PRIi64 ", \"alignmentFileBytes\": %" PRIi64 ", \"sampledAlignmentBytes\": %"
+            PRIi64 ", \"sampledAlignments\": %" PRIi64 ", \"alignments\": %" PRIi64 ", \"alignedBases\": %" PRIi64
+            ", \"gaplessBlocks\": %" PRIi64 "},\n", sequences.sequenceNumber, sequences.totalSequenceLength,
+            sequences.maxSequenceLength, sample.fileBytes, sample.sampledBytes, sample.alignments, (int64_t)alignments,
+            (int64_t)alignedBases, (int64_t)gaplessBlocks);
+    fprintf(fileHandle, "\"threads\": %" PRIi64 ",\n\"stages\": [", threadNumber);
+    // CAF is largely serial, the other stages are parallel over flowers
+    writeStage(fileHandle, "setup", setupBytes, setupSeconds, 1, 1);
+    writeStage(fileHandle, "caf", cafBytes, cafSeconds, 1, 0);
+    writeStage(fileHandle, "bar", barBytes, barSeconds, threadNumber, 0);
+    writeStage(fileHandle, "reference", referenceBytes, referenceSeconds, threadNumber, 0);
+    double peakBytes = setupBytes > cafBytes ? setupBytes : cafBytes;
+    peakBytes = peakBytes > barBytes ? peakBytes : barBytes;
+    peakBytes = peakBytes > referenceBytes ? peakBytes : referenceBytes;
+    double coreSeconds = setupSeconds + cafSeconds + barSeconds + referenceSeconds;
+    fprintf(fileHandle, "\n],\n\"peakBytes\": %" PRIi64 ",\n\"coreHours\": %.4f\n}\n", (int64_t)peakBytes,
+            coreSeconds / 3600.0);
+}
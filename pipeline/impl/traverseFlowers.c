@@ -1,4 +1,7 @@
 #include "traverseFlowers.h"
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 void extendFlowers(Flower *flower, stList *extendedFlowers, int64_t minFlowerSize) {
     Flower_GroupIterator *groupIterator = flower_getGroupIterator(flower);
@@ -43,18 +46,146 @@ void getChildFlowers(Flower *flower, stList *children) {
     }
 }
 
-stList *getFlowerHierarchyInLayers(Flower *rootFlower) {
-    stList *flowers = stList_construct();
-    stList_append(flowers, rootFlower);
-    stList *flowerLayers = stList_construct3(0, (void (*)(void *)) stList_destruct);
-    while (stList_length(flowers) > 0) {
-        stList *childFlowers = stList_construct();
-        for(int64_t i=0; i<stList_length(flowers); i++) {
-            getChildFlowers(stList_get(flowers, i), childFlowers);
+int flower_sizeCmpFn(const void *a, const void *b) {
+    // Sort by number of caps the flowers contains, a cheap proxy for the work in the flower's subtree
+    int64_t i = flower_getCapNumber((Flower *)a), j = flower_getCapNumber((Flower *)b);
+    return i < j ? 1 : (i > j ? -1 : 0); // Sort in descending order
+}
+
+static void traverseFlowersTopDownP(Flower *flower, void (*fn)(Flower *, void *), void *extraArg) {
+    fn(flower, extraArg);
+    stList *children = stList_construct();
+    getChildFlowers(flower, children);
+    stList_sort(children, flower_sizeCmpFn);
+    for (int64_t i = 0; i < stList_length(children); i++) {
+        Flower *child = stList_get(children, i);
+#if defined(_OPENMP)
+#pragma omp task firstprivate(child)
+#endif
+        traverseFlowersTopDownP(child, fn, extraArg);
+    }
+    stList_destruct(children);
+}
+
+void traverseFlowersTopDown(Flower *rootFlower, void (*fn)(Flower *, void *), void *extraArg) {
+#if defined(_OPENMP)
+#pragma omp parallel
+#pragma omp single
+#endif
+    traverseFlowersTopDownP(rootFlower, fn, extraArg);
+}
+
+/*
+ * A node of the bottom-up traversal. A flower becomes ready once all its children are done, rather than
+ * once the whole layer below it is done, so a deep subtree does not hold up the shallow flowers elsewhere.
+ */
+typedef struct _bottomUpTask {
+    Flower *flower;
+    struct _bottomUpTask *parent;
+    stList *children; // In getChildFlowers order, so the results are always passed in the same order
+    int64_t pendingChildren;
+    void *result;
+} BottomUpTask;
+
+static BottomUpTask *bottomUpTask_construct(Flower *flower, BottomUpTask *parent) {
+    BottomUpTask *task = st_calloc(1, sizeof(BottomUpTask));
+    task->flower = flower;
+    task->parent = parent;
+    task->children = stList_construct();
+    return task;
+}
+
+static void bottomUpTask_destruct(BottomUpTask *task) {
+    stList_destruct(task->children);
+    free(task);
+}
+
+static int bottomUpTask_sizeCmpFn(const void *a, const void *b) {
+    return flower_sizeCmpFn(((BottomUpTask *)a)->flower, ((BottomUpTask *)b)->flower);
+}
+
+/*
+ * Builds the task tree of the hierarchy with an explicit stack, so deep hierarchies cannot overflow the call
+ * stack, adding the tasks of the leaf flowers to leafTasks.
+ */
+static BottomUpTask *bottomUpTask_constructTree(Flower *rootFlower, stList *leafTasks) {
+    BottomUpTask *root = bottomUpTask_construct(rootFlower, NULL);
+    stList *stack = stList_construct();
+    stList_append(stack, root);
+    stList *childFlowers = stList_construct();
+    while (stList_length(stack) > 0) {
+        BottomUpTask *task = stList_pop(stack);
+        getChildFlowers(task->flower, childFlowers);
+        for (int64_t i = 0; i < stList_length(childFlowers); i++) {
+            BottomUpTask *child = bottomUpTask_construct(stList_get(childFlowers, i), task);
+            stList_append(task->children, child);
+            stList_append(stack, child);
+        }
+        stList_setLength(childFlowers, 0);
+        task->pendingChildren = stList_length(task->children);
+        if (task->pendingChildren == 0) {
+            stList_append(leafTasks, task);
+        }
+    }
+    stList_destruct(childFlowers);
+    stList_destruct(stack);
+    return root;
+}
+
+/*
+ * Runs the task then, if it was the last child of its parent to finish, carries on with the parent.
+ */
+static void bottomUpTask_run(BottomUpTask *task, void *(*fn)(Flower *, stList *, void *), void *extraArg) {
+    while (1) {
+        stList *childResults = stList_construct();
+        for (int64_t i = 0; i < stList_length(task->children); i++) {
+            BottomUpTask *child = stList_get(task->children, i);
+            stList_append(childResults, child->result);
+            bottomUpTask_destruct(child);
         }
-        stList_append(flowerLayers, flowers);
-        flowers = childFlowers;
+        stList_setLength(task->children, 0);
+        task->result = fn(task->flower, childResults, extraArg);
+        stList_destruct(childResults);
+        if (task->parent == NULL) {
+            return;
+        }
+
+        int64_t pendingChildren;
+#if defined(_OPENMP)
+#pragma omp flush
+#pragma omp atomic capture
+#endif
+        pendingChildren = --task->parent->pendingChildren;
+        if (pendingChildren > 0) {
+            return;
+        }
+#if defined(_OPENMP)
+#pragma omp flush
+#endif
+        task = task->parent;
+    }
+}
+
+void *traverseFlowersBottomUp(Flower *rootFlower, void *(*fn)(Flower *, stList *, void *), void *extraArg) {
+    stList *leafTasks = stList_construct();
+    BottomUpTask *root = bottomUpTask_constructTree(rootFlower, leafTasks);
+    stList_sort(leafTasks, bottomUpTask_sizeCmpFn); // Start the largest leaves first
+    st_logInfo("Bottom-up traversal has %" PRIi64 " leaf flowers\n", stList_length(leafTasks));
+
+#if defined(_OPENMP)
+#pragma omp parallel
+#pragma omp single
+#endif
+    for (int64_t i = 0; i < stList_length(leafTasks); i++) {
+        BottomUpTask *task = stList_get(leafTasks, i);
+#if defined(_OPENMP)
+#pragma omp task firstprivate(task)
+#endif
+        bottomUpTask_run(task, fn, extraArg);
     }
-    stList_destruct(flowers);
-    return flowerLayers;
+    stList_destruct(leafTasks);
+
+    void *result = root->result;
+    bottomUpTask_destruct(root);
+    return result;
 }
@@ -9,11 +9,6 @@
 
 #include "cactus.h"
 
-/*
- * Converts input alignments coordinates into coordinates used by cactus.
- */
-void convertAlignmentCoordinates(char *inputAlignmentFile, char *outputAlignmentFile, Flower *flower);
-
 /*
  * Strips unique identifiers from sequence IDs (which are added for leaf genomes)
  */
@@ -0,0 +1,43 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef RESOURCE_ESTIMATE_H_
+#define RESOURCE_ESTIMATE_H_
+
+#include "sonLib.h"
+#include "cactus.h"
+
+/*
+ * Predictions of the peak memory and core hours of each stage of cactus_consolidated, made without running it.
+ *
+ * The sequence files are read to total the sequence lengths (one sequence is held at a time), and the alignment
+ * files are sampled at evenly spaced offsets to extrapolate the number of alignments, aligned bases and gapless
+ * alignment blocks (each of which becomes a pinch). These are fed to linear models of the pinch graph, the cactus
+ * graph built from it, the BAR alignment windows and the reference/HAL records, whose coefficients are read from
+ * the consolidated/resourceModel node of the params, so they can be refit against the reports written with
+ * --statsFile.
+ */
+
+typedef struct _alignmentSample {
+    int64_t fileBytes; // Total size of the alignment files
+    int64_t sampledBytes; // Bytes of the files parsed
+    int64_t alignments; // Alignments parsed
+    int64_t alignedBases; // Bases in the match operations of the alignments parsed
+    int64_t gaplessBlocks; // Maximal runs of match operations in the alignments parsed
+} AlignmentSample;
+
+/*
+ * Adds a sample of the PAF alignments in the given file to the sample. Files of up to maxSampleBytes are read in full,
+ * larger ones are read in evenly spaced chunks totalling about maxSampleBytes.
+ */
+void alignmentSample_addFile(AlignmentSample *sample, const char *alignmentsFile, int64_t maxSampleBytes);
+
+/*
+ * Writes the predicted resources of each stage as a JSON object. The alignment files are the primary alignments
+ * and any secondary or constraint alignments, as given to CAF.
+ */
+void resourceEstimate_write(FILE *fileHandle, CactusParams *params, char *sequenceFilesAndEvents,
+                            stList *alignmentFiles, int64_t threadNumber);
+
+#endif /* RESOURCE_ESTIMATE_H_ */
@@ -22,10 +22,26 @@ void extendFlowers(Flower *flower, stList *extendedFlowers, int64_t minFlowerSiz
 void getChildFlowers(Flower *flower, stList *children);
 
 /*
- * Returns a list of lists of the flowers, where the flowers in layer i are the children of those
- * in layer i-1 and the parents of those in layer i+1.
+ * Orders flowers by descending number of caps.
  */
-stList *getFlowerHierarchyInLayers(Flower *rootFlower);
+int flower_sizeCmpFn(const void *a, const void *b);
+
+/*
+ * Calls fn(flower, extraArg) on every flower in the hierarchy, such that fn is called on a flower only after it has
+ * returned for the flower's parent. Rather than waiting for a whole layer of the hierarchy to complete, the children
+ * of a flower are scheduled as tasks as soon as the flower is done, largest first, so sibling subtrees proceed
+ * independently and a single large flower does not stall the rest of the hierarchy.
+ */
+void traverseFlowersTopDown(Flower *rootFlower, void (*fn)(Flower *, void *), void *extraArg);
+
+/*
+ * Calls fn(flower, childResults, extraArg) on every flower in the hierarchy, including the root, where childResults
+ * holds the values fn returned for the flower's children in getChildFlowers order, and returns the value returned
+ * for the root. fn is called on a flower as soon as it has returned for all of the flower's children, rather than
+ * once the whole layer below is done, and the leaves are started largest first. The childResults list is freed
+ * after fn returns, but not the values in it.
+ */
+void *traverseFlowersBottomUp(Flower *rootFlower, void *(*fn)(Flower *, stList *, void *), void *extraArg);
 
 #endif /* TRAVERSE_FLOWERS_H_ */
 
@@ -8,10 +8,14 @@
 #include "sonLib.h"
 
 CuSuite* cactusParamsTestSuite(void);
+CuSuite* traverseFlowersTestSuite(void);
+CuSuite* resourceEstimateTestSuite(void);
 
 int cactusPipelineRunAllTests(void) {
     CuString *output = CuStringNew();
     CuSuite* suite = CuSuiteNew();
+    CuSuiteAddSuite(suite, traverseFlowersTestSuite());
+    CuSuiteAddSuite(suite, resourceEstimateTestSuite());
 
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
@@ -0,0 +1,117 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "cactus.h"
+#include "resourceEstimate.h"
+
+static char *params_file = "./src/cactus/cactus_progressive_config.xml";
+static char *alignmentsFile = "tempFileForResourceEstimateTest.paf";
+static char *sequencesFile = "tempFileForResourceEstimateTest.fa";
+
+// Two gapless blocks of 4 and 6 bases; the lines are identical so any sample of whole lines extrapolates exactly
+static char *pafLine = "a\t100\t0\t12\t+\tb\t100\t0\t12\t10\t12\t60\tcg:Z:4M2I2D6M";
+
+/*
+ * Writes the PAF line the given number of times, returning the size of the file.
+ */
+static int64_t writeAlignments(int64_t lineNumber) {
+    FILE *fileHandle = fopen(alignmentsFile, "w");
+    for (int64_t i = 0; i < lineNumber; i++) {
+        fprintf(fileHandle, "%s\n", pafLine);
+    }
+    fclose(fileHandle);
+    return lineNumber * (strlen(pafLine) + 1);
+}
+
+static void testAlignmentSample_addFile(CuTest *testCase) {
+    int64_t fileBytes = writeAlignments(1000);
+
+    // Small enough to read in full
+    AlignmentSample sample = { 0, 0, 0, 0, 0 };
+    alignmentSample_addFile(&sample, alignmentsFile, fileBytes);
+    CuAssertIntEquals(testCase, fileBytes, sample.fileBytes);
+    CuAssertIntEquals(testCase, fileBytes, sample.sampledBytes);
+    CuAssertIntEquals(testCase, 1000, sample.alignments);
+    CuAssertIntEquals(testCase, 10000, sample.alignedBases);
+    CuAssertIntEquals(testCase, 2000, sample.gaplessBlocks);
+
+    // Sampled in chunks, then extrapolated to the whole file as resourceEstimate_write does
+    AlignmentSample sample2 = { 0, 0, 0, 0, 0 };
+    alignmentSample_addFile(&sample2, alignmentsFile, fileBytes / 10);
+    CuAssertIntEquals(testCase, fileBytes, sample2.fileBytes);
+    CuAssertTrue(testCase, sample2.sampledBytes > 0 && sample2.sampledBytes < fileBytes);
+    CuAssertIntEquals(testCase, sample2.sampledBytes, sample2.alignments * (strlen(pafLine) + 1));
+    double scale = ((double)sample2.fileBytes) / sample2.sampledBytes;
+    CuAssertDblEquals(testCase, 1000, sample2.alignments * scale, 0.001);
+    CuAssertDblEquals(testCase, 10000, sample2.alignedBases * scale, 0.001);
+    CuAssertDblEquals(testCase, 2000, sample2.gaplessBlocks * scale, 0.001);
+
+    // Samples of several files add up
+    alignmentSample_addFile(&sample, alignmentsFile, fileBytes);
+    CuAssertIntEquals(testCase, 2 * fileBytes, sample.fileBytes);
+    CuAssertIntEquals(testCase, 2000, sample.alignments);
+
+    stFile_rmtree(alignmentsFile);
+}
+
+static void testResourceEstimate_write(CuTest *testCase) {
+    int64_t fileBytes = writeAlignments(100);
+    FILE *fileHandle = fopen(sequencesFile, "w");
+    fprintf(fileHandle, ">one\n%s\n>two\n%s\n",
+            "ACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGT",
+            "ACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTAC");
+    fclose(fileHandle);
+    char *sequenceFilesAndEvents = stString_print("human %s", sequencesFile);
+    stList *alignmentFiles = stList_construct();
+    stList_append(alignmentFiles, alignmentsFile);
+    CactusParams *params = cactusParams_load(params_file);
+
+    char *outputFile = "tempFileForResourceEstimateTest.json";
+    fileHandle = fopen(outputFile, "w");
+    resourceEstimate_write(fileHandle, params, sequenceFilesAndEvents, alignmentFiles, 2);
+    fclose(fileHandle);
+    fileHandle = fopen(outputFile, "r");
+    char *json = stFile_getLineFromFile(fileHandle);
+    char *line;
+    while ((line = stFile_getLineFromFile(fileHandle)) != NULL) {
+        char *newJson = stString_print("%s\n%s", json, line);
+        free(json);
+        free(line);
+        json = newJson;
+    }
+    fclose(fileHandle);
+
+    // 150 bases in 2 sequences, and 100 alignments of 10 aligned bases in 2 gapless blocks
+    char *inputs = stString_print("\"inputs\": {\"sequences\": 2, \"totalSequenceLength\": 150, \"maxSequenceLength\": 100, "
+                                  "\"alignmentFileBytes\": %" PRIi64 ", \"sampledAlignmentBytes\": %" PRIi64
+                                  ", \"sampledAlignments\": 100, \"alignments\": 100, \"alignedBases\": 1000, "
+                                  "\"gaplessBlocks\": 200}", fileBytes, fileBytes);
+    CuAssertTrue(testCase, strstr(json, inputs) != NULL);
+    CuAssertTrue(testCase, strstr(json, "\"threads\": 2") != NULL);
+    // With the default model, the sequences take 2 * 150 + 2000 * 2 = 4300 bytes and the cactus 300 * 200 bytes
+    CuAssertTrue(testCase, strstr(json, "{\"name\": \"setup\", \"peakBytes\": 4400,") != NULL);
+    CuAssertTrue(testCase, strstr(json, "{\"name\": \"caf\", \"peakBytes\": 144300,") != NULL);
+    // Two threads each aligning a 10000 base window, with the POA memory budget unlimited
+    CuAssertTrue(testCase, strstr(json, "{\"name\": \"bar\", \"peakBytes\": 800064300,") != NULL);
+    CuAssertTrue(testCase, strstr(json, "{\"name\": \"reference\", \"peakBytes\": 64900,") != NULL);
+    CuAssertTrue(testCase, strstr(json, "\"peakBytes\": 800064300,\n\"coreHours\"") != NULL);
+
+    free(inputs);
+    free(json);
+    cactusParams_destruct(params);
+    stList_destruct(alignmentFiles);
+    free(sequenceFilesAndEvents);
+    stFile_rmtree(outputFile);
+    stFile_rmtree(sequencesFile);
+    stFile_rmtree(alignmentsFile);
+}
+
+CuSuite* resourceEstimateTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testAlignmentSample_addFile);
+    SUITE_ADD_TEST(suite, testResourceEstimate_write);
+    return suite;
+}
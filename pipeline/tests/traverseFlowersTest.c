@@ -0,0 +1,116 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "cactus.h"
+#include "traverseFlowers.h"
+
+/*
+ * Makes a random hierarchy of flowers, of up to the given number of flowers.
+ */
+static Flower *getRandomFlowerHierarchy(CactusDisk *cactusDisk, int64_t flowerNumber) {
+    Flower *rootFlower = flower_construct(cactusDisk);
+    stList *flowers = stList_construct();
+    stList_append(flowers, rootFlower);
+    for (int64_t i = 1; i < flowerNumber; i++) {
+        Flower *parentFlower = st_randomChoice(flowers);
+        Flower *flower = flower_construct(cactusDisk);
+        group_construct(parentFlower, flower);
+        flower_setBuiltBlocks(parentFlower, 1);
+        stList_append(flowers, flower);
+    }
+    stList_destruct(flowers);
+    return rootFlower;
+}
+
+/*
+ * The result of a flower is its name preceded by the results of its children, in order.
+ */
+static char *getResult(Flower *flower, stList *childResults) {
+    char *result = stString_print("(");
+    for (int64_t i = 0; i < stList_length(childResults); i++) {
+        char *childResult = stList_get(childResults, i);
+        char *newResult = stString_print("%s%s,", result, childResult);
+        free(result);
+        free(childResult);
+        result = newResult;
+    }
+    char *newResult = stString_print("%s)%" PRIi64, result, flower_getName(flower));
+    free(result);
+    return newResult;
+}
+
+static void *getResultFn(Flower *flower, stList *childResults, void *extraArg) {
+    int64_t *calls = extraArg;
+#if defined(_OPENMP)
+#pragma omp atomic
+#endif
+    (*calls)++;
+    return getResult(flower, childResults);
+}
+
+/*
+ * Computes the result of the root a layer of the hierarchy at a time, starting from the deepest layer.
+ */
+static char *getResultByLayers(Flower *rootFlower) {
+    stList *flowerLayers = stList_construct3(0, (void (*)(void *)) stList_destruct);
+    stList *flowers = stList_construct();
+    stList_append(flowers, rootFlower);
+    while (stList_length(flowers) > 0) {
+        stList *childFlowers = stList_construct();
+        for (int64_t i = 0; i < stList_length(flowers); i++) {
+            getChildFlowers(stList_get(flowers, i), childFlowers);
+        }
+        stList_append(flowerLayers, flowers);
+        flowers = childFlowers;
+    }
+    stList_destruct(flowers);
+
+    stHash *flowersToResults = stHash_construct();
+    for (int64_t i = stList_length(flowerLayers) - 1; i >= 0; i--) {
+        stList *layer = stList_get(flowerLayers, i);
+        for (int64_t j = 0; j < stList_length(layer); j++) {
+            Flower *flower = stList_get(layer, j);
+            stList *children = stList_construct();
+            getChildFlowers(flower, children);
+            stList *childResults = stList_construct();
+            for (int64_t k = 0; k < stList_length(children); k++) {
+                stList_append(childResults, stHash_remove(flowersToResults, stList_get(children, k)));
+            }
+            stHash_insert(flowersToResults, flower, getResult(flower, childResults));
+            stList_destruct(childResults);
+            stList_destruct(children);
+        }
+    }
+    char *result = stHash_remove(flowersToResults, rootFlower);
+    assert(stHash_size(flowersToResults) == 0);
+    stHash_destruct(flowersToResults);
+    stList_destruct(flowerLayers);
+    return result;
+}
+
+static void testTraverseFlowersBottomUp(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        CactusDisk *cactusDisk = cactusDisk_construct();
+        int64_t flowerNumber = st_randomInt(1, 200);
+        Flower *rootFlower = getRandomFlowerHierarchy(cactusDisk, flowerNumber);
+
+        int64_t calls = 0;
+        char *result = traverseFlowersBottomUp(rootFlower, getResultFn, &calls);
+        char *expectedResult = getResultByLayers(rootFlower);
+        CuAssertIntEquals(testCase, flowerNumber, calls);
+        CuAssertStrEquals(testCase, expectedResult, result);
+
+        free(result);
+        free(expectedResult);
+        cactusDisk_destruct(cactusDisk);
+    }
+}
+
+CuSuite* traverseFlowersTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testTraverseFlowersBottomUp);
+    return suite;
+}
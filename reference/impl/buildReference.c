@@ -5,6 +5,7 @@
 #include "stCheckEdges.h"
 #include "stMatchingAlgorithms.h"
 #include "stReferenceProblem2.h"
+#include "cactusReference.h"
 #include <math.h>
 
 // OpenMP
@@ -1169,60 +1170,57 @@ void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader, int
 ////////////////////////////////////
 ////////////////////////////////////
 
-void cactus_make_reference(stList *flowers, char *referenceEventString,
-                           CactusDisk *cactusDisk, CactusParams *params) {
-    ///////////////////////////////////////////////////////////////////////////
-    // Build the reference
-    ///////////////////////////////////////////////////////////////////////////
-
-    int64_t permutations = cactusParams_get_int(params, 2, "reference", "permutations");
-    double theta = cactusParams_get_float(params, 2, "reference", "theta");
-    double phi = cactusParams_get_float(params, 2, "reference", "phi");
+ReferenceParameters *referenceParameters_constructFromCactusParams(CactusParams *params, char *referenceEventString) {
+    ReferenceParameters *p = st_malloc(sizeof(ReferenceParameters));
+    p->referenceEventString = referenceEventString;
+    p->permutations = cactusParams_get_int(params, 2, "reference", "permutations");
+    p->theta = cactusParams_get_float(params, 2, "reference", "theta");
+    p->phi = cactusParams_get_float(params, 2, "reference", "phi");
     bool useSimulatedAnnealing = cactusParams_get_int(params, 2, "reference", "useSimulatedAnnealing");
-    int64_t maxWalkForCalculatingZ = cactusParams_get_int(params, 2, "reference", "maxWalkForCalculatingZ");
-    bool ignoreUnalignedGaps = cactusParams_get_int(params, 2, "reference", "ignoreUnalignedGaps");
-    double wiggle = cactusParams_get_float(params, 2, "reference", "wiggle");
-    int64_t numberOfNsForScaffoldGap = cactusParams_get_int(params, 2, "reference", "numberOfNs");
-    int64_t minNumberOfSequencesToSupportAdjacency = cactusParams_get_int(params, 2, "reference", "minNumberOfSequencesToSupportAdjacency");
-    bool makeScaffolds = cactusParams_get_int(params, 2, "reference", "makeScaffolds");
-
-    stList *(*matchingAlgorithm)(stList *edges, int64_t nodeNumber) = chooseMatching_greedy;
+    p->maxWalkForCalculatingZ = cactusParams_get_int(params, 2, "reference", "maxWalkForCalculatingZ");
+    p->ignoreUnalignedGaps = cactusParams_get_int(params, 2, "reference", "ignoreUnalignedGaps");
+    p->wiggle = cactusParams_get_float(params, 2, "reference", "wiggle");
+    p->numberOfNsForScaffoldGap = cactusParams_get_int(params, 2, "reference", "numberOfNs");
+    p->minNumberOfSequencesToSupportAdjacency = cactusParams_get_int(params, 2, "reference", "minNumberOfSequencesToSupportAdjacency");
+    p->makeScaffolds = cactusParams_get_int(params, 2, "reference", "makeScaffolds");
+
+    p->matchingAlgorithm = chooseMatching_greedy;
     char *matchAlgorithmString = cactusParams_get_string(params, 2, "reference", "matchingAlgorithm");
     if (strcmp("greedy", matchAlgorithmString) == 0) {
-        matchingAlgorithm = chooseMatching_greedy;
+        p->matchingAlgorithm = chooseMatching_greedy;
     } else if (strcmp("maxCardinality", matchAlgorithmString) == 0) {
-        matchingAlgorithm = chooseMatching_maximumCardinalityMatching;
+        p->matchingAlgorithm = chooseMatching_maximumCardinalityMatching;
     } else if (strcmp("maxWeight", matchAlgorithmString) == 0) {
-        matchingAlgorithm = chooseMatching_maximumWeightMatching;
+        p->matchingAlgorithm = chooseMatching_maximumWeightMatching;
     } else if (strcmp("blossom5", matchAlgorithmString) == 0) {
-        matchingAlgorithm = chooseMatching_blossom5;
+        p->matchingAlgorithm = chooseMatching_blossom5;
     } else {
+        free(p);
         stThrowNew(REFERENCE_BUILDING_EXCEPTION, "Input error: unrecognized matching algorithm: %s", matchAlgorithmString);
     }
     free(matchAlgorithmString);
 
-    /*st_logDebug("The reference event string: %s\n", referenceEventString);
-    st_logDebug("The theta parameter has been set to %lf\n", theta);
-    st_logDebug("The ignore unaligned gaps parameter is %i\n", ignoreUnalignedGaps);
-    st_logDebug("The number of permutations is %" PRIi64 "\n", permutations);
-    st_logDebug("Simulated annealing is %" PRIi64 "\n", useSimulatedAnnealing);
-    st_logDebug("Max number of segments in thread to calculate z-score between is %" PRIi64 "\n",
-            maxWalkForCalculatingZ);
-    st_logDebug("Wiggle is %f\n", wiggle);
-    st_logDebug("Max number of Ns for a scaffold gap is: %" PRIi64 "\n", numberOfNsForScaffoldGap);
-    st_logDebug("Min number of sequences to required to support an adjacency is: %" PRIi64 "\n",
-            minNumberOfSequencesToSupportAdjacency);
-    st_logDebug("Make scaffolds is: %i\n", makeScaffolds);*/
-
-    double (*temperatureFn)(double) = useSimulatedAnnealing ? exponentiallyDecreasingTemperatureFn : constantTemperatureFn;
+    p->temperatureFn = useSimulatedAnnealing ? exponentiallyDecreasingTemperatureFn : constantTemperatureFn;
+    return p;
+}
+
+void referenceParameters_destruct(ReferenceParameters *p) {
+    free(p);
+}
 
+void cactus_make_reference_for_flower(Flower *flower, ReferenceParameters *p) {
+    st_logDebug("Processing flower %" PRIi64 "\n", flower_getName(flower));
+    buildReferenceTopDown(flower, p->referenceEventString, p->permutations, p->matchingAlgorithm, p->temperatureFn,
+                          p->theta, p->phi, p->maxWalkForCalculatingZ, p->ignoreUnalignedGaps, p->wiggle,
+                          p->numberOfNsForScaffoldGap, p->minNumberOfSequencesToSupportAdjacency, p->makeScaffolds);
+}
+
+void cactus_make_reference(stList *flowers, char *referenceEventString,
+                           CactusDisk *cactusDisk, CactusParams *params) {
+    ReferenceParameters *p = referenceParameters_constructFromCactusParams(params, referenceEventString);
 #pragma omp parallel for
     for(int64_t i=0; i<stList_length(flowers); i++) {
-        Flower *flower = stList_get(flowers, i);
-        st_logDebug("Processing flower %" PRIi64 "\n", flower_getName(flower));
-        buildReferenceTopDown(flower, referenceEventString, permutations, matchingAlgorithm, temperatureFn, theta,
-                              phi, maxWalkForCalculatingZ, ignoreUnalignedGaps, wiggle, numberOfNsForScaffoldGap,
-                              minNumberOfSequencesToSupportAdjacency, makeScaffolds);
+        cactus_make_reference_for_flower(stList_get(flowers, i), p);
     }
+    referenceParameters_destruct(p);
 }
-
@@ -13,64 +13,291 @@
 #include "sonLib.h"
 #include "recursiveThreadBuilder.h"
 
+// OpenMP
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+ * Lists of caps shorter than this are processed serially, as for them the cost of starting a parallel region
+ * outweighs the work. Only the root and a few giant flowers are above it.
+ */
+#define MIN_CAPS_FOR_PARALLEL_THREADS 64
+
+/*
+ * A record is either a leaf, holding a string made by one of the write functions, or a composite holding the
+ * records of a thread in order. A flower's threads are composed from the records of its children without copying
+ * them, so each string is copied only once, when the top level threads are flattened or written out, rather than
+ * once per level of the hierarchy.
+ */
+typedef struct _record {
+    int64_t length; // The length of the string the record represents
+    char *string; // The string of a leaf, NULL for a composite
+    int64_t childNumber;
+    struct _record **children;
+} Record;
+
+static Record *record_construct(char *string) {
+    Record *record = st_calloc(1, sizeof(Record));
+    record->string = string;
+    record->length = strlen(string);
+    return record;
+}
+
+static void record_destruct(Record *record) {
+    if (record->string != NULL) {
+        free(record->string);
+    } else {
+        for (int64_t i = 0; i < record->childNumber; i++) {
+            record_destruct(record->children[i]);
+        }
+        free(record->children);
+    }
+    free(record);
+}
+
+/*
+ * Makes a composite of the records, taking ownership of them. Empty records are dropped.
+ */
+static Record *record_constructComposite(stList *records) {
+    Record *record = st_calloc(1, sizeof(Record));
+    record->children = st_malloc(sizeof(Record *) * stList_length(records));
+    for (int64_t i = 0; i < stList_length(records); i++) {
+        Record *child = stList_get(records, i);
+        if (child->length == 0) {
+            record_destruct(child);
+            continue;
+        }
+        record->length += child->length;
+        record->children[record->childNumber++] = child;
+    }
+    return record;
+}
+
+/*
+ * Copies the string of the record into the buffer, returning the position after it.
+ */
+static char *record_copy(Record *record, char *buffer) {
+    if (record->string != NULL) {
+        memcpy(buffer, record->string, record->length);
+        return buffer + record->length;
+    }
+    for (int64_t i = 0; i < record->childNumber; i++) {
+        buffer = record_copy(record->children[i], buffer);
+    }
+    return buffer;
+}
+
+static void record_write(Record *record, FILE *fileHandle) {
+    if (record->string != NULL) {
+        fwrite(record->string, sizeof(char), record->length, fileHandle);
+        return;
+    }
+    for (int64_t i = 0; i < record->childNumber; i++) {
+        record_write(record->children[i], fileHandle);
+    }
+}
+
+/*
+ * The record holder is an open addressing hash table with linear probing, keyed on the names of the caps and
+ * segments. Unlike an stHash it needs no allocation per entry and no boxing of the keys, and merging two holders
+ * always moves the records of the smaller into the larger, so a parent flower adopts the table of its largest
+ * child rather than rebuilding one from scratch.
+ */
+struct _recordHolder {
+    int64_t size;
+    int64_t capacity; // Always a power of two
+    int64_t shift; // 64 - log2(capacity)
+    Name *names; // NULL_NAME marks an empty slot
+    Record **records;
+};
+
+#define RECORD_HOLDER_INITIAL_CAPACITY 16
+
+static void recordHolder_allocate(RecordHolder *rh, int64_t capacity) {
+    rh->size = 0;
+    rh->capacity = capacity;
+    rh->shift = 64;
+    while (capacity > 1) {
+        rh->shift--;
+        capacity >>= 1;
+    }
+    capacity = rh->capacity;
+    rh->names = st_malloc(sizeof(Name) * capacity);
+    rh->records = st_malloc(sizeof(Record *) * capacity);
+    for (int64_t i = 0; i < capacity; i++) {
+        rh->names[i] = NULL_NAME;
+    }
+}
+
 RecordHolder *recordHolder_construct() {
-    return stHash_construct2(NULL, free);
+    RecordHolder *rh = st_malloc(sizeof(RecordHolder));
+    recordHolder_allocate(rh, RECORD_HOLDER_INITIAL_CAPACITY);
+    return rh;
 }
 
 void recordHolder_destruct(RecordHolder *rh) {
-    stHash_destruct(rh);
+    for (int64_t i = 0; i < rh->capacity; i++) {
+        if (rh->names[i] != NULL_NAME) {
+            record_destruct(rh->records[i]);
+        }
+    }
+    free(rh->names);
+    free(rh->records);
+    free(rh);
 }
 
 int64_t recordHolder_size(RecordHolder *rh) {
-    return stHash_size(rh);
+    return rh->size;
+}
+
+static inline int64_t recordHolder_slot(RecordHolder *rh, Name name) {
+    // Fibonacci hashing, which spreads runs of consecutive names, as made by cactusDisk_getUniqueID, evenly
+    return rh->shift == 64 ? 0 : (int64_t)((((uint64_t)name) * 0x9E3779B97F4A7C15ULL) >> rh->shift);
+}
+
+static int64_t recordHolder_find(RecordHolder *rh, Name name) {
+    int64_t i = recordHolder_slot(rh, name);
+    while (rh->names[i] != NULL_NAME) {
+        if (rh->names[i] == name) {
+            return i;
+        }
+        i = (i + 1) & (rh->capacity - 1);
+    }
+    return -1;
 }
 
-static void recordHolder_add(RecordHolder *rh, Name name, char *string) {
-    assert(stHash_search(rh, (void *)name) == NULL);
-    stHash_insert(rh, (void *)name, string);
+static Record *recordHolder_get(RecordHolder *rh, Name name) {
+    int64_t i = recordHolder_find(rh, name);
+    return i == -1 ? NULL : rh->records[i];
 }
 
-static char *recordHolder_remove(RecordHolder *rh, Name name) {
-    char *string = stHash_remove(rh, (void *)name);
+static void recordHolder_insert(RecordHolder *rh, Name name, Record *record) {
+    int64_t i = recordHolder_slot(rh, name);
+    while (rh->names[i] != NULL_NAME) {
+        assert(rh->names[i] != name);
+        i = (i + 1) & (rh->capacity - 1);
+    }
+    rh->names[i] = name;
+    rh->records[i] = record;
+    rh->size++;
+}
+
+static void recordHolder_resize(RecordHolder *rh, int64_t capacity) {
+    int64_t oldCapacity = rh->capacity;
+    Name *names = rh->names;
+    Record **records = rh->records;
+    recordHolder_allocate(rh, capacity);
+    for (int64_t i = 0; i < oldCapacity; i++) {
+        if (names[i] != NULL_NAME) {
+            recordHolder_insert(rh, names[i], records[i]);
+        }
+    }
+    free(names);
+    free(records);
+}
+
+static void recordHolder_addRecord(RecordHolder *rh, Name name, Record *record) {
+    assert(name != NULL_NAME);
+    if (2 * (rh->size + 1) > rh->capacity) { // Keep the load at most a half
+        recordHolder_resize(rh, 2 * rh->capacity);
+    }
+    recordHolder_insert(rh, name, record);
+}
+
+void recordHolder_add(RecordHolder *rh, Name name, char *string) {
+    recordHolder_addRecord(rh, name, record_construct(string));
+}
+
+static Record *recordHolder_remove(RecordHolder *rh, Name name) {
+    int64_t i = recordHolder_find(rh, name);
+    if (i == -1) {
+        return NULL;
+    }
+    Record *record = rh->records[i];
+    rh->names[i] = NULL_NAME;
+    rh->size--;
+    // Shift back the following entries of the probe run that can move into the hole, so no tombstones are needed
+    int64_t mask = rh->capacity - 1;
+    for (int64_t j = (i + 1) & mask; rh->names[j] != NULL_NAME; j = (j + 1) & mask) {
+        int64_t k = recordHolder_slot(rh, rh->names[j]);
+        // The entry at j can move to the hole at i if its home slot k is not cyclically within (i, j]
+        if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+            rh->names[i] = rh->names[j];
+            rh->records[i] = rh->records[j];
+            rh->names[j] = NULL_NAME;
+            i = j;
+        }
+    }
+    return record;
+}
+
+char *recordHolder_removeString(RecordHolder *rh, Name name) {
+    Record *record = recordHolder_remove(rh, name);
+    if (record == NULL) {
+        return NULL;
+    }
+    char *string = st_malloc(record->length + 1);
+    *record_copy(record, string) = '\0';
+    record_destruct(record);
     return string;
 }
 
 void recordHolder_transferAll(RecordHolder *rhToAddTo, RecordHolder *rhToAdd) {
-    stHashIterator *it = stHash_getIterator(rhToAdd);
-    void *name;
-    while((name = stHash_getNext(it)) != NULL) {
-        char *string = stHash_remove(rhToAdd, name);
-        assert(string != NULL);
-        assert(stHash_search(rhToAddTo, name) == NULL);
-        stHash_insert(rhToAddTo, name, string);
+    if (rhToAdd->size > rhToAddTo->size) { // Move the smaller set of records into the larger table
+        RecordHolder swap = *rhToAddTo;
+        *rhToAddTo = *rhToAdd;
+        *rhToAdd = swap;
+    }
+    for (int64_t i = 0; i < rhToAdd->capacity; i++) {
+        if (rhToAdd->names[i] != NULL_NAME) {
+            recordHolder_addRecord(rhToAddTo, rhToAdd->names[i], rhToAdd->records[i]);
+            rhToAdd->names[i] = NULL_NAME;
+        }
+    }
+    rhToAdd->size = 0;
+    recordHolder_destruct(rhToAdd);
+}
+
+static void cacheNonNestedRecordsForCap(RecordHolder *rh, Cap *cap, char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg) {
+    while (1) {
+        Cap *adjacentCap = cap_getAdjacency(cap);
+        assert(adjacentCap != NULL);
+        Group *group = end_getGroup(cap_getEnd(cap));
+        assert(group != NULL);
+        if (group_isLeaf(group)) { //Record must not be in the database already
+            recordHolder_add(rh, cap_getName(cap), terminalAdjacencyWriteFn(cap, extraArg));
+        }
+        if ((cap = cap_getOtherSegmentCap(adjacentCap)) == NULL) {
+            break;
+        }
+        Segment *segment = cap_getSegment(adjacentCap);
+        recordHolder_add(rh, segment_getName(segment), segmentWriteFn(segment, extraArg));
     }
-    stHash_destructIterator(it);
-    assert(stHash_size(rhToAdd) == 0);
-    stHash_destruct(rhToAdd);
 }
 
 static void cacheNonNestedRecords(RecordHolder *rh, stList *caps, char *(*segmentWriteFn)(Segment *, void *),
         char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg) {
     /*
      * Caches the set of terminal adjacency and segment records present in the threads.
+     * Each thread formats records into its own holder, which is merged into rh once the thread is done.
      */
-    for (int64_t i = 0; i < stList_length(caps); i++) {
-        Cap *cap = stList_get(caps, i);
-        //int64_t recordSize;
-        while (1) {
-            Cap *adjacentCap = cap_getAdjacency(cap);
-            assert(adjacentCap != NULL);
-            Group *group = end_getGroup(cap_getEnd(cap));
-            assert(group != NULL);
-            if (group_isLeaf(group)) { //Record must not be in the database already
-                recordHolder_add(rh, cap_getName(cap), terminalAdjacencyWriteFn(cap, extraArg));
-            }
-            if ((cap = cap_getOtherSegmentCap(adjacentCap)) == NULL) {
-                break;
-            }
-            Segment *segment = cap_getSegment(adjacentCap);
-            recordHolder_add(rh, segment_getName(segment), segmentWriteFn(segment, extraArg));
+#if defined(_OPENMP)
+#pragma omp parallel if(stList_length(caps) >= MIN_CAPS_FOR_PARALLEL_THREADS)
+#endif
+    {
+        RecordHolder *threadRh = recordHolder_construct();
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic)
+#endif
+        for (int64_t i = 0; i < stList_length(caps); i++) {
+            cacheNonNestedRecordsForCap(threadRh, stList_get(caps, i), segmentWriteFn, terminalAdjacencyWriteFn, extraArg);
         }
+#if defined(_OPENMP)
+#pragma omp critical(cacheNonNestedRecords)
+#endif
+        recordHolder_transferAll(rh, threadRh);
     }
 }
 
@@ -167,16 +394,18 @@ static void deleteNestedRecords(stKVDatabase *database, stList *caps) {
     stList_destruct(deleteRequests);
 }
 
-static char *getThread(RecordHolder *rh, Cap *startCap, bool deleteUsedRecords) {
+static stList *getThreadRecords(RecordHolder *rh, Cap *startCap, bool removeRecords) {
     /*
-     * Iterate through, first calculating the length of the final record, then concatenating the results.
+     * Gets the records of the thread, in order. If removeRecords is set they are also removed from rh, otherwise
+     * rh is only read, so this may be called concurrently.
      */
     Cap *cap = startCap;
-    stList *strings = stList_construct3(0, free);
-    while (1) { //Calculate the size of the entries in the DB that represent the thread.
-        char *s = recordHolder_remove(rh, cap_getName(cap));
-        assert(s != NULL);
-        stList_append(strings, s);
+    stList *records = stList_construct();
+    while (1) {
+        Record *record = removeRecords ? recordHolder_remove(rh, cap_getName(cap)) :
+                                         recordHolder_get(rh, cap_getName(cap));
+        assert(record != NULL);
+        stList_append(records, record);
 
         Cap *adjacentCap = cap_getAdjacency(cap);
         assert(adjacentCap != NULL);
@@ -184,15 +413,42 @@ static char *getThread(RecordHolder *rh, Cap *startCap, bool deleteUsedRecords)
         if ((cap = cap_getOtherSegmentCap(adjacentCap)) == NULL) {
             break;
         }
-        s = recordHolder_remove(rh, segment_getName(cap_getSegment(adjacentCap)));
-        assert(s != NULL);
-        stList_append(strings, s);
+        Name segmentName = segment_getName(cap_getSegment(adjacentCap));
+        record = removeRecords ? recordHolder_remove(rh, segmentName) : recordHolder_get(rh, segmentName);
+        assert(record != NULL);
+        stList_append(records, record);
+    }
+    return records;
+}
+
+static char *getThread(RecordHolder *rh, Cap *startCap) {
+    /*
+     * Concatenates the records of the thread. Only reads rh, so may be called concurrently.
+     */
+    stList *records = getThreadRecords(rh, startCap, 0);
+    int64_t length = 0;
+    for (int64_t i = 0; i < stList_length(records); i++) {
+        length += ((Record *)stList_get(records, i))->length;
     }
-    char *string = stString_join2("", strings);
-    stList_destruct(strings);
+    char *string = st_malloc(sizeof(char) * (length + 1));
+    char *end = string;
+    for (int64_t i = 0; i < stList_length(records); i++) {
+        end = record_copy(stList_get(records, i), end);
+    }
+    *end = '\0';
+    stList_destruct(records);
     return string;
 }
 
+static void deleteThreadRecords(RecordHolder *rh, Cap *startCap) {
+    /*
+     * Removes and frees the records used to build the thread.
+     */
+    stList *records = getThreadRecords(rh, startCap, 1);
+    stList_setDestructor(records, (void (*)(void *))record_destruct);
+    stList_destruct(records);
+}
+
 void buildRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *, void *),
                            char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg) {
     //Cache records
@@ -202,7 +458,7 @@ void buildRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segment
     stList *records = stList_construct3(stList_length(caps), (void(*)(void *)) stKVDatabaseBulkRequest_destruct);
     for (int64_t i = 0; i < stList_length(caps); i++) {
         Cap *cap = stList_get(caps, i);
-        char *string = getThread(rh, cap, 0);
+        char *string = getThread(rh, cap);
         assert(string != NULL);
         stList_set(records, i, stKVDatabaseBulkRequest_constructInsertRequest(cap_getName(cap),
                                                                               string, sizeof(char)*(strlen(string)+1)));
@@ -225,11 +481,19 @@ void buildRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segment
 }
 
 stList *buildRecursiveThreadsInListP(RecordHolder *rh, stList *caps, bool deleteUsedRecords) {
-    //Build new threads
+    //Build new threads, in the order of the caps whichever thread builds them
     stList *threadStrings = stList_construct3(stList_length(caps), free);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic) if(stList_length(caps) >= MIN_CAPS_FOR_PARALLEL_THREADS)
+#endif
     for (int64_t i = 0; i < stList_length(caps); i++) {
-        Cap *cap = stList_get(caps, i);
-        stList_set(threadStrings, i, getThread(rh, cap, deleteUsedRecords));
+        stList_set(threadStrings, i, getThread(rh, stList_get(caps, i)));
+    }
+    //The hash is not safe to modify concurrently, so the used records are removed afterwards
+    if (deleteUsedRecords) {
+        for (int64_t i = 0; i < stList_length(caps); i++) {
+            deleteThreadRecords(rh, stList_get(caps, i));
+        }
     }
     return threadStrings;
 }
@@ -248,12 +512,13 @@ void buildRecursiveThreadsNoDb(RecordHolder *rh, stList *caps, char *(*segmentWr
     //Cache records
     cacheNonNestedRecords(rh, caps, segmentWriteFn, terminalAdjacencyWriteFn, extraArg);
 
-    //Build new threads and add to cache
+    //Build new threads and add to cache. Each thread is a composite of the records it is made from, which are
+    //moved out of the cache rather than copied.
     for (int64_t i = 0; i < stList_length(caps); i++) {
         Cap *cap = stList_get(caps, i);
-        char *string = getThread(rh, cap, 1);
-        assert(string != NULL);
-        recordHolder_add(rh, cap_getName(cap), string);
+        stList *records = getThreadRecords(rh, cap, 1);
+        recordHolder_addRecord(rh, cap_getName(cap), record_constructComposite(records));
+        stList_destruct(records);
     }
 }
 
@@ -263,4 +528,36 @@ stList *buildRecursiveThreadsInListNoDb(RecordHolder *rh, stList *caps, char *(*
     return buildRecursiveThreadsInListP(rh, caps, 1);
 }
 
+static void writeThread(RecordHolder *rh, Cap *startCap, FILE *fileHandle) {
+    /*
+     * Writes the records of the thread in the same order as getThread concatenates them, removing and freeing
+     * each as it goes.
+     */
+    stList *records = getThreadRecords(rh, startCap, 1);
+    for (int64_t i = 0; i < stList_length(records); i++) {
+        Record *record = stList_get(records, i);
+        record_write(record, fileHandle);
+        record_destruct(record);
+    }
+    stList_destruct(records);
+}
+
+void writeRecursiveThreadsNoDb(RecordHolder *rh, stList *caps, char *(*segmentWriteFn)(Segment *, void *),
+                               char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg,
+                               bool (*threadStartFn)(Cap *, FILE *, void *),
+                               void (*threadEndFn)(Cap *, FILE *, void *), FILE *fileHandle) {
+    cacheNonNestedRecords(rh, caps, segmentWriteFn, terminalAdjacencyWriteFn, extraArg);
+    for (int64_t i = 0; i < stList_length(caps); i++) {
+        Cap *cap = stList_get(caps, i);
+        if (threadStartFn == NULL || threadStartFn(cap, fileHandle, extraArg)) {
+            writeThread(rh, cap, fileHandle);
+            if (threadEndFn != NULL) {
+                threadEndFn(cap, fileHandle, extraArg);
+            }
+        } else {
+            deleteThreadRecords(rh, cap);
+        }
+    }
+}
+
 
@@ -26,6 +26,34 @@ extern const char *REFERENCE_BUILDING_EXCEPTION;
  */
 void cactus_make_reference(stList *flowers, char *referenceEventString, CactusDisk *cactusDisk, CactusParams *params);
 
+/*
+ * The reference building parameters, parsed once from the cactus params.
+ */
+typedef struct _referenceParameters {
+    char *referenceEventString;
+    int64_t permutations;
+    stList *(*matchingAlgorithm)(stList *edges, int64_t nodeNumber);
+    double (*temperatureFn)(double);
+    double theta;
+    double phi;
+    int64_t maxWalkForCalculatingZ;
+    bool ignoreUnalignedGaps;
+    double wiggle;
+    int64_t numberOfNsForScaffoldGap;
+    int64_t minNumberOfSequencesToSupportAdjacency;
+    bool makeScaffolds;
+} ReferenceParameters;
+
+ReferenceParameters *referenceParameters_constructFromCactusParams(CactusParams *params, char *referenceEventString);
+
+void referenceParameters_destruct(ReferenceParameters *p);
+
+/*
+ * Builds the reference for a single flower. The reference of the flower's parent must already have been built.
+ * Flowers that are not ancestors or descendants of one another may be processed concurrently.
+ */
+void cactus_make_reference_for_flower(Flower *flower, ReferenceParameters *p);
+
 /*
  * Construct a reference for the flower, top down.
  */
@@ -16,7 +16,7 @@ stList *buildRecursiveThreadsInList(stKVDatabase *database, stList *caps,
         char *(*segmentWriteFn)(Segment *, void *),
         char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg);
 
-typedef stHash RecordHolder;
+typedef struct _recordHolder RecordHolder;
 
 RecordHolder *recordHolder_construct();
 
@@ -25,7 +25,18 @@ void recordHolder_destruct(RecordHolder *rh);
 int64_t recordHolder_size(RecordHolder *rh);
 
 /*
- * Removes the records from rhToAdd and puts them in rhToAddTo, leaving rhToAdd empty.
+ * Adds a record of the string, taking ownership of the string. The name must not already be in the holder.
+ */
+void recordHolder_add(RecordHolder *rh, Name name, char *string);
+
+/*
+ * Removes the record of the name, returning its string (which the caller must free), or NULL if there is none.
+ */
+char *recordHolder_removeString(RecordHolder *rh, Name name);
+
+/*
+ * Moves the records of rhToAdd into rhToAddTo and destructs rhToAdd. The records of the smaller holder are moved
+ * into the table of the larger, so the cost is proportional to the smaller of the two.
  */
 void recordHolder_transferAll(RecordHolder *rhToAddTo, RecordHolder *rhToAdd);
 
@@ -35,4 +46,15 @@ void buildRecursiveThreadsNoDb(RecordHolder *rh, stList *caps, char *(*segmentWr
 stList *buildRecursiveThreadsInListNoDb(RecordHolder *rh, stList *caps, char *(*segmentWriteFn)(Segment *, void *),
                                         char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg);
 
+/*
+ * As buildRecursiveThreadsInListNoDb, but streams each thread to the file record by record instead of returning the
+ * threads as strings, freeing the records as they are written, so no thread is ever held as a single string.
+ * Before each thread threadStartFn (if not NULL) is called with the cap the thread starts from; if it returns false
+ * the thread is skipped. After each thread written threadEndFn (if not NULL) is called.
+ */
+void writeRecursiveThreadsNoDb(RecordHolder *rh, stList *caps, char *(*segmentWriteFn)(Segment *, void *),
+                               char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg,
+                               bool (*threadStartFn)(Cap *, FILE *, void *),
+                               void (*threadEndFn)(Cap *, FILE *, void *), FILE *fileHandle);
+
 #endif /* RECURSIVETHREADBUILDER_H_ */
@@ -92,8 +92,221 @@ static void recursiveFileBuilder_test(CuTest *testCase) {
     stFile_rmtree(tempDir);
 }
 
+static CactusDisk *makeManyThreads(int64_t threadNumber, stList *caps, stList *expectedStrings) {
+    //Make a flower with enough threads for the records to be built in parallel, each thread
+    //containing a segment of one block flanked by two terminal adjacencies.
+
+    CactusDisk *cactusDisk = cactusDisk_construct();
+    eventTree_construct2(cactusDisk);
+    Flower *flower = flower_construct(cactusDisk);
+    End *end1 = end_construct2(0, 1, flower);
+    End *end2 = end_construct2(1, 1, flower);
+    Block *block = block_construct(2, flower);
+    Event *event = eventTree_getRootEvent(flower_getEventTree(flower));
+
+    for (int64_t i = 0; i < threadNumber; i++) {
+        char string[7];
+        for (int64_t j = 0; j < 6; j++) {
+            string[j] = "ACGT"[st_randomInt(0, 4)];
+        }
+        string[6] = '\0';
+        char *header = stString_print("sequence%" PRIi64, i);
+        Sequence *sequence = sequence_construct(1, 6, string, header, event, cactusDisk);
+        free(header);
+        flower_addSequence(flower, sequence);
+        Cap *cap1 = cap_construct2(end1, 0, 1, sequence);
+        Cap *cap2 = cap_construct2(end2, 7, 1, sequence);
+        Segment *segment = segment_construct2(block, 3, 1, sequence);
+        cap_makeAdjacent(cap1, segment_get5Cap(segment));
+        cap_makeAdjacent(segment_get3Cap(segment), cap2);
+        stList_append(caps, cap1);
+        stList_append(expectedStrings, stString_print("0 %.2s 3 %.2s 4 %.2s ", string, string + 2, string + 4));
+    }
+
+    Group *group = group_construct2(flower);
+    End *end;
+    Flower_EndIterator *endIt = flower_getEndIterator(flower);
+    while((end = flower_getNextEnd(endIt)) != NULL) {
+        end_setGroup(end, group);
+    }
+    flower_destructEndIterator(endIt);
+    return cactusDisk;
+}
+
+static void recursiveFileBuilder_testManyThreads(CuTest *testCase) {
+    int64_t threadNumber = 200;
+    stList *caps = stList_construct();
+    stList *expectedStrings = stList_construct3(0, free);
+    CactusDisk *cactusDisk = makeManyThreads(threadNumber, caps, expectedStrings);
+
+    RecordHolder *rh = recordHolder_construct();
+    stList *threadStrings = buildRecursiveThreadsInListNoDb(rh, caps, writeSegment, writeTerminalAdjacency, NULL);
+
+    //The threads come back in the order of the caps, and all the used records are consumed
+    CuAssertIntEquals(testCase, threadNumber, stList_length(threadStrings));
+    for (int64_t i = 0; i < threadNumber; i++) {
+        CuAssertStrEquals(testCase, stList_get(expectedStrings, i), stList_get(threadStrings, i));
+    }
+    CuAssertIntEquals(testCase, 0, recordHolder_size(rh));
+
+    recordHolder_destruct(rh);
+    stList_destruct(threadStrings);
+    stList_destruct(expectedStrings);
+    stList_destruct(caps);
+    cactusDisk_destruct(cactusDisk);
+}
+
+static bool writeThreadStart(Cap *cap, FILE *fileHandle, void *extraArg) {
+    //Skip every other thread
+    int64_t *threadIndex = extraArg;
+    if ((*threadIndex)++ % 2 == 1) {
+        return 0;
+    }
+    fprintf(fileHandle, "%s: ", sequence_getHeader(cap_getSequence(cap)));
+    return 1;
+}
+
+static void writeThreadEnd(Cap *cap, FILE *fileHandle, void *extraArg) {
+    fprintf(fileHandle, "\n");
+}
+
+static void recursiveFileBuilder_testWriteThreads(CuTest *testCase) {
+    int64_t threadNumber = 200;
+    stList *caps = stList_construct();
+    stList *expectedStrings = stList_construct3(0, free);
+    CactusDisk *cactusDisk = makeManyThreads(threadNumber, caps, expectedStrings);
+
+    RecordHolder *rh = recordHolder_construct();
+    FILE *fileHandle = tmpfile();
+    int64_t threadIndex = 0;
+    writeRecursiveThreadsNoDb(rh, caps, writeSegment, writeTerminalAdjacency, &threadIndex,
+                              writeThreadStart, writeThreadEnd, fileHandle);
+
+    //The streamed threads match the built ones, in order, and all the records are consumed, including those of
+    //the skipped threads
+    CuAssertIntEquals(testCase, threadNumber, threadIndex);
+    CuAssertIntEquals(testCase, 0, recordHolder_size(rh));
+    rewind(fileHandle);
+    for (int64_t i = 0; i < threadNumber; i += 2) {
+        char *line = stFile_getLineFromFile(fileHandle);
+        CuAssertTrue(testCase, line != NULL);
+        char *expectedLine = stString_print("sequence%" PRIi64 ": %s", i, (char *)stList_get(expectedStrings, i));
+        CuAssertStrEquals(testCase, expectedLine, line);
+        free(expectedLine);
+        free(line);
+    }
+    CuAssertTrue(testCase, stFile_getLineFromFile(fileHandle) == NULL);
+    fclose(fileHandle);
+
+    recordHolder_destruct(rh);
+    stList_destruct(expectedStrings);
+    stList_destruct(caps);
+    cactusDisk_destruct(cactusDisk);
+}
+
+/*
+ * Applies random adds and removes of the given names to the record holder and to a reference hash of the names to
+ * their strings, checking they agree.
+ */
+static void recordHolder_randomOperations(CuTest *testCase, RecordHolder *rh, stHash *expected, stList *names,
+                                          int64_t operationNumber) {
+    for (int64_t i = 0; i < operationNumber; i++) {
+        Name name = (Name)stList_get(names, st_randomInt(0, stList_length(names)));
+        char *expectedString = stHash_search(expected, (void *)name);
+        if (st_random() > 0.5) {
+            if (expectedString == NULL) {
+                recordHolder_add(rh, name, stString_print("record%" PRIi64, name));
+                stHash_insert(expected, (void *)name, stString_print("record%" PRIi64, name));
+            }
+        } else {
+            char *string = recordHolder_removeString(rh, name);
+            CuAssertIntEquals(testCase, expectedString == NULL, string == NULL);
+            if (string != NULL) {
+                CuAssertStrEquals(testCase, expectedString, string);
+                free(stHash_remove(expected, (void *)name));
+                free(string);
+            }
+        }
+        CuAssertIntEquals(testCase, stHash_size(expected), recordHolder_size(rh));
+    }
+}
+
+/*
+ * Removes all the records, checking they match the reference hash, which is left empty.
+ */
+static void recordHolder_checkAndEmpty(CuTest *testCase, RecordHolder *rh, stHash *expected) {
+    stList *names = stHash_getKeys(expected);
+    for (int64_t i = 0; i < stList_length(names); i++) {
+        Name name = (Name)stList_get(names, i);
+        char *string = recordHolder_removeString(rh, name);
+        CuAssertTrue(testCase, string != NULL);
+        CuAssertStrEquals(testCase, stHash_search(expected, (void *)name), string);
+        free(stHash_remove(expected, (void *)name));
+        free(string);
+    }
+    stList_destruct(names);
+    CuAssertIntEquals(testCase, 0, recordHolder_size(rh));
+}
+
+static void recordHolder_testWrapAroundCluster(CuTest *testCase) {
+    // Names whose home slots in the initial table of 16 slots (as computed by recordHolder_slot) are the last two,
+    // so their probe runs wrap around to the start of the table. Eight of them fit without a resize.
+    stList *names = stList_construct();
+    for (Name name = 1; stList_length(names) < 8; name++) {
+        if ((((uint64_t)name) * 0x9E3779B97F4A7C15ULL) >> 60 >= 14) {
+            stList_append(names, (void *)name);
+        }
+    }
+    for (int64_t test = 0; test < 100; test++) {
+        RecordHolder *rh = recordHolder_construct();
+        stHash *expected = stHash_construct2(NULL, free);
+        recordHolder_randomOperations(testCase, rh, expected, names, 100);
+        recordHolder_checkAndEmpty(testCase, rh, expected);
+        stHash_destruct(expected);
+        recordHolder_destruct(rh);
+    }
+    stList_destruct(names);
+}
+
+static void recordHolder_testRandom(CuTest *testCase) {
+    for (int64_t test = 0; test < 20; test++) {
+        RecordHolder *rh = recordHolder_construct();
+        stHash *expected = stHash_construct2(NULL, free);
+        for (int64_t round = 0; round < 10; round++) {
+            // Consecutive names, as made by cactusDisk_getUniqueID, distinct between rounds
+            stList *names = stList_construct();
+            int64_t nameNumber = st_randomInt(1, 1000);
+            for (int64_t i = 0; i < nameNumber; i++) {
+                stList_append(names, (void *)(1 + round * 1000 + i));
+            }
+            if (st_random() > 0.5) {
+                recordHolder_randomOperations(testCase, rh, expected, names, st_randomInt(0, 3000));
+            } else {
+                // Fill a second holder and transfer it, in whichever direction
+                RecordHolder *rh2 = recordHolder_construct();
+                recordHolder_randomOperations(testCase, rh2, expected, names, st_randomInt(0, 3000));
+                if (st_random() > 0.5) {
+                    recordHolder_transferAll(rh, rh2);
+                } else {
+                    recordHolder_transferAll(rh2, rh);
+                    rh = rh2;
+                }
+                CuAssertIntEquals(testCase, stHash_size(expected), recordHolder_size(rh));
+            }
+            stList_destruct(names);
+        }
+        recordHolder_checkAndEmpty(testCase, rh, expected);
+        stHash_destruct(expected);
+        recordHolder_destruct(rh);
+    }
+}
+
 CuSuite* recursiveThreadBuilderTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, recursiveFileBuilder_test);
+    SUITE_ADD_TEST(suite, recursiveFileBuilder_testManyThreads);
+    SUITE_ADD_TEST(suite, recursiveFileBuilder_testWriteThreads);
+    SUITE_ADD_TEST(suite, recordHolder_testWrapAroundCluster);
+    SUITE_ADD_TEST(suite, recordHolder_testRandom);
     return suite;
 }
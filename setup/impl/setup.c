@@ -1,4 +1,5 @@
 #include "cactus.h"
+#include "cactus_setup.h"
 #include "sonLib.h"
 #include "bioioC.h"
 #include <stdio.h>
@@ -61,6 +62,7 @@ bool getCompleteStatus(const char *fileName) {
 typedef struct _processSequenceVars {
     bool isComplete;
     Event *event;
+    EventTree *eventTree;
     int64_t totalSequenceNumber;
     Flower *flower;
     CactusDisk *cactusDisk;
@@ -83,61 +85,96 @@ void processSequence(void* destination, const char *fastaHeader, const char *str
     p->totalSequenceNumber++;
 }
 
-static int64_t assignSequences(CactusDisk *cactusDisk, Flower *flower, EventTree *eventTree, char *sequenceFilesAndEvents) {
+/*
+ * Calls fileFn for each fasta file given in the space separated list of event names and files (or directories of
+ * files).
+ */
+static void forEachSequenceFile(char *sequenceFilesAndEvents,
+                                void (*fileFn)(const char *eventName, const char *fileName, void *extraArg),
+                                void *extraArg) {
     stList *sequenceFilesAndEventsList = stString_split(sequenceFilesAndEvents);
     if (stList_length(sequenceFilesAndEventsList) % 2 != 0) {
         stList_destruct(sequenceFilesAndEventsList);
         st_errAbort("Sequences weren't provided in a proper "
                     "'event seq' space-separated format");
     }
-    ProcessSequenceVars p; // Struct to pass around storing variables for
-    // making sequences
-    p.totalSequenceNumber = 0;
-    p.flower = flower;
-    p.cactusDisk = cactusDisk;
 
     for (int64_t i = 0; i < stList_length(sequenceFilesAndEventsList); i += 2) {
         char *eventName = stList_get(sequenceFilesAndEventsList, i);
         char *fileName = stList_get(sequenceFilesAndEventsList, i+1);
 
-        st_logInfo("Assigning sequence %s to %s\n", fileName, eventName);
-
         if (!stFile_exists(fileName)) {
             st_errAbort("File does not exist: %s\n", fileName);
         }
 
-        // Set the global "event" variable, which is needed for the
-        // function provided to fastaReadToFunction.
-        p.event = eventTree_getEventByHeader(eventTree, eventName);
-        if (p.event == NULL) {
-            st_errAbort("No such event: %s", eventName);
-        }
         if (stFile_isDir(fileName)) {
             st_logInfo("Processing directory: %s\n", fileName);
             stList *filesInDir = stFile_getFileNamesInDirectory(fileName);
             for (int64_t j = 0; j < stList_length(filesInDir); j++) {
                 char *absChildFileName = stFile_pathJoin(fileName, stList_get(filesInDir, j));
                 assert(stFile_exists(absChildFileName));
-                p.isComplete = getCompleteStatus(absChildFileName); //decide if the sequences in the file should be free or attached.
-                FILE *fileHandle = fopen(absChildFileName, "r");
-                fastaReadToFunction(fileHandle, &p, processSequence);
-                fclose(fileHandle);
+                fileFn(eventName, absChildFileName, extraArg);
                 free(absChildFileName);
             }
             stList_destruct(filesInDir);
         } else {
             st_logInfo("Processing file: %s\n", fileName);
-            p.isComplete = getCompleteStatus(fileName); //decide if the sequences in the file should be free or attached.
-            FILE *fileHandle = fopen(fileName, "r");
-            fastaReadToFunction(fileHandle, &p, processSequence);
-            fclose(fileHandle);
+            fileFn(eventName, fileName, extraArg);
         }
     }
     stList_destruct(sequenceFilesAndEventsList);
+}
+
+static void assignSequencesFromFile(const char *eventName, const char *fileName, void *extraArg) {
+    ProcessSequenceVars *p = extraArg;
+
+    st_logInfo("Assigning sequence %s to %s\n", fileName, eventName);
+
+    // Set the "event" variable, which is needed for the
+    // function provided to fastaReadToFunction.
+    p->event = eventTree_getEventByHeader(p->eventTree, eventName);
+    if (p->event == NULL) {
+        st_errAbort("No such event: %s", eventName);
+    }
+    p->isComplete = getCompleteStatus(fileName); //decide if the sequences in the file should be free or attached.
+    FILE *fileHandle = fopen(fileName, "r");
+    fastaReadToFunction(fileHandle, p, processSequence);
+    fclose(fileHandle);
+}
 
+static int64_t assignSequences(CactusDisk *cactusDisk, Flower *flower, EventTree *eventTree, char *sequenceFilesAndEvents) {
+    ProcessSequenceVars p; // Struct to pass around storing variables for
+    // making sequences
+    p.totalSequenceNumber = 0;
+    p.flower = flower;
+    p.cactusDisk = cactusDisk;
+    p.eventTree = eventTree;
+    forEachSequenceFile(sequenceFilesAndEvents, assignSequencesFromFile, &p);
     return p.totalSequenceNumber;
 }
 
+static void summariseSequence(void *destination, const char *fastaHeader, const char *string, int64_t length) {
+    SequenceSummary *summary = destination;
+    summary->sequenceNumber++;
+    summary->totalSequenceLength += length;
+    if (length > summary->maxSequenceLength) {
+        summary->maxSequenceLength = length;
+    }
+}
+
+static void summariseSequencesInFile(const char *eventName, const char *fileName, void *extraArg) {
+    FILE *fileHandle = fopen(fileName, "r");
+    fastaReadToFunction(fileHandle, extraArg, summariseSequence);
+    fclose(fileHandle);
+}
+
+void cactus_setup_summariseSequences(char *sequenceFilesAndEvents, SequenceSummary *summary) {
+    summary->sequenceNumber = 0;
+    summary->totalSequenceLength = 0;
+    summary->maxSequenceLength = 0;
+    forEachSequenceFile(sequenceFilesAndEvents, summariseSequencesInFile, summary);
+}
+
 static int64_t constructEvents(Event *parentEvent, stTree *tree, EventTree *eventTree) {
     Event *myEvent = NULL; // To distinguish from the global "event" variable.
     assert(tree != NULL);
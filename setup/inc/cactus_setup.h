@@ -13,4 +13,16 @@
 Flower *cactus_setup_first_flower(CactusDisk *cactusDisk, CactusParams *params,
                                   char *speciesTree, char *outgroupEvents, char *sequenceFilesAndEvents);
 
+typedef struct _sequenceSummary {
+    int64_t sequenceNumber;
+    int64_t totalSequenceLength;
+    int64_t maxSequenceLength;
+} SequenceSummary;
+
+/*
+ * Reads the sequence files in the same format as cactus_setup_first_flower, totalling the number and lengths of
+ * the sequences without keeping them.
+ */
+void cactus_setup_summariseSequences(char *sequenceFilesAndEvents, SequenceSummary *summary);
+
 #endif /* ST_CACTUS_SETUP_H_ */